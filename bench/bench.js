@@ -0,0 +1,148 @@
+/*
+ * JS-level benchmarks of the vector types against plain Array and, when
+ * the engine has them, Int32Array and Float32Array.  Sizes run from 10^3
+ * up to --max (default 10^6).  Each result is printed as one JSON object
+ * per line, in the same form as the native benchmarks:
+ *
+ *   {"suite":"intvec","case":"get","impl":"IntVec","n":1000,"ns_per_elem":3.1,...}
+ *
+ * Usage: node bench/bench.js [--max N] [--suite NAME] [--case NAME]
+ */
+
+var vec = require("../build/default/vec");
+
+var opts = { max: 1e6, suite: null, kase: null };
+for (var a = 2; a < process.argv.length; ++a) {
+  var arg = process.argv[a];
+  if (arg == '--max') { opts.max = Number(process.argv[++a]); }
+  else if (arg == '--suite') { opts.suite = process.argv[++a]; }
+  else if (arg == '--case') { opts.kase = process.argv[++a]; }
+  else { console.error("usage: node bench/bench.js [--max N] [--suite NAME] [--case NAME]"); process.exit(1); }
+}
+
+var sink;
+
+// Milliseconds per call: the best of 3 samples, each repeating fn enough
+// times to last at least 20ms, since Date.now() only counts milliseconds.
+function time(fn) {
+  var reps = 1, best = Infinity, t0, dt, r;
+  for (;;) {
+    t0 = Date.now();
+    for (r = 0; r < reps; ++r) { sink = fn(); }
+    if (Date.now() - t0 >= 20) { break; }
+    reps *= 2;
+  }
+  for (var sample = 0; sample < 3; ++sample) {
+    t0 = Date.now();
+    for (r = 0; r < reps; ++r) { sink = fn(); }
+    dt = (Date.now() - t0) / reps;
+    if (dt < best) { best = dt; }
+  }
+  return best;
+}
+
+function report(suite, kase, impl, n, ms) {
+  console.log(JSON.stringify({
+    suite: suite, 'case': kase, impl: impl, n: n,
+    ms: ms, ns_per_elem: ms * 1e6 / n
+  }));
+}
+
+/*
+ * An implementation is a constructor of an n-element container plus how
+ * to walk it; the vector types use their own forEach/map/reduce and the
+ * chunked forms, the baselines plain loops or Array methods.
+ */
+function arrayImpl(name, Ctor, value) {
+  return {
+    name: name,
+    make: function(n) { var v = new Ctor(n); for (var i = 0; i < n; ++i) { v[i] = value(i); } return v; },
+    forEach: function(v, cb) { for (var i = 0; i < v.length; ++i) { cb(v[i], i); } },
+    map: function(v, cb) { var r = new Ctor(v.length); for (var i = 0; i < v.length; ++i) { r[i] = cb(v[i]); } return r; },
+    reduce: function(v, init, cb) { var acc = init; for (var i = 0; i < v.length; ++i) { acc = cb(acc, v[i]); } return acc; },
+    toString: function(v) { return Array.prototype.join.call(v, ','); },
+    fromString: function(s) { var p = s.split(','), v = new Ctor(p.length); for (var i = 0; i < p.length; ++i) { v[i] = Number(p[i]); } return v; }
+  };
+}
+
+function vecImpl(name, Ctor, value) {
+  return {
+    name: name, chunked: Ctor !== vec.BitVec,
+    make: function(n) { var v = new Ctor(n); for (var i = 0; i < n; ++i) { v[i] = value(i); } return v; },
+    forEach: function(v, cb) { v.forEach(cb); },
+    map: function(v, cb) { return v.mapInto ? v.mapInto(cb) : v.map(cb); },
+    reduce: function(v, init, cb) { return v.reduce(init, cb); },
+    toString: function(v) { return v.toString(); },
+    fromString: function(s) { return new Ctor(s); }
+  };
+}
+
+function suites() {
+  var intValue = function(i) { return (i * 7) % 1000; };
+  var floatValue = function(i) { return i * 0.25; };
+  var bitValue = function(i) { return (i % 3) == 0; };
+
+  var ints = [vecImpl('IntVec', vec.IntVec, intValue), arrayImpl('Array', Array, intValue)];
+  var floats = [vecImpl('FloatVec', vec.FloatVec, floatValue), arrayImpl('Array', Array, floatValue)];
+  var bits = [vecImpl('BitVec', vec.BitVec, bitValue), arrayImpl('Array', Array, bitValue)];
+  if (typeof Int32Array != 'undefined') { ints.push(arrayImpl('Int32Array', Int32Array, intValue)); }
+  if (typeof Float32Array != 'undefined') { floats.push(arrayImpl('Float32Array', Float32Array, floatValue)); }
+
+  return { intvec: ints, floatvec: floats, bitvec: bits };
+}
+
+var cases = {
+  make: function(impl, n) { return time(function() { return impl.make(n); }); },
+
+  get: function(impl, n, v) {
+    return time(function() { var s = 0; for (var i = 0; i < n; ++i) { s += v[i]; } return s; });
+  },
+
+  set: function(impl, n, v) {
+    return time(function() { for (var i = 0; i < n; ++i) { v[i] = v[n-1-i]; } });
+  },
+
+  forEach: function(impl, n, v) {
+    return time(function() { var s = 0; impl.forEach(v, function(x) { s += x; }); return s; });
+  },
+
+  map: function(impl, n, v) {
+    return time(function() { return impl.map(v, function(x) { return x + 1; }); });
+  },
+
+  reduce: function(impl, n, v) {
+    return time(function() { return impl.reduce(v, 0, function(acc, x) { return acc + x; }); });
+  },
+
+  reduceChunk: function(impl, n, v) {
+    if (! impl.chunked) { return null; }
+    return time(function() {
+      return v.reduceChunk(0, function(acc, w) {
+        for (var i = 0; i < w.length; ++i) { acc += w[i]; }
+        return acc;
+      });
+    });
+  },
+
+  toString: function(impl, n, v) { return time(function() { return impl.toString(v); }); },
+
+  fromString: function(impl, n, v) {
+    var s = impl.toString(v);
+    return time(function() { return impl.fromString(s); });
+  }
+};
+
+var all = suites();
+for (var n = 1e3; n <= opts.max; n *= 10) {
+  for (var suite in all) {
+    if (opts.suite && suite != opts.suite) { continue; }
+    all[suite].forEach(function(impl) {
+      var v = impl.make(n);
+      for (var kase in cases) {
+        if (opts.kase && kase != opts.kase) { continue; }
+        var ms = cases[kase](impl, n, v);
+        if (ms !== null) { report(suite, kase, impl.name, n, ms); }
+      }
+    });
+  }
+}
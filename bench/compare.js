@@ -0,0 +1,44 @@
+/*
+ * Compare two benchmark runs, each a file of JSON result lines from
+ * bench.js or the native benchmarks, and list the cases that got slower
+ * by more than --threshold percent (default 10).  Exits with status 1 if
+ * there were any, so it can gate a release.
+ *
+ * Usage: node bench/compare.js baseline.json current.json [--threshold PCT]
+ */
+
+var fs = require("fs");
+
+var files = [], threshold = 10;
+for (var a = 2; a < process.argv.length; ++a) {
+  if (process.argv[a] == '--threshold') { threshold = Number(process.argv[++a]); }
+  else { files.push(process.argv[a]); }
+}
+if (files.length != 2) {
+  console.error("usage: node bench/compare.js baseline.json current.json [--threshold PCT]");
+  process.exit(2);
+}
+
+function load(file) {
+  var results = {};
+  fs.readFileSync(file, 'utf8').split('\n').forEach(function(line) {
+    if (! line.match(/^\s*\{/)) { return; }
+    var r = JSON.parse(line);
+    results[[r.suite, r['case'], r.impl, r.n].join('/')] = r;
+  });
+  return results;
+}
+
+var base = load(files[0]), cur = load(files[1]), regressions = 0;
+for (var key in cur) {
+  if (! base[key] || ! base[key].ns_per_elem) { continue; }
+  var change = 100 * (cur[key].ns_per_elem / base[key].ns_per_elem - 1);
+  var slower = change > threshold;
+  if (slower) { ++regressions; }
+  console.log((slower ? "SLOWER " : "       ") + key + " " +
+              base[key].ns_per_elem.toFixed(3) + " -> " +
+              cur[key].ns_per_elem.toFixed(3) + " ns/elem (" +
+              (change >= 0 ? "+" : "") + change.toFixed(1) + "%)");
+}
+
+process.exit(regressions ? 1 : 0);
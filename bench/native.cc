@@ -0,0 +1,232 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+/*
+ * Native microbenchmarks of the V8-free kernels behind the vector types.
+ * Each case is timed over sizes from 10^3 up to --max (default 10^7) and
+ * the best of several runs is reported, one JSON object per line:
+ *
+ *   {"suite":"native","case":"sum_f32","n":1000000,"ns_per_elem":0.21,...}
+ *
+ * Build with node-waf (target bench_native) or directly:
+ *
+ *   g++ -O2 -I.. native.cc ../kernels.cc ../parallel.cc -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "kernels.h"
+#include "stats.h"
+
+// Keeps results live so the compiler cannot drop the work.
+static volatile double sink;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Data {
+  uint32_t n;
+  int32_t *ints, *ints_out;
+  float *floats, *floats_out;
+  int8_t *bytes_a, *bytes_b;
+  uint32_t *mask, *bits_out;
+};
+
+typedef void (*bench_fn)(Data *d);
+
+static void b_sum_i32(Data *d) { sink = sum_i32(d->ints, d->n, 0); }
+static void b_sum_f32(Data *d) { sink = sum_f32(d->floats, d->n, 0); }
+static void b_sum_f32_masked(Data *d) { sink = sum_f32(d->floats, d->n, d->mask); }
+static void b_min_f32(Data *d) { sink = min_f32(d->floats, d->n, 0); }
+static void b_max_i32(Data *d) { sink = max_i32(d->ints, d->n, 0); }
+static void b_dot_i8(Data *d) { sink = dot_i8(d->bytes_a, d->bytes_b, d->n); }
+static void b_scan_i32(Data *d) { scan_i32(d->ints, d->ints_out, d->n, SCAN_SUM, false); }
+static void b_scan_f32(Data *d) { scan_f32(d->floats, d->floats_out, d->n, SCAN_SUM, false); }
+static void b_diff_f32(Data *d) { diff_f32(d->floats, d->floats_out, d->n); }
+static void b_count_bits(Data *d) { sink = count_bits(d->mask, d->n); }
+static void b_compress(Data *d)
+{
+  sink = compress_u32((const uint32_t *) d->ints, d->mask, d->n, (uint32_t *) d->ints_out);
+}
+static void b_expand(Data *d)
+{
+  sink = expand_u32((const uint32_t *) d->ints, d->n, d->mask, d->n, (uint32_t *) d->ints_out);
+}
+static void b_gt_f32(Data *d) { cmp_f32(d->floats, d->n, CMP_GT, 0.5, d->bits_out); }
+static void b_eq_i32(Data *d) { cmp_i32(d->ints, d->n, CMP_EQ, 7, d->bits_out); }
+static void b_gt_f32_vec(Data *d)
+{
+  cmp_f32_vec(d->floats, d->floats_out, d->n, CMP_GT, d->bits_out);
+}
+static void b_sqrt_f32(Data *d)
+{
+  transform(d->floats, ELEM_F32, d->n, XF_SQRT, d->floats_out, ELEM_F32);
+}
+static void b_cast_f32_i32(Data *d)
+{
+  transform(d->floats, ELEM_F32, d->n, XF_CAST, d->ints_out, ELEM_I32);
+}
+static void b_histogram_f32(Data *d)
+{
+  histogram(d->floats, d->n, 64, 0.0, 1.0, d->ints_out);
+}
+static void b_quantiles_f32(Data *d)
+{
+  double ps[3] = { 0.25, 0.5, 0.75 }, out[3];
+  memcpy(d->floats_out, d->floats, d->n * sizeof(float));
+  quantiles(d->floats_out, d->n, ps, 3, out);
+  sink = out[1];
+}
+static void b_topk_f32(Data *d)
+{
+  uint32_t k = d->n < 100 ? d->n : 100;
+  sink = top_k(d->floats, d->n, k, true, (uint32_t *) d->ints_out);
+}
+
+// The elements as a matrix of 256 (or 64) columns.
+static void b_gemv_f32(Data *d)
+{
+  gemv_f32(d->floats, d->n / 256, 256, d->floats_out, d->floats_out + 256);
+}
+static void b_gemm_f32(Data *d)
+{
+  // By a 256 x 64 matrix, which the output overwrites from its first row.
+  if (d->n < 256 * 64) { return; }
+  gemm_f32(d->floats, d->floats + d->n - 256 * 64, d->n / 256, 256, 64, d->floats_out);
+}
+static void b_knn_f32(Data *d)
+{
+  sink = knn_f32(d->floats, d->n / 64, 64, d->floats_out, 10, KNN_L2, (uint32_t *) d->ints_out, d->floats_out + 64);
+}
+
+// Element access through plain loops, the floor the vector types'
+// get/set are measured against.
+static void b_get_i32(Data *d)
+{
+  int64_t s = 0;
+  for (uint32_t i = 0; i < d->n; ++i) { s += d->ints[i]; }
+  sink = s;
+}
+static void b_set_f32(Data *d)
+{
+  for (uint32_t i = 0; i < d->n; ++i) { d->floats_out[i] = (float) i; }
+}
+
+struct Case { const char *name; bench_fn fn; };
+
+static const Case cases[] = {
+  { "get_i32", b_get_i32 },
+  { "set_f32", b_set_f32 },
+  { "sum_i32", b_sum_i32 },
+  { "sum_f32", b_sum_f32 },
+  { "sum_f32_masked", b_sum_f32_masked },
+  { "min_f32", b_min_f32 },
+  { "max_i32", b_max_i32 },
+  { "dot_i8", b_dot_i8 },
+  { "scan_i32", b_scan_i32 },
+  { "scan_f32", b_scan_f32 },
+  { "diff_f32", b_diff_f32 },
+  { "count_bits", b_count_bits },
+  { "compress_u32", b_compress },
+  { "expand_u32", b_expand },
+  { "gt_f32", b_gt_f32 },
+  { "eq_i32", b_eq_i32 },
+  { "gt_f32_vec", b_gt_f32_vec },
+  { "sqrt_f32", b_sqrt_f32 },
+  { "cast_f32_i32", b_cast_f32_i32 },
+  { "histogram_f32", b_histogram_f32 },
+  { "quantiles_f32", b_quantiles_f32 },
+  { "topk_f32", b_topk_f32 },
+  { "gemv_f32", b_gemv_f32 },
+  { "gemm_f32", b_gemm_f32 },
+  { "knn_f32", b_knn_f32 }
+};
+
+static void
+fill(Data *d, uint32_t n)
+{
+  d->n = n;
+  d->ints = (int32_t *) malloc(n * sizeof(int32_t));
+  d->ints_out = (int32_t *) malloc(n * sizeof(int32_t));
+  d->floats = (float *) malloc(n * sizeof(float));
+  d->floats_out = (float *) malloc(n * sizeof(float));
+  d->bytes_a = (int8_t *) malloc(n);
+  d->bytes_b = (int8_t *) malloc(n);
+  d->mask = (uint32_t *) malloc((n/32 + 1) * sizeof(uint32_t));
+  d->bits_out = (uint32_t *) malloc((n/32 + 1) * sizeof(uint32_t));
+
+  srand(1);
+  for (uint32_t i = 0; i < n; ++i) {
+    d->ints[i] = rand() % 1000;
+    d->floats[i] = d->floats_out[i] = rand() / (float) RAND_MAX;
+    d->bytes_a[i] = rand() % 255 - 127;
+    d->bytes_b[i] = rand() % 255 - 127;
+  }
+  for (uint32_t i = 0; i <= n/32; ++i) { d->mask[i] = rand(); }
+}
+
+static void
+release(Data *d)
+{
+  free(d->ints); free(d->ints_out); free(d->floats); free(d->floats_out);
+  free(d->bytes_a); free(d->bytes_b); free(d->mask); free(d->bits_out);
+}
+
+int
+main(int argc, char **argv)
+{
+  double max = 1e7;
+  const char *only = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (! strcmp(argv[i], "--max") && i+1 < argc) {
+      max = atof(argv[++i]);
+    } else if (! strcmp(argv[i], "--case") && i+1 < argc) {
+      only = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--max N] [--case NAME]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // The same kernels vec.cc binds, VEC_SIMD included.
+  const char *simd = simd_level_names[simd_init()];
+
+  for (double size = 1e3; size <= max; size *= 10) {
+    Data d;
+    fill(&d, (uint32_t) size);
+
+    for (size_t c = 0; c < sizeof(cases)/sizeof(cases[0]); ++c) {
+      if (only && strcmp(only, cases[c].name)) { continue; }
+
+      // At least 3 runs and about 0.2s of work; keep the best.
+      double best = INFINITY, total = 0;
+      for (int run = 0; run < 3 || (total < 0.2 && run < 10000); ++run) {
+        double t0 = now();
+        cases[c].fn(&d);
+        double dt = now() - t0;
+        total += dt;
+        best = std::min(best, dt);
+      }
+
+      printf("{\"suite\":\"native\",\"case\":\"%s\",\"impl\":\"vec\",\"simd\":\"%s\",\"n\":%u,"
+             "\"ms\":%.6f,\"ns_per_elem\":%.4f}\n",
+             cases[c].name, simd, d.n, best * 1e3, best * 1e9 / d.n);
+      fflush(stdout);
+    }
+    release(&d);
+  }
+  return 0;
+}
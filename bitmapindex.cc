@@ -0,0 +1,410 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+using namespace node;
+using namespace v8;
+
+#include "bitmapindex.h"
+#include "intvec.h"
+#include "bitvec.h"
+#include "kernels.h"
+
+// Words of rows evaluated at a time: 8192 rows, 1KB of each bitmap.
+#define QUERY_BLOCK 256
+
+BitmapIndex::~BitmapIndex()
+{
+  V8::AdjustAmountOfExternalAllocatedMemory(-(intptr_t) bytes);
+}
+
+static Persistent<FunctionTemplate> s_ct;
+
+void
+BitmapIndex::build(const int32_t *col, uint32_t n)
+{
+  length = n;
+
+  std::vector<int32_t> keys(col, col + n);
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  // Posting of each row, and the size of each posting.
+  std::vector<uint32_t> slot(n);
+  postings.resize(keys.size());
+  for (uint32_t i = 0; i < n; ++i) {
+    slot[i] = std::lower_bound(keys.begin(), keys.end(), col[i]) - keys.begin();
+    ++postings[slot[i]].count;
+  }
+
+  uint32_t words = (n+31)/32;
+  bytes = 0;
+  for (size_t k = 0; k < keys.size(); ++k) {
+    BitmapPosting &p = postings[k];
+    p.value = keys[k];
+    if (p.count >= words) {
+      p.bits.assign(words, 0);
+    } else {
+      p.rows.reserve(p.count);
+    }
+    bytes += sizeof(uint32_t) * (p.dense() ? words : p.count);
+  }
+
+  for (uint32_t i = 0; i < n; ++i) {
+    BitmapPosting &p = postings[slot[i]];
+    if (p.dense()) {
+      p.bits[i/32] |= 1u << (i%32);
+    } else {
+      p.rows.push_back(i);
+    }
+  }
+  V8::AdjustAmountOfExternalAllocatedMemory(bytes);
+}
+
+const BitmapPosting *
+BitmapIndex::find(int32_t value)
+{
+  size_t lo = 0, hi = postings.size();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo)/2;
+    if (postings[mid].value < value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < postings.size() && postings[lo].value == value ? &postings[lo] : 0;
+}
+
+/*
+ * A compiled query.  Each node writes its rows for one block of words
+ * into a buffer, either setting it or merging into it with or / and, so
+ * a run of ors (or ands) merges every term straight into one buffer and
+ * only a change of operator needs a scratch block.
+ */
+enum { Q_TERM, Q_AND, Q_OR, Q_NOT };
+enum { M_SET, M_OR, M_AND };
+
+struct QueryNode {
+  int op;
+  const BitmapPosting *term;  // 0 for a value with no rows
+  uint32_t pos;               // Cursor into a sparse term's rows
+  uint32_t estimate;          // Rough result size, to order the terms of an and
+  std::vector<QueryNode> kids;
+  std::vector<uint32_t> scratch;
+
+  QueryNode() : op(Q_TERM), term(0), pos(0), estimate(0) {}
+};
+
+static bool
+by_estimate(const QueryNode &a, const QueryNode &b)
+{
+  return a.estimate < b.estimate;
+}
+
+// Deepest query compile() accepts, so a cyclic or absurdly nested one
+// fails as a bad query instead of overflowing the stack.
+#define QUERY_DEPTH_MAX 256
+
+static bool
+compile(BitmapIndex *index, uint32_t length, Handle<Value> q, QueryNode *node, uint32_t depth)
+{
+  if (depth > QUERY_DEPTH_MAX) { return false; }
+  if (q->IsNumber()) {
+    node->op = Q_TERM;
+    node->term = q->IsInt32() ? index->find(q->Int32Value()) : 0;
+    node->estimate = node->term ? node->term->count : 0;
+    return true;
+  }
+  if (! q->IsObject()) { return false; }
+
+  Handle<Object> obj = q->ToObject();
+  Handle<Value> kids = obj;
+  if (q->IsArray()) {
+    node->op = Q_OR;
+  } else if (obj->Has(String::NewSymbol("not"))) {
+    node->op = Q_NOT;
+    node->kids.resize(1);
+    if (! compile(index, length, obj->Get(String::NewSymbol("not")), &node->kids[0], depth+1)) { return false; }
+    node->estimate = length - node->kids[0].estimate;
+    return true;
+  } else if (obj->Has(String::NewSymbol("and"))) {
+    node->op = Q_AND;
+    kids = obj->Get(String::NewSymbol("and"));
+  } else if (obj->Has(String::NewSymbol("or"))) {
+    node->op = Q_OR;
+    kids = obj->Get(String::NewSymbol("or"));
+  } else {
+    return false;
+  }
+  if (! kids->IsArray()) { return false; }
+
+  Handle<Array> list = Handle<Array>::Cast(kids);
+  node->kids.resize(list->Length());
+  uint64_t sum = 0;
+  uint32_t min = length;
+  for (uint32_t k = 0; k < list->Length(); ++k) {
+    if (! compile(index, length, list->Get(k), &node->kids[k], depth+1)) { return false; }
+    sum += node->kids[k].estimate;
+    if (node->kids[k].estimate < min) { min = node->kids[k].estimate; }
+  }
+
+  if (node->op == Q_OR) {
+    node->estimate = sum < length ? sum : length;
+  } else {
+    // The most selective terms first, so a block goes empty soonest.
+    std::sort(node->kids.begin(), node->kids.end(), by_estimate);
+    node->estimate = min;
+  }
+  return true;
+}
+
+static inline void
+merge(int mode, uint32_t *out, uint32_t w)
+{
+  switch (mode) {
+  case M_SET: *out = w; break;
+  case M_OR: *out |= w; break;
+  default: *out &= w; break;
+  }
+}
+
+static bool
+all_zero(const uint32_t *w, uint32_t nw)
+{
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < nw; ++i) { acc |= w[i]; }
+  return ! acc;
+}
+
+// Rows [32*w0, 32*(w0+nw)) of a term.
+static void
+term_block(QueryNode &q, uint32_t w0, uint32_t nw, int mode, uint32_t *out)
+{
+  const BitmapPosting *p = q.term;
+  if (! p) {
+    if (mode != M_OR) { memset(out, 0, sizeof(uint32_t) * nw); }
+    return;
+  }
+
+  if (p->dense()) {
+    const uint32_t *src = &p->bits[w0];
+    for (uint32_t i = 0; i < nw; ++i) { merge(mode, out + i, src[i]); }
+    return;
+  }
+
+  // Sparse rows are visited in block order, so a cursor finds the block's
+  // rows; blocks skipped by an empty and are stepped over here.
+  uint32_t r0 = 32*w0, r1 = 32*(w0 + nw), n = p->rows.size();
+  const uint32_t *rows = n ? &p->rows[0] : 0;
+  while (q.pos < n && rows[q.pos] < r0) { ++q.pos; }
+
+  uint32_t *dst = out;
+  if (mode == M_AND) {
+    q.scratch.resize(nw);
+    dst = &q.scratch[0];
+  }
+  if (mode != M_OR) { memset(dst, 0, sizeof(uint32_t) * nw); }
+  for (; q.pos < n && rows[q.pos] < r1; ++q.pos) {
+    uint32_t r = rows[q.pos] - r0;
+    dst[r/32] |= 1u << (r%32);
+  }
+  if (mode == M_AND) {
+    for (uint32_t i = 0; i < nw; ++i) { out[i] &= dst[i]; }
+  }
+}
+
+static void
+eval_block(QueryNode &q, uint32_t w0, uint32_t nw, int mode, uint32_t *out)
+{
+  if (q.op == Q_TERM) {
+    term_block(q, w0, nw, mode, out);
+    return;
+  }
+
+  // Set the node's rows into out directly, or merge them in when the
+  // node's own operator is the same; otherwise build them in scratch.
+  int op_mode = q.op == Q_AND ? M_AND : M_OR;
+  bool direct = q.op != Q_NOT && (mode == M_SET || mode == op_mode);
+  uint32_t *dst = out;
+  if (! direct) {
+    q.scratch.resize(nw);
+    dst = &q.scratch[0];
+  }
+
+  if (q.op == Q_NOT) {
+    eval_block(q.kids[0], w0, nw, M_SET, dst);
+    for (uint32_t i = 0; i < nw; ++i) { merge(mode, out + i, ~dst[i]); }
+    return;
+  }
+
+  int first = direct ? mode : M_SET;
+  if (q.kids.empty() && first == M_SET) {
+    memset(dst, q.op == Q_AND ? 0xff : 0, sizeof(uint32_t) * nw);
+  }
+  for (size_t k = 0; k < q.kids.size(); ++k) {
+    eval_block(q.kids[k], w0, nw, k == 0 ? first : op_mode, dst);
+    if (q.op == Q_AND && all_zero(dst, nw)) { break; }
+  }
+
+  if (! direct) {
+    for (uint32_t i = 0; i < nw; ++i) { merge(mode, out + i, dst[i]); }
+  }
+}
+
+/*
+ * Evaluate a query over all the rows, into out when given (which must
+ * hold all the words), and return the number of matching rows.
+ */
+static uint32_t
+evaluate(QueryNode &q, uint32_t length, uint32_t *out)
+{
+  uint32_t words = (length+31)/32, count = 0;
+  uint32_t block[QUERY_BLOCK];
+
+  for (uint32_t w0 = 0; w0 < words; w0 += QUERY_BLOCK) {
+    uint32_t nw = words - w0 < QUERY_BLOCK ? words - w0 : QUERY_BLOCK;
+    uint32_t *dst = out ? out + w0 : block;
+    eval_block(q, w0, nw, M_SET, dst);
+
+    // Nots set the bits past the last row.
+    if (w0 + nw == words && length % 32) { dst[nw-1] &= (1u << (length%32)) - 1; }
+    count += count_bits(dst, 32*nw);
+  }
+  return count;
+}
+
+Handle<Value>
+BitmapIndex::New(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || ! IntVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be an IntVec")));
+  }
+  BitmapIndex* hw = new BitmapIndex();
+  IntVec *col = ObjectWrap::Unwrap<IntVec>(args[0]->ToObject());
+  hw->build(col->data(), col->size());
+
+  hw->Wrap(args.This());
+  return args.This();
+}
+
+Handle<Value>
+BitmapIndex::GetLength(Local<String> property, const AccessorInfo& info)
+{
+  BitmapIndex* hw = ObjectWrap::Unwrap<BitmapIndex>(info.This());
+  return Integer::NewFromUnsigned(hw->length);
+}
+
+// The number of distinct values.
+Handle<Value>
+BitmapIndex::GetSize(Local<String> property, const AccessorInfo& info)
+{
+  BitmapIndex* hw = ObjectWrap::Unwrap<BitmapIndex>(info.This());
+  return Integer::NewFromUnsigned(hw->postings.size());
+}
+
+// The distinct values, in increasing order, as an IntVec.
+Handle<Value>
+BitmapIndex::GetValues(Local<String> property, const AccessorInfo& info)
+{
+  HandleScope scope;
+  BitmapIndex* hw = ObjectWrap::Unwrap<BitmapIndex>(info.This());
+
+  Handle<Object> ret = IntVec::NewInstance(hw->postings.size());
+  int32_t *out = ObjectWrap::Unwrap<IntVec>(ret)->data();
+  for (size_t k = 0; k < hw->postings.size(); ++k) { out[k] = hw->postings[k].value; }
+  return scope.Close(ret);
+}
+
+/*
+ * The rows holding a value, as a BitVec.
+ */
+Handle<Value>
+BitmapIndex::Get(const Arguments& args)
+{
+  HandleScope scope;
+  BitmapIndex* hw = ObjectWrap::Unwrap<BitmapIndex>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsNumber()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a number")));
+  }
+  const BitmapPosting *p = args[0]->IsInt32() ? hw->find(args[0]->Int32Value()) : 0;
+
+  Handle<Object> ret = BitVec::NewInstance(hw->length);
+  uint32_t *out = ObjectWrap::Unwrap<BitVec>(ret)->data();
+  if (p && p->dense()) {
+    memcpy(out, &p->bits[0], sizeof(uint32_t) * p->bits.size());
+  } else if (p) {
+    for (size_t i = 0; i < p->rows.size(); ++i) { out[p->rows[i]/32] |= 1u << (p->rows[i]%32); }
+  }
+  return scope.Close(ret);
+}
+
+/*
+ * The rows matching a query, as a BitVec.
+ */
+Handle<Value>
+BitmapIndex::Query(const Arguments& args)
+{
+  HandleScope scope;
+  BitmapIndex* hw = ObjectWrap::Unwrap<BitmapIndex>(args.This());
+
+  QueryNode q;
+  if (args.Length() < 1 || ! compile(hw, hw->length, args[0], &q, 0)) {
+    return ThrowException(Exception::TypeError(String::New("Bad query")));
+  }
+
+  Handle<Object> ret = BitVec::NewInstance(hw->length);
+  evaluate(q, hw->length, ObjectWrap::Unwrap<BitVec>(ret)->data());
+  return scope.Close(ret);
+}
+
+/*
+ * The number of rows matching a query, without building them.
+ */
+Handle<Value>
+BitmapIndex::Count(const Arguments& args)
+{
+  HandleScope scope;
+  BitmapIndex* hw = ObjectWrap::Unwrap<BitmapIndex>(args.This());
+
+  QueryNode q;
+  if (args.Length() < 1 || ! compile(hw, hw->length, args[0], &q, 0)) {
+    return ThrowException(Exception::TypeError(String::New("Bad query")));
+  }
+
+  uint32_t n = q.op == Q_TERM ? q.estimate : evaluate(q, hw->length, 0);
+  return scope.Close(Integer::NewFromUnsigned(n));
+}
+
+void
+BitmapIndex::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("BitmapIndex"));
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "get", Get);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "query", Query);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "count", Count);
+
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("length"), GetLength);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("size"), GetSize);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("values"), GetValues);
+
+  target->Set(String::NewSymbol("BitmapIndex"), s_ct->GetFunction());
+}
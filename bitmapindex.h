@@ -0,0 +1,68 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef BITMAPINDEX_H
+#define BITMAPINDEX_H
+
+#include <v8.h>
+#include <node.h>
+
+#include <vector>
+
+using namespace node;
+using namespace v8;
+
+/*
+ * The rows holding one value of the indexed column: a sorted list of row
+ * numbers when that is smaller than a bitmap of all the rows, otherwise
+ * the bitmap.
+ */
+struct BitmapPosting {
+  int32_t value;
+  uint32_t count;
+  std::vector<uint32_t> rows;
+  std::vector<uint32_t> bits;
+
+  bool dense() const { return ! bits.empty(); }
+};
+
+/*
+ * A bitmap index over a snapshot of an IntVec column, with one posting
+ * per distinct value.  Queries combine values with and, or and not, and
+ * are evaluated natively a block of rows at a time, so count() never
+ * builds the full result.  A query is a value, an array of values (any
+ * of them), or an object {and: [q...]}, {or: [q...]} or {not: q}.
+ */
+class BitmapIndex: ObjectWrap
+{
+private:
+  uint32_t length;  // Rows in the column
+  std::vector<BitmapPosting> postings;  // By increasing value
+  size_t bytes;     // Posting storage reported to V8
+
+public:
+
+  static void Init(Handle<Object> target);
+
+  BitmapIndex() : length(0), bytes(0) {}
+  ~BitmapIndex();
+
+  // Prototype methods.
+  static Handle<Value> New(const Arguments& args);
+  static Handle<Value> Get(const Arguments& args);
+  static Handle<Value> Query(const Arguments& args);
+  static Handle<Value> Count(const Arguments& args);
+
+  // Getters
+  static Handle<Value> GetLength(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetSize(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetValues(Local<String> property, const AccessorInfo& info);
+
+  // Internal manipulators
+  void build(const int32_t *col, uint32_t n);
+  const BitmapPosting *find(int32_t value);
+};
+
+#endif
@@ -8,23 +8,81 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 using namespace node;
 using namespace v8;
 
 #include "bitvec.h"
+#include "chunk.h"
+#include "mapinto.h"
+#include "bulk.h"
+#include "kernels.h"
 
 BitVec::~BitVec()
+{
+  release();
+  dirty_free(&dirty);
+  vec_live(MEM_BITVEC, -1);
+}
+
+// Give up the storage, wherever it is, leaving the vector without any.
+void
+BitVec::release()
 {
   if (vec) {
     //fprintf(stderr, "bitvec: free vec @%p\n", vec);
-    free(vec);
+    if (shared) {
+      vec_shm_close(MEM_BITVEC, vec);
+    } else if (! share || vec_unshare_release(&share)) {
+      vec_release(MEM_BITVEC, vec, inline_vec, sizeof(uint32_t) * word_len);
+    }
     V8::AdjustAmountOfExternalAllocatedMemory(-sizeof(int32_t) * word_len);
   }
+  vec = 0;
+  word_len = 0;
+  shared = false;
 }
 
 static Persistent<FunctionTemplate> s_ct;
 
+bool
+BitVec::HasInstance(Handle<Value> val)
+{
+  return val->IsObject() && s_ct->HasInstance(val);
+}
+
+Handle<Object>
+BitVec::NewInstance(uint32_t len)
+{
+  HandleScope scope;
+  Handle<Value> argv[1] = { Integer::NewFromUnsigned(len) };
+  return scope.Close(s_ct->GetFunction()->NewInstance(1, argv));
+}
+
+/*
+ * A vector over len bits of a shared memory segment, which it unmaps
+ * when collected.  Writes are seen by every process that has the segment
+ * mapped, until the vector grows out of its last word and moves to
+ * storage of its own.
+ */
+Handle<Object>
+BitVec::NewShared(uint32_t *data, uint32_t len)
+{
+  HandleScope scope;
+  Handle<Object> ret = NewInstance(0);
+  BitVec *hw = ObjectWrap::Unwrap<BitVec>(ret);
+  hw->vec = data;
+  hw->length = len;
+  hw->word_len = (len + 31) / 32;
+  hw->shared = true;
+  hw->hash_valid = false;  // other processes may write it from now on
+  dirty_resize(&hw->dirty, ELEM_BIT, len);
+  dirty_mark(&hw->dirty, ELEM_BIT, 0, len);
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * hw->word_len);
+  return scope.Close(ret);
+}
+
 Handle<Value>
 BitVec::New(const Arguments& args)
 {
@@ -39,9 +97,14 @@ BitVec::New(const Arguments& args)
       if (len < 0) {
         return ThrowException(Exception::TypeError(String::New("Bad argument")));
       }
-      hw->extend(len);
+      if (! hw->extend(len)) {
+        return ThrowException(Exception::TypeError(String::New("Out of memory")));
+      }
     } else if (args[0]->IsString()) {
-      if (hw->setString(Local<String>::Cast(args[0])) < 0) {
+      int r = hw->setString(Local<String>::Cast(args[0]));
+      if (r == -2) {
+        return ThrowException(Exception::TypeError(String::New("Out of memory")));
+      } else if (r < 0) {
         return ThrowException(Exception::TypeError(String::New("Invalid BitVec string")));
       }
     } else {
@@ -78,12 +141,14 @@ BitVec::get(uint32_t idx)
   return vec[word] & mask;
 }
 
-uint32_t
+// False if the vector could not grow to hold idx.
+bool
 BitVec::set(uint32_t idx, bool value)
 {
   if (idx < length || value) {
     uint32_t word = idx/32, mask = (1) << (idx%32);
-    extend(idx+1);
+    if (! extend(idx+1)) { return false; }
+    willWrite(idx, idx+1);
 
     if (value) {
       vec[word] |= mask;
@@ -91,7 +156,7 @@ BitVec::set(uint32_t idx, bool value)
       vec[word] &= ~mask;
     }
   }
-  return value;
+  return true;
 }
 
 const char TRANS[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYX+/";
@@ -125,7 +190,7 @@ BitVec::setString(Local<String> str) {
     return -1;
   }
 
-  extend((len - (p-data))*bpc);
+  if (! extend((len - (p-data))*bpc)) { free(buf); return -2; }
   for (i = 0; p < data+len; ++p) {
     if (*p == ']') { break; }
     const char *t = index(TRANS, *p);
@@ -213,31 +278,50 @@ BitVec::toString(uint32_t base, bool json)
   return scope.Close(ret);
 }
 
-void
+// False, with the storage as it was, if it cannot grow to len bits.
+bool
 BitVec::extend(uint32_t len) {
+  dirty_resize(&dirty, ELEM_BIT, len);
+  hash_valid = false;
   uint32_t new_word_len = (len+31)/32;
   if (new_word_len <= word_len) {
-    return;
+    if (len > length) { length = len; }
+    return true;
   } else if (new_word_len < 5*word_len/4) {
     new_word_len = 5*word_len/4;
   }
 
-  if (vec) {
-    vec = (uint32_t *) realloc(vec, new_word_len * sizeof(uint32_t));
-    bzero(vec + word_len, (new_word_len - word_len) * sizeof(uint32_t));
+  // Small vectors use all of the inline buffer straight away.
+  if (new_word_len * sizeof(uint32_t) <= VEC_INLINE_BYTES) {
+    new_word_len = VEC_INLINE_BYTES / sizeof(uint32_t);
+  }
+  if (shared) {
+    // Leaving the shared segment, for storage only this vector sees.
+    uint32_t *own = (uint32_t *) vec_grow(MEM_BITVEC, 0, inline_vec, 0, new_word_len * sizeof(uint32_t));
+    if (! own) { return false; }
+    memcpy(own, vec, sizeof(uint32_t) * word_len);
+    vec_shm_close(MEM_BITVEC, vec);
+    shared = false;
+    vec = own;
   } else {
-    vec = (uint32_t *) calloc(new_word_len, sizeof(uint32_t));
+    unshare();
+    uint32_t *grown = (uint32_t *) vec_grow(MEM_BITVEC, vec, inline_vec, word_len * sizeof(uint32_t),
+                                            new_word_len * sizeof(uint32_t));
+    if (! grown) { return false; }
+    vec = grown;
   }
 
   //fprintf(stderr, "bitvec: [%d] extend %d -> %d\n", len, length, new_word_len*32);
   V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * (new_word_len - word_len));
   length = len;
   word_len = new_word_len;
+  return true;
 }
 
 Handle<Value>
 BitVec::IndexGet(uint32_t idx, const AccessorInfo& info)
 {
+  VEC_COUNT(MEM_BITVEC, gets);
   BitVec* hw = ObjectWrap::Unwrap<BitVec>(info.This());
 
   uint32_t retval = (idx >= hw->length ? 0 : hw->get(idx));
@@ -253,6 +337,7 @@ BitVec::IndexGet(uint32_t idx, const AccessorInfo& info)
 Handle<Value>
 BitVec::IndexSet(uint32_t idx, Local<Value> value, const AccessorInfo& info)
 {
+  VEC_COUNT(MEM_BITVEC, sets);
   if (idx < 0) {
     return ThrowException(Exception::TypeError(String::New("Bad argument")));
   }
@@ -261,10 +346,367 @@ BitVec::IndexSet(uint32_t idx, Local<Value> value, const AccessorInfo& info)
 
   //fprintf(stderr, "bitvec: IndexSet(%d, %d)\n", idx, value->Int32Value());
 
-  hw->set(idx, value->BooleanValue());
+  if (! hw->set(idx, value->BooleanValue())) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
   return value;
 }
 
+/*
+ * A copy of this vector that shares its storage until either one is
+ * written to, when the writer takes a private copy.
+ */
+Handle<Value>
+BitVec::Clone(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (hw->shared) {
+    // Clones of shared vectors are private.
+    Handle<Object> ret = NewInstance(hw->length);
+    BitVec *copy = ObjectWrap::Unwrap<BitVec>(ret);
+    memcpy(copy->vec, hw->vec, sizeof(uint32_t) * ((hw->length + 31) / 32));
+    return scope.Close(ret);
+  }
+
+  Handle<Object> ret = NewInstance(0);
+  BitVec *copy = ObjectWrap::Unwrap<BitVec>(ret);
+
+  copy->length = hw->length;
+  copy->word_len = hw->word_len;
+  if (hw->vec == hw->inline_vec) {
+    memcpy(copy->inline_vec, hw->inline_vec, sizeof(hw->inline_vec));
+    copy->vec = copy->inline_vec;
+  } else if (hw->vec) {
+    hw->share = copy->share = vec_share(hw->share);
+    copy->vec = hw->vec;
+  }
+  copy->cached_hash = hw->cached_hash;
+  copy->hash_valid = hw->hash_valid;
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * copy->word_len);
+
+  return scope.Close(ret);
+}
+
+/*
+ * Make this vector a copy of another one with a single memcpy.
+ */
+Handle<Value>
+BitVec::CopyFrom(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (args.Length() < 1 || ! HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a BitVec")));
+  }
+  BitVec *other = ObjectWrap::Unwrap<BitVec>(args[0]->ToObject());
+  if (other == hw) { return scope.Close(args.This()); }
+
+  uint32_t words = (other->length+31)/32, old_words = (hw->length+31)/32;
+  if (! hw->extend(other->length)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite();
+  memcpy(hw->vec, other->vec, sizeof(uint32_t) * words);
+  if (old_words > words) {
+    memset(hw->vec + words, 0, sizeof(uint32_t) * (old_words - words));
+  }
+  hw->length = other->length;
+
+  return scope.Close(args.This());
+}
+
+/*
+ * Set elements [start, end) to a value, extending the vector if end is
+ * past its length.
+ */
+Handle<Value>
+BitVec::Fill(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t start, end;
+  if (args.Length() < 1 || args[0]->IsUndefined() || ! range_args(args, 1, hw->length, &start, &end)) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  }
+  uint32_t v = args[0]->BooleanValue() ? ~0u : 0;
+  if (! hw->extend(end)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite(start, end);
+  for (uint32_t j = start; j < end; ) {
+    uint32_t b = j % 32, k = 32 - b;
+    if (k > end - j) { k = end - j; }
+    uint32_t m = k == 32 ? ~0u : ((1u << k) - 1) << b;
+    hw->vec[j/32] = (hw->vec[j/32] & ~m) | (v & m);
+    j += k;
+  }
+
+  return scope.Close(args.This());
+}
+
+/*
+ * Copy a JS array, typed array or Buffer into this vector from offset,
+ * extending it as needed.
+ */
+Handle<Value>
+BitVec::Set(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t n, offset = 0;
+  if (args.Length() < 1 || ! bulk_source(args[0], &n)) {
+    return ThrowException(Exception::TypeError(String::New("Source must be an array, typed array or Buffer")));
+  }
+  if (args.Length() > 1 && ! args[1]->IsUndefined()) {
+    if (! args[1]->IsInt32() || args[1]->Int32Value() < 0) {
+      return ThrowException(Exception::TypeError(String::New("Offset must be a non-negative integer")));
+    }
+    offset = args[1]->Int32Value();
+  }
+
+  // Convert first: it may run JS that changes this vector.
+  double *values;
+  if (! bulk_convert(args[0]->ToObject(), n, ELEM_BIT, &values)) { return Handle<Value>(); }
+  if (! hw->extend(offset + n)) {
+    free(values);
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite(offset, offset + n);
+  bulk_copy_in(args[0]->ToObject(), values, n, hw->vec, ELEM_BIT, offset);
+  free(values);
+
+  return scope.Close(args.This());
+}
+
+// Elements [start, end) as a JS Array or a Uint8Array of 0 and 1.
+static bool
+bitvec_range(const Arguments& args, uint32_t length, uint32_t *start, uint32_t *end)
+{
+  if (! range_args(args, 0, length, start, end)) { return false; }
+  if (*end > length) { *end = length; }
+  if (*start > *end) { *start = *end; }
+  return true;
+}
+
+Handle<Value>
+BitVec::ToArray(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t start, end;
+  if (! bitvec_range(args, hw->length, &start, &end)) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  }
+  return scope.Close(bulk_to_array(hw->vec, ELEM_BIT, start, end));
+}
+
+Handle<Value>
+BitVec::ToTypedArray(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t start, end;
+  if (! bitvec_range(args, hw->length, &start, &end)) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  }
+  return scope.Close(bulk_to_typed_array(hw->vec, ELEM_BIT, start, end));
+}
+
+/*
+ * Call back with the start and end of each run of elements written since
+ * the last delta or clearDirty(), in whole blocks; before either, the
+ * whole vector is one run.
+ */
+Handle<Value>
+BitVec::DirtyRanges(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  }
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  uint32_t start, end;
+  for (uint32_t i = 0; dirty_next(&hw->dirty, ELEM_BIT, hw->length, i, &start, &end); i = end) {
+    Handle<Value> argv[2] = { Integer::NewFromUnsigned(start), Integer::NewFromUnsigned(end) };
+    VEC_COUNT(MEM_BITVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 2, argv);
+    if (ret.IsEmpty()) { return ret; }
+  }
+
+  return scope.Close(args.This());
+}
+
+Handle<Value>
+BitVec::ClearDirty(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  dirty_clear(&hw->dirty, ELEM_BIT, hw->length);
+  return scope.Close(args.This());
+}
+
+/*
+ * A Buffer of the runs written since the last delta, for applyDelta() on
+ * a copy of this vector as it was then.  The first delta holds all of it.
+ */
+Handle<Value>
+BitVec::SerializeDelta(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  return scope.Close(delta_serialize(&hw->dirty, ELEM_BIT, hw->vec, hw->length));
+}
+
+Handle<Value>
+BitVec::ApplyDelta(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t len;
+  if (args.Length() < 1 || ! delta_check(args[0], ELEM_BIT, &len)) {
+    return ThrowException(Exception::TypeError(String::New("Bad delta")));
+  }
+
+  if (! hw->extend(len)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->unshare();
+  if (hw->length > len) {
+    uint32_t words = (len+31)/32, old_words = (hw->length+31)/32;
+    memset(hw->vec + words, 0, sizeof(uint32_t) * (old_words - words));
+    if (len % 32) { hw->vec[words-1] &= (1u << (len%32)) - 1; }
+    hw->length = len;
+  }
+  delta_apply(args[0], &hw->dirty, ELEM_BIT, hw->vec);
+
+  return scope.Close(args.This());
+}
+
+/*
+ * A 64-bit hash of the contents, as 16 hex digits, cached until the
+ * next write.  Vectors that are equals() hash the same.
+ */
+Handle<Value>
+BitVec::Hash(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (! hw->hash_valid) {
+    hw->cached_hash = hash_bits(hw->vec, hw->length, hw->length);
+    // Shared storage can be written by other processes.
+    hw->hash_valid = ! hw->shared;
+  }
+  char buffer[17];
+  sprintf(buffer, "%016llx", (unsigned long long) hw->cached_hash);
+  return scope.Close(String::New(buffer));
+}
+
+/*
+ * Whether another BitVec has the same length and the same contents, ignoring
+ * storage past the length.
+ */
+Handle<Value>
+BitVec::Equals(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (args.Length() < 1 || ! HasInstance(args[0])) { return scope.Close(False()); }
+  BitVec *other = ObjectWrap::Unwrap<BitVec>(args[0]->ToObject());
+
+  if (hw->length != other->length) { return scope.Close(False()); }
+  if (hw->hash_valid && other->hash_valid && hw->cached_hash != other->cached_hash) {
+    return scope.Close(False());
+  }
+  bool eq = hw->vec == other->vec || hw->length == 0 || equal_bits(hw->vec, other->vec, hw->length);
+  return scope.Close(eq ? True() : False());
+}
+
+/*
+ * Move the storage into a new shared memory segment of this name, which
+ * vec.openShared(name) opens in other processes as a BitVec over the
+ * same bits.  The name lasts until vec.unlinkShared(name).
+ */
+Handle<Value>
+BitVec::Share(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsString()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a name")));
+  }
+  String::Utf8Value name(args[0]);
+  uint32_t words = (hw->length + 31) / 32;
+  uint32_t *p = (uint32_t *) vec_shm_create(*name, MEM_BITVEC, hw->length, sizeof(uint32_t) * words);
+  if (! p) {
+    return ThrowException(Exception::TypeError(String::Concat(
+        String::New("Cannot create shared memory: "), String::New(strerror(errno)))));
+  }
+  if (words) { memcpy(p, hw->vec, sizeof(uint32_t) * words); }
+  hw->release();
+  hw->vec = p;
+  hw->word_len = words;
+  hw->shared = true;
+  hw->hash_valid = false;  // other processes may write it from now on
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * words);
+
+  return scope.Close(args.This());
+}
+
+/*
+ * Set or clear a bit with an atomic and/or on its word, safe against
+ * other processes and threads writing the same shared storage, and
+ * return whether it was set before.  Unlike indexed writes it never
+ * extends the vector.
+ */
+static Handle<Value>
+atomic_bit(BitVec *hw, const Arguments& args, bool value)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || ! args[0]->IsUint32() || args[0]->Uint32Value() >= hw->size()) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  uint32_t idx = args[0]->Uint32Value();
+  uint32_t word = idx/32, mask = (1) << (idx%32);
+  hw->willWrite(idx, idx+1);
+
+  uint32_t *w = hw->data() + word;
+  uint32_t old = value ? __sync_fetch_and_or(w, mask) : __sync_fetch_and_and(w, ~mask);
+  return scope.Close(old & mask ? True() : False());
+}
+
+Handle<Value>
+BitVec::AtomicSet(const Arguments& args)
+{
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+  return atomic_bit(hw, args, args.Length() > 1 ? args[1]->BooleanValue() : true);
+}
+
+// Set a bit, returning false only to the first caller to do so.
+Handle<Value>
+BitVec::TestAndSet(const Arguments& args)
+{
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+  return atomic_bit(hw, args, true);
+}
+
 Handle<Value>
 BitVec::ForEach(const Arguments& args)
 {
@@ -282,6 +724,7 @@ BitVec::ForEach(const Arguments& args)
   for (uint32_t i = 0; i < hw->length; ++i) {
     argv[0] = *(hw->get(i) ? True() : False());
     argv[1] = Int32::New(i);
+    VEC_COUNT(MEM_BITVEC, callbacks);
     cb->Call(global, 2, argv);
   }
 
@@ -305,6 +748,7 @@ BitVec::ForEachTrue(const Arguments& args)
   for (uint32_t i = 0; i < hw->length; ++i) {
     if (hw->get(i)) {
       argv[0] = Integer::New(i);
+      VEC_COUNT(MEM_BITVEC, callbacks);
       cb->Call(global, 1, argv);
     }
   }
@@ -312,6 +756,64 @@ BitVec::ForEachTrue(const Arguments& args)
   return scope.Close(args.This());
 }
 
+/*
+ * Chunked forEachTrue: the callback gets a window of up to [size]
+ * (default 4096) set-bit indices at a time.
+ */
+Handle<Value>
+BitVec::ForEachTrueChunk(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t size;
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  } else if (! chunk_size_arg(args, 1, &size)) {
+    return ThrowException(Exception::TypeError(String::New("Chunk size must be a positive integer")));
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  // No batch can hold more indices than there are bits.
+  uint32_t *batch = (uint32_t *) chunk_buffer(&size, hw->length, sizeof(uint32_t));
+  if (! batch) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  uint32_t n = 0, w = 0, bits = 0;
+  bool ok = true;
+
+  while (ok) {
+    // Load the next word with any set bits; w is one past its index.  The
+    // callback may have changed the length.
+    while (! bits && w < (hw->length+31)/32) {
+      bits = hw->vec[w];
+      if (w == hw->length/32) { bits &= (1u << (hw->length%32)) - 1; }
+      ++w;
+    }
+    bool done = ! bits;
+    if (! done) {
+      batch[n++] = (w-1)*32 + __builtin_ctz(bits);
+      bits &= bits - 1;
+    }
+
+    if (n == size || (done && n)) {
+      HandleScope chunk_scope;
+      Handle<Object> window = chunk_window(batch, kExternalUnsignedIntArray, n);
+      Handle<Value> argv[1] = { window };
+      VEC_COUNT(MEM_BITVEC, callbacks);
+      ok = ! cb->Call(global, 1, argv).IsEmpty();
+      chunk_detach(window);
+      n = 0;
+    }
+    if (done) { break; }
+  }
+  free(batch);
+
+  return ok ? scope.Close(args.This()) : Handle<Value>();
+}
+
 Handle<Value>
 BitVec::Map(const Arguments& args)
 {
@@ -330,12 +832,53 @@ BitVec::Map(const Arguments& args)
   Local<Value> argv[1];
   for (uint32_t i = 0; i < hw->length; ++i) {
     argv[0] = *(hw->get(i) ? True() : False());
+    VEC_COUNT(MEM_BITVEC, callbacks);
     retval->Set(i, cb->Call(global, 1, argv));
   }
 
   return scope.Close(retval);
 }
 
+/*
+ * Like map, but the callback results are stored straight into a native
+ * vector: [out] is an existing IntVec, FloatVec or BitVec, or the name
+ * of the type of a new one ("int", "float" or "bit"), by default a new
+ * BitVec.  Returns the output vector.
+ */
+Handle<Value>
+BitVec::MapInto(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  }
+
+  Handle<Object> out;
+  int type;
+  if (! map_output(args.Length() > 1 ? args[1] : Handle<Value>(Undefined()), ELEM_BIT,
+                   hw->length, &out, &type)) {
+    return Handle<Value>();
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  for (uint32_t i = 0; i < hw->length; ++i) {
+    HandleScope elem_scope;
+    Handle<Value> argv[2] = { hw->get(i) ? True() : False(), Integer::NewFromUnsigned(i) };
+    VEC_COUNT(MEM_BITVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 2, argv);
+    if (ret.IsEmpty()) { return ret; }
+    if (! map_store(out, type, i, ret)) {
+      return ThrowException(Exception::TypeError(String::New("Out of memory")));
+    }
+  }
+
+  return scope.Close(out);
+}
+
 Handle<Value>
 BitVec::Reduce(const Arguments& args)
 {
@@ -356,12 +899,82 @@ BitVec::Reduce(const Arguments& args)
   argv[0] = args[0];
   for (uint32_t i = 0; i < hw->length; ++i) {
     argv[1] = *(hw->get(i) ? True() : False());
+    VEC_COUNT(MEM_BITVEC, callbacks);
     argv[0] = cb->Call(global, 2, argv);
   }
 
   return scope.Close(argv[0]);
 }
 
+enum { BIT_AND, BIT_OR, BIT_XOR, BIT_ANDNOT };
+
+// A new BitVec combining this with another word by word, as long as the
+// longer of the two; bits past the end of the shorter one are false.
+static Handle<Value>
+combine(const Arguments& args, int op)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  if (args.Length() < 1 || ! BitVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a BitVec")));
+  }
+  BitVec *other = ObjectWrap::Unwrap<BitVec>(args[0]->ToObject());
+
+  uint32_t alen = hw->size(), blen = other->size();
+  uint32_t len = alen > blen ? alen : blen;
+  uint32_t awords = (alen+31)/32, bwords = (blen+31)/32, words = (len+31)/32;
+
+  Handle<Object> ret = BitVec::NewInstance(len);
+  const uint32_t *a = hw->data(), *b = other->data();
+  uint32_t *out = ObjectWrap::Unwrap<BitVec>(ret)->data();
+
+  for (uint32_t i = 0; i < words; ++i) {
+    uint32_t x = i < awords ? a[i] : 0, y = i < bwords ? b[i] : 0;
+    switch (op) {
+    case BIT_AND:    out[i] = x & y; break;
+    case BIT_OR:     out[i] = x | y; break;
+    case BIT_XOR:    out[i] = x ^ y; break;
+    case BIT_ANDNOT: out[i] = x & ~y; break;
+    }
+  }
+
+  return scope.Close(ret);
+}
+
+Handle<Value> BitVec::And(const Arguments& args) { return combine(args, BIT_AND); }
+Handle<Value> BitVec::Or(const Arguments& args) { return combine(args, BIT_OR); }
+Handle<Value> BitVec::Xor(const Arguments& args) { return combine(args, BIT_XOR); }
+Handle<Value> BitVec::AndNot(const Arguments& args) { return combine(args, BIT_ANDNOT); }
+
+Handle<Value>
+BitVec::Not(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  uint32_t words = (hw->length+31)/32;
+  Handle<Object> ret = NewInstance(hw->length);
+  uint32_t *out = ObjectWrap::Unwrap<BitVec>(ret)->data();
+
+  for (uint32_t i = 0; i < words; ++i) { out[i] = ~hw->vec[i]; }
+  if (hw->length % 32) { out[words-1] &= (1u << (hw->length%32)) - 1; }
+
+  return scope.Close(ret);
+}
+
+/*
+ * The number of set bits.
+ */
+Handle<Value>
+BitVec::Count(const Arguments& args)
+{
+  HandleScope scope;
+  BitVec* hw = ObjectWrap::Unwrap<BitVec>(args.This());
+
+  return scope.Close(Integer::NewFromUnsigned(count_bits(hw->vec, hw->length)));
+}
+
 void
 BitVec::Init(Handle<Object> target)
 {
@@ -380,11 +993,36 @@ BitVec::Init(Handle<Object> target)
   s_ct->SetClassName(String::NewSymbol("BitVec"));
 
   NODE_SET_PROTOTYPE_METHOD(s_ct, "toString", ToString);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "clone", Clone);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "copyFrom", CopyFrom);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "fill", Fill);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "set", Set);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toArray", ToArray);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toTypedArray", ToTypedArray);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "dirtyRanges", DirtyRanges);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "clearDirty", ClearDirty);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "serializeDelta", SerializeDelta);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "applyDelta", ApplyDelta);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "hash", Hash);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "equals", Equals);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "share", Share);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "atomicSet", AtomicSet);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "testAndSet", TestAndSet);
 
   NODE_SET_PROTOTYPE_METHOD(s_ct, "map", Map);
   NODE_SET_PROTOTYPE_METHOD(s_ct, "reduce", Reduce);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "mapInto", MapInto);
   NODE_SET_PROTOTYPE_METHOD(s_ct, "forEach", ForEach);
   NODE_SET_PROTOTYPE_METHOD(s_ct, "forEachTrue", ForEachTrue);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "forEachTrueChunk", ForEachTrueChunk);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "and", And);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "or", Or);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "xor", Xor);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "andNot", AndNot);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "not", Not);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "count", Count);
 
   s_ct->InstanceTemplate()->SetIndexedPropertyHandler(IndexGet, IndexSet);
 
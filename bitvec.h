@@ -3,9 +3,15 @@
 * LICENSE file.
 */
 
+#ifndef BITVEC_H
+#define BITVEC_H
+
 #include <v8.h>
 #include <node.h>
 
+#include "vecmem.h"
+#include "dirty.h"
+
 using namespace node;
 using namespace v8;
 
@@ -15,22 +21,56 @@ class BitVec: ObjectWrap
   uint32_t length;   // Length of the vector in bits
   uint32_t word_len; // Length of the vector in uint32_t words
   uint32_t *vec;
+  uint32_t inline_vec[VEC_INLINE_BYTES / sizeof(uint32_t)];
+  VecShare *share;  // Heap storage shared with clones, if any
+  bool shared;      // Storage is a shared memory segment
+  VecDirty dirty;   // Blocks written since the last delta
+  uint64_t cached_hash;
+  bool hash_valid;  // cached_hash is of the current contents
 
  public:
 
   static void Init(Handle<Object> target);
+  static bool HasInstance(Handle<Value> val);
+  static Handle<Object> NewInstance(uint32_t len);
+  static Handle<Object> NewShared(uint32_t *data, uint32_t len);
 
-  BitVec() : length(0), word_len(0), vec(0) {}
+  BitVec() : length(0), word_len(0), vec(0), inline_vec(), share(0), shared(false), dirty(), cached_hash(0), hash_valid(false) { vec_live(MEM_BITVEC, 1); }
   ~BitVec();
 
   // Prototype methods.
   static Handle<Value> New(const Arguments& args);
   static Handle<Value> ToString(const Arguments& args);
+  static Handle<Value> Clone(const Arguments& args);
+  static Handle<Value> CopyFrom(const Arguments& args);
+  static Handle<Value> Fill(const Arguments& args);
+  static Handle<Value> Set(const Arguments& args);
+  static Handle<Value> ToArray(const Arguments& args);
+  static Handle<Value> ToTypedArray(const Arguments& args);
+  static Handle<Value> DirtyRanges(const Arguments& args);
+  static Handle<Value> ClearDirty(const Arguments& args);
+  static Handle<Value> SerializeDelta(const Arguments& args);
+  static Handle<Value> ApplyDelta(const Arguments& args);
+  static Handle<Value> Hash(const Arguments& args);
+  static Handle<Value> Equals(const Arguments& args);
+
+  static Handle<Value> Share(const Arguments& args);
+  static Handle<Value> AtomicSet(const Arguments& args);
+  static Handle<Value> TestAndSet(const Arguments& args);
 
   static Handle<Value> ForEach(const Arguments& args);
   static Handle<Value> ForEachTrue(const Arguments& args);
+  static Handle<Value> ForEachTrueChunk(const Arguments& args);
   static Handle<Value> Map(const Arguments& args);
   static Handle<Value> Reduce(const Arguments& args);
+  static Handle<Value> MapInto(const Arguments& args);
+
+  static Handle<Value> And(const Arguments& args);
+  static Handle<Value> Or(const Arguments& args);
+  static Handle<Value> Xor(const Arguments& args);
+  static Handle<Value> AndNot(const Arguments& args);
+  static Handle<Value> Not(const Arguments& args);
+  static Handle<Value> Count(const Arguments& args);
 
   // Getters
   static Handle<Value> GetLength(Local<String> property, const AccessorInfo& info);
@@ -42,8 +82,28 @@ class BitVec: ObjectWrap
 
   // Internal manipulators
   uint32_t get(uint32_t idx);
-  uint32_t set(uint32_t idx, bool v);
-  void extend(uint32_t len);
-  int setString(Local<String> str);
+  bool set(uint32_t idx, bool v);
+  bool extend(uint32_t len);
+  void release();
+  int setString(Local<String> str);  // -1 if malformed, -2 if out of memory
   Handle<Value> toString(uint32_t base, bool json = false);
+
+  // Call before writing to the storage, which clones share until then,
+  // with the elements about to be written (by default all of them).
+  void willWrite(uint32_t start = 0, uint32_t end = ~0u) {
+    unshare();
+    dirty_mark(&dirty, ELEM_BIT, start, end);
+  }
+  // willWrite() for writers that mark their own dirty blocks.
+  void unshare() {
+    hash_valid = false;
+    if (share) { vec = (uint32_t *) vec_unshare(MEM_BITVEC, vec, sizeof(uint32_t) * word_len, &share); }
+  }
+
+  // Raw access for native kernels in the other vector types; call
+  // willWrite() before writing through data().
+  uint32_t size() { return length; }
+  uint32_t *data() { return vec; }
 };
+
+#endif
@@ -0,0 +1,188 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace v8;
+
+#include "bulk.h"
+#include "kernels.h"
+
+bool
+range_args(const Arguments& args, int i, uint32_t len, uint32_t *start, uint32_t *end)
+{
+  double r[2] = { 0, (double) len };
+  for (int k = 0; k < 2; ++k) {
+    if (args.Length() <= i+k || args[i+k]->IsUndefined()) { continue; }
+    if (! args[i+k]->IsNumber()) { return false; }
+    r[k] = args[i+k]->IntegerValue();
+    if (r[k] < 0) { r[k] += len; }
+    if (r[k] < 0) { r[k] = 0; }
+    if (r[k] > 4294967295.0) { r[k] = 4294967295.0; }
+  }
+  *start = (uint32_t) r[0];
+  *end = r[1] < r[0] ? *start : (uint32_t) r[1];
+  return true;
+}
+
+bool
+bulk_source(Handle<Value> src, uint32_t *n)
+{
+  if (src->IsArray()) {
+    *n = Handle<Array>::Cast(src)->Length();
+    return true;
+  }
+  if (src->IsObject() && src->ToObject()->HasIndexedPropertiesInExternalArrayData()) {
+    *n = src->ToObject()->GetIndexedPropertiesExternalArrayDataLength();
+    return true;
+  }
+  return false;
+}
+
+// Element conversions of an indexed set, by source type.
+template <typename T> static inline int32_t as_i32(T v) { return (int32_t) v; }
+template <> inline int32_t as_i32(float v) { return to_int32(v); }
+template <> inline int32_t as_i32(double v) { return to_int32(v); }
+template <typename T> static inline uint32_t as_bit(T v) { return v != 0 && v == v; }
+
+template <typename T>
+static void
+copy_in(const T *src, uint32_t n, void *dst, int type, uint32_t offset)
+{
+  switch (type) {
+  case ELEM_I32: {
+    int32_t *out = (int32_t *) dst + offset;
+    for (uint32_t i = 0; i < n; ++i) { out[i] = as_i32(src[i]); }
+    break;
+  }
+  case ELEM_F32: {
+    float *out = (float *) dst + offset;
+    for (uint32_t i = 0; i < n; ++i) { out[i] = (float) src[i]; }
+    break;
+  }
+  default: {
+    // A word at a time, keeping the bits of the first and last words
+    // outside the range.
+    uint32_t *out = (uint32_t *) dst;
+    for (uint32_t i = 0, j = offset; i < n; ) {
+      uint32_t b = j % 32, k = 32 - b;
+      if (k > n - i) { k = n - i; }
+      uint32_t bits = 0;
+      for (uint32_t t = 0; t < k; ++t) { bits |= as_bit(src[i+t]) << (b+t); }
+      uint32_t m = k == 32 ? ~0u : ((1u << k) - 1) << b;
+      out[j/32] = (out[j/32] & ~m) | bits;
+      i += k;
+      j += k;
+    }
+    break;
+  }
+  }
+}
+
+bool
+bulk_convert(Handle<Object> src, uint32_t n, int type, double **values)
+{
+  *values = 0;
+  if (! src->IsArray() || ! n) { return true; }
+
+  double *out = (double *) malloc(sizeof(double) * n);
+  if (! out) {
+    ThrowException(Exception::TypeError(String::New("Out of memory")));
+    return false;
+  }
+
+  // Array elements may be anything, so each goes through V8's own
+  // conversion.
+  TryCatch try_catch;
+  for (uint32_t i = 0; i < n; ++i) {
+    Local<Value> v = src->Get(i);
+    if (! try_catch.HasCaught()) {
+      if (type == ELEM_I32) {
+        out[i] = v->Int32Value();
+      } else if (type == ELEM_F32) {
+        out[i] = v->NumberValue();
+      } else {
+        out[i] = v->BooleanValue();
+      }
+    }
+    if (try_catch.HasCaught()) {
+      free(out);
+      try_catch.ReThrow();
+      return false;
+    }
+  }
+  *values = out;
+  return true;
+}
+
+void
+bulk_copy_in(Handle<Object> src, const double *values, uint32_t n, void *dst, int type, uint32_t offset)
+{
+  if (values) {
+    copy_in(values, n, dst, type, offset);
+    return;
+  }
+  if (src->IsArray()) { return; }
+
+  void *data = src->GetIndexedPropertiesExternalArrayData();
+  switch (src->GetIndexedPropertiesExternalArrayDataType()) {
+  case kExternalByteArray: copy_in((const int8_t *) data, n, dst, type, offset); break;
+  case kExternalUnsignedByteArray: copy_in((const uint8_t *) data, n, dst, type, offset); break;
+  case kExternalShortArray: copy_in((const int16_t *) data, n, dst, type, offset); break;
+  case kExternalUnsignedShortArray: copy_in((const uint16_t *) data, n, dst, type, offset); break;
+  case kExternalIntArray: copy_in((const int32_t *) data, n, dst, type, offset); break;
+  case kExternalUnsignedIntArray: copy_in((const uint32_t *) data, n, dst, type, offset); break;
+  case kExternalFloatArray: copy_in((const float *) data, n, dst, type, offset); break;
+  }
+}
+
+Handle<Value>
+bulk_to_array(const void *src, int type, uint32_t start, uint32_t end)
+{
+  HandleScope scope;
+  Local<Array> ret = Array::New(end - start);
+  for (uint32_t i = start; i < end; ++i) {
+    switch (type) {
+    case ELEM_I32: ret->Set(i - start, Integer::New(((const int32_t *) src)[i])); break;
+    case ELEM_F32: ret->Set(i - start, Number::New(((const float *) src)[i])); break;
+    default:
+      ret->Set(i - start, (((const uint32_t *) src)[i/32] >> (i%32)) & 1 ? True() : False());
+      break;
+    }
+  }
+  return scope.Close(ret);
+}
+
+Handle<Value>
+bulk_to_typed_array(const void *src, int type, uint32_t start, uint32_t end)
+{
+  HandleScope scope;
+  const char *name = type == ELEM_I32 ? "Int32Array" : type == ELEM_F32 ? "Float32Array" : "Uint8Array";
+  Local<Value> ctor = Context::GetCurrent()->Global()->Get(String::NewSymbol(name));
+  if (! ctor->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Typed arrays are not available")));
+  }
+
+  uint32_t n = end - start;
+  Handle<Value> argv[1] = { Integer::NewFromUnsigned(n) };
+  Local<Object> ret = Handle<Function>::Cast(ctor)->NewInstance(1, argv);
+  if (ret.IsEmpty()) { return Handle<Value>(); }
+  void *data = ret->GetIndexedPropertiesExternalArrayData();
+
+  switch (type) {
+  case ELEM_I32: memcpy(data, (const int32_t *) src + start, n * sizeof(int32_t)); break;
+  case ELEM_F32: memcpy(data, (const float *) src + start, n * sizeof(float)); break;
+  default: {
+    const uint32_t *w = (const uint32_t *) src;
+    uint8_t *out = (uint8_t *) data;
+    for (uint32_t i = start; i < end; ++i) { out[i - start] = (w[i/32] >> (i%32)) & 1; }
+    break;
+  }
+  }
+  return scope.Close(ret);
+}
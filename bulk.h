@@ -0,0 +1,52 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef BULK_H
+#define BULK_H
+
+#include <v8.h>
+
+using namespace v8;
+
+/*
+ * Bulk copies between vector storage and JS values for fill(), set(),
+ * toArray() and toTypedArray(), in one native loop instead of one
+ * interceptor call per element.  Sources are JS Arrays or anything with
+ * external array data: typed arrays, Buffers and chunk windows.  Types
+ * are the ELEM_ constants of kernels.h.
+ */
+
+// Optional start and end arguments at args[i] and args[i+1], defaulting
+// to 0 and len; negative ones count back from len.  end is not clamped
+// to len, and is raised to start.  False if either is not a number.
+bool range_args(const Arguments& args, int i, uint32_t len, uint32_t *start, uint32_t *end);
+
+// Number of elements of a bulk source; false if the value is not one.
+bool bulk_source(Handle<Value> src, uint32_t *n);
+
+// Convert the first n elements of an Array source to numbers, as
+// indexed sets would: ToInt32 for ints, ToNumber for floats, ToBoolean
+// for bits.  The conversions may run user JS (getters, valueOf) that
+// grows, clones or frees the destination vector's storage.  Call this
+// before extend() or willWrite(), and before taking a storage pointer.
+// *values is a buffer to free(), or 0 for sources that are not Arrays
+// and need no conversion.  Returns false, with an exception pending, if
+// a conversion threw or the buffer could not be allocated.
+bool bulk_convert(Handle<Object> src, uint32_t n, int type, double **values);
+
+// Copy n elements of a bulk source into storage from element offset,
+// converted as indexed sets would: ToInt32 into ints, nonzero (and not
+// NaN) into bits.  values is from bulk_convert.  The storage must hold
+// offset+n elements and be ready for writing.  No JS runs.
+void bulk_copy_in(Handle<Object> src, const double *values, uint32_t n, void *dst, int type, uint32_t offset);
+
+// Elements [start, end) of storage as a new JS Array, or as a new
+// Int32Array, Float32Array, or for bits a Uint8Array of 0 and 1.  The
+// typed array is empty, with an exception thrown, when the global
+// constructor is missing.
+Handle<Value> bulk_to_array(const void *src, int type, uint32_t start, uint32_t end);
+Handle<Value> bulk_to_typed_array(const void *src, int type, uint32_t start, uint32_t end);
+
+#endif
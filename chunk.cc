@@ -0,0 +1,50 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+
+#include <stdlib.h>
+
+using namespace v8;
+
+#include "chunk.h"
+
+// Detached windows point here with no elements.
+static int32_t empty;
+
+Handle<Object>
+chunk_window(void *data, ExternalArrayType type, uint32_t len)
+{
+  HandleScope scope;
+  Handle<Object> window = Object::New();
+  window->SetIndexedPropertiesToExternalArrayData(data, type, len);
+  window->Set(String::NewSymbol("length"), Integer::NewFromUnsigned(len));
+  return scope.Close(window);
+}
+
+void
+chunk_detach(Handle<Object> window)
+{
+  window->SetIndexedPropertiesToExternalArrayData(
+    &empty, window->GetIndexedPropertiesExternalArrayDataType(), 0);
+  window->Set(String::NewSymbol("length"), Integer::New(0));
+}
+
+bool
+chunk_size_arg(const Arguments& args, int i, uint32_t *size)
+{
+  *size = DEFAULT_CHUNK;
+  if (args.Length() <= i || args[i]->IsUndefined()) { return true; }
+  if (! args[i]->IsInt32() || args[i]->Int32Value() <= 0) { return false; }
+  *size = args[i]->Int32Value();
+  return true;
+}
+
+void *
+chunk_buffer(uint32_t *size, uint32_t length, size_t elem_bytes)
+{
+  if (*size > length) { *size = length ? length : 1; }
+  return malloc(elem_bytes * *size);
+}
@@ -0,0 +1,38 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <v8.h>
+
+using namespace v8;
+
+/*
+ * Windows for the chunked callbacks.  A window is a plain object whose
+ * indexed elements are backed directly by native memory, plus a length.
+ * It is only valid for the duration of the callback it is passed to: it
+ * is detached (emptied) as soon as the callback returns, so a retained
+ * window can never see freed memory.
+ *
+ * Windows over a vector being walked are over a copy of each chunk in a
+ * buffer of the walk's own, never the vector's storage, which the
+ * callback may grow, share, clone or hash as it likes.  Writing to such
+ * a window does not change the vector.
+ */
+
+#define DEFAULT_CHUNK 4096
+
+Handle<Object> chunk_window(void *data, ExternalArrayType type, uint32_t len);
+void chunk_detach(Handle<Object> window);
+
+// Optional chunk size argument; false if given and not a positive integer.
+bool chunk_size_arg(const Arguments& args, int i, uint32_t *size);
+
+// Clamp a chunk size to a vector's length and allocate a buffer of that
+// many elements, to be freed with free(); 0 if that fails.
+void *chunk_buffer(uint32_t *size, uint32_t length, size_t elem_bytes);
+
+#endif
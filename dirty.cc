@@ -0,0 +1,212 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+#include <node_buffer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace node;
+using namespace v8;
+
+#include "dirty.h"
+
+static const char delta_magic[4] = { 'V', 'D', 'L', 'T' };
+
+// Set bits [from, to) of a bitmap.
+static void
+set_bits(uint32_t *w, uint32_t from, uint32_t to)
+{
+  while (from < to) {
+    uint32_t b = from % 32, k = 32 - b;
+    if (k > to - from) { k = to - from; }
+    w[from/32] |= k == 32 ? ~0u : ((1u << k) - 1) << b;
+    from += k;
+  }
+}
+
+// The first bit at or after from, up to limit, that is set (or clear).
+static uint32_t
+find_bit(const uint32_t *w, uint32_t from, uint32_t limit, bool set)
+{
+  while (from < limit) {
+    uint32_t word = set ? w[from/32] : ~w[from/32];
+    word &= ~0u << (from % 32);
+    if (word) {
+      uint32_t i = (from & ~31u) + __builtin_ctz(word);
+      return i < limit ? i : limit;
+    }
+    from = (from & ~31u) + 32;
+  }
+  return limit;
+}
+
+void
+dirty_mark_range(VecDirty *d, int type, uint32_t start, uint32_t end)
+{
+  uint32_t per = dirty_block_elems(type);
+  uint32_t first = start / per, last = (end - 1) / per + 1;
+  if (last > d->blocks) { last = d->blocks; }
+  set_bits(d->bits, first, last);
+}
+
+void
+dirty_resize(VecDirty *d, int type, uint32_t len)
+{
+  if (! d->on) { return; }
+  uint32_t per = dirty_block_elems(type);
+  uint32_t blocks = len / per + (len % per != 0);
+  if (blocks <= d->blocks) { return; }
+
+  uint32_t words = (d->blocks+31)/32, new_words = (blocks+31)/32;
+  if (new_words > words) {
+    d->bits = (uint32_t *) realloc(d->bits, sizeof(uint32_t) * new_words);
+    memset(d->bits + words, 0, sizeof(uint32_t) * (new_words - words));
+  }
+  d->blocks = blocks;
+}
+
+void
+dirty_clear(VecDirty *d, int type, uint32_t len)
+{
+  dirty_free(d);
+  d->on = true;
+  dirty_resize(d, type, len);
+}
+
+void
+dirty_free(VecDirty *d)
+{
+  free(d->bits);
+  d->on = false;
+  d->blocks = 0;
+  d->bits = 0;
+}
+
+bool
+dirty_next(VecDirty *d, int type, uint32_t len, uint32_t from, uint32_t *start, uint32_t *end)
+{
+  if (from >= len) { return false; }
+  if (! d->on) {
+    *start = from;
+    *end = len;
+    return true;
+  }
+
+  uint32_t per = dirty_block_elems(type);
+  uint32_t first = find_bit(d->bits, from / per, d->blocks, true);
+  if (first == d->blocks) { return false; }
+  uint32_t last = find_bit(d->bits, first, d->blocks, false);
+
+  *start = first * per > from ? first * per : from;
+  *end = (uint64_t) last * per < len ? last * per : len;
+  return *start < *end;
+}
+
+// Storage bytes of count elements.
+static size_t
+run_bytes(int type, uint32_t count)
+{
+  return type == ELEM_BIT ? sizeof(uint32_t) * ((count+31)/32) : 4 * (size_t) count;
+}
+
+// Storage of the element at start, which for bits is word aligned.
+static size_t
+run_offset(int type, uint32_t start)
+{
+  return type == ELEM_BIT ? start / 8 : 4 * (size_t) start;
+}
+
+static char *
+put_u32(char *p, uint32_t v)
+{
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+static const char *
+get_u32(const char *p, uint32_t *v)
+{
+  memcpy(v, p, sizeof(*v));
+  return p + sizeof(*v);
+}
+
+Handle<Value>
+delta_serialize(VecDirty *d, int type, const void *data, uint32_t len)
+{
+  HandleScope scope;
+
+  size_t size = 5 * sizeof(uint32_t);
+  uint32_t runs = 0, start, end;
+  for (uint32_t i = 0; dirty_next(d, type, len, i, &start, &end); i = end) {
+    size += 2 * sizeof(uint32_t) + run_bytes(type, end - start);
+    ++runs;
+  }
+
+  Buffer *buf = Buffer::New(size);
+  char *p = Buffer::Data(buf);
+  memcpy(p, delta_magic, sizeof(delta_magic));
+  p = put_u32(p + sizeof(delta_magic), type);
+  p = put_u32(p, len);
+  p = put_u32(p, dirty_block_elems(type));
+  p = put_u32(p, runs);
+  for (uint32_t i = 0; dirty_next(d, type, len, i, &start, &end); i = end) {
+    p = put_u32(p, start);
+    p = put_u32(p, end - start);
+    memcpy(p, (const char *) data + run_offset(type, start), run_bytes(type, end - start));
+    p += run_bytes(type, end - start);
+  }
+
+  dirty_clear(d, type, len);
+  return scope.Close(buf->handle_);
+}
+
+bool
+delta_check(Handle<Value> buf, int type, uint32_t *len)
+{
+  if (! Buffer::HasInstance(buf)) { return false; }
+  const char *p = Buffer::Data(buf->ToObject());
+  size_t size = Buffer::Length(buf->ToObject());
+
+  uint32_t t, per, runs;
+  if (size < 5 * sizeof(uint32_t) || memcmp(p, delta_magic, sizeof(delta_magic))) { return false; }
+  p = get_u32(p + sizeof(delta_magic), &t);
+  p = get_u32(p, len);
+  p = get_u32(p, &per);
+  p = get_u32(p, &runs);
+  if ((int) t != type || per != dirty_block_elems(type)) { return false; }
+  size -= 5 * sizeof(uint32_t);
+
+  for (uint32_t r = 0; r < runs; ++r) {
+    uint32_t start, count;
+    if (size < 2 * sizeof(uint32_t)) { return false; }
+    p = get_u32(p, &start);
+    p = get_u32(p, &count);
+    size -= 2 * sizeof(uint32_t);
+    if (start > *len || count > *len - start) { return false; }
+    if (type == ELEM_BIT && start % 32) { return false; }
+    if (size < run_bytes(type, count)) { return false; }
+    p += run_bytes(type, count);
+    size -= run_bytes(type, count);
+  }
+  return size == 0;
+}
+
+void
+delta_apply(Handle<Value> buf, VecDirty *d, int type, void *data)
+{
+  const char *p = Buffer::Data(buf->ToObject());
+  uint32_t runs, start, count;
+  p = get_u32(p + 4 * sizeof(uint32_t), &runs);
+  for (uint32_t r = 0; r < runs; ++r) {
+    p = get_u32(p, &start);
+    p = get_u32(p, &count);
+    memcpy((char *) data + run_offset(type, start), p, run_bytes(type, count));
+    p += run_bytes(type, count);
+    dirty_mark(d, type, start, start + count);
+  }
+}
@@ -0,0 +1,80 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include <v8.h>
+#include <stdint.h>
+
+#include "kernels.h"
+
+using namespace v8;
+
+/*
+ * Dirty-block tracking for incremental snapshots.  A vector's storage is
+ * divided into blocks of DIRTY_BLOCK bytes, and every write marks the
+ * blocks it touches.  Tracking starts at the first clearDirty() or
+ * serializeDelta(); until then the whole vector counts as dirty and
+ * writes cost one branch.  Types are the ELEM_ constants of kernels.h.
+ */
+#define DIRTY_BLOCK 4096
+
+struct VecDirty {
+  bool on;
+  uint32_t blocks;  // blocks covered by bits
+  uint32_t *bits;
+};
+
+// Elements per block.
+static inline uint32_t
+dirty_block_elems(int type)
+{
+  return type == ELEM_BIT ? DIRTY_BLOCK * 8 : DIRTY_BLOCK / 4;
+}
+
+void dirty_mark_range(VecDirty *d, int type, uint32_t start, uint32_t end);
+
+// Mark elements [start, end); end may be past the length.
+static inline void
+dirty_mark(VecDirty *d, int type, uint32_t start, uint32_t end)
+{
+  if (__builtin_expect(d->on, 0) && start < end) { dirty_mark_range(d, type, start, end); }
+}
+
+// Cover a vector that has grown to len elements; new blocks are clean,
+// as their zeros are implied by the length in a delta.
+void dirty_resize(VecDirty *d, int type, uint32_t len);
+
+// Start tracking, or start over, with everything clean.
+void dirty_clear(VecDirty *d, int type, uint32_t len);
+void dirty_free(VecDirty *d);
+
+// The next run of dirty elements at or after from, clipped to len;
+// false when there are no more.
+bool dirty_next(VecDirty *d, int type, uint32_t len, uint32_t from, uint32_t *start, uint32_t *end);
+
+/*
+ * Deltas are Buffers, in host byte order, of a header of five uint32s:
+ * the magic "VDLT", the element type, the vector length, the block
+ * elements and the number of runs; then for each run its start and
+ * element count, followed by its storage (whole words for bits).
+ * Applying one to a vector of the same type makes it equal to the
+ * source vector as it was when the delta was made, provided it was equal
+ * at the previous delta.
+ */
+
+// A delta of the dirty runs of storage, which then starts clean.
+Handle<Value> delta_serialize(VecDirty *d, int type, const void *data, uint32_t len);
+
+// Check a delta for a vector of this type, returning the length it
+// sets; false if it is malformed.
+bool delta_check(Handle<Value> buf, int type, uint32_t *len);
+
+// Copy a checked delta's runs into storage already resized to its
+// length, marking them dirty.
+void delta_apply(Handle<Value> buf, VecDirty *d, int type, void *data);
+
+#endif
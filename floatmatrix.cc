@@ -0,0 +1,334 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace node;
+using namespace v8;
+
+#include "floatmatrix.h"
+#include "floatvec.h"
+#include "intvec.h"
+#include "kernels.h"
+#include "bulk.h"
+
+FloatMatrix::~FloatMatrix()
+{
+  if (vec) {
+    vec_free(MEM_FLOATMATRIX, vec, sizeof(float) * size());
+    V8::AdjustAmountOfExternalAllocatedMemory(-sizeof(float) * size());
+  }
+  vec_live(MEM_FLOATMATRIX, -1);
+}
+
+static Persistent<FunctionTemplate> s_ct;
+
+bool
+FloatMatrix::HasInstance(Handle<Value> val)
+{
+  return val->IsObject() && s_ct->HasInstance(val);
+}
+
+Handle<Object>
+FloatMatrix::NewInstance(uint32_t rows, uint32_t cols)
+{
+  HandleScope scope;
+  Handle<Value> argv[2] = { Integer::NewFromUnsigned(rows), Integer::NewFromUnsigned(cols) };
+  return scope.Close(s_ct->GetFunction()->NewInstance(2, argv));
+}
+
+// Whether a rows x cols matrix, or a row or column of it, would not fit
+// in a FloatVec.
+static bool
+too_large(uint32_t rows, uint32_t cols)
+{
+  return rows > 0x7fffffffu || cols > 0x7fffffffu || (uint64_t) rows * cols > 0x7fffffffu;
+}
+
+/*
+ * new FloatMatrix(rows, cols[, data]) is a zero matrix, or one filled
+ * row by row from a FloatVec, array, typed array or Buffer of exactly
+ * rows * cols values.
+ */
+Handle<Value>
+FloatMatrix::New(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 2 || ! args[0]->IsUint32() || ! args[1]->IsUint32()) {
+    return ThrowException(Exception::TypeError(String::New("Rows and columns must be non-negative integers")));
+  }
+  uint32_t rows = args[0]->Uint32Value(), cols = args[1]->Uint32Value();
+  if (too_large(rows, cols)) {
+    return ThrowException(Exception::TypeError(String::New("Matrix too large")));
+  }
+
+  uint32_t n = 0;
+  bool from_vec = false;
+  if (args.Length() > 2 && ! args[2]->IsUndefined()) {
+    from_vec = FloatVec::HasInstance(args[2]);
+    if (from_vec) {
+      n = ObjectWrap::Unwrap<FloatVec>(args[2]->ToObject())->size();
+    } else if (! bulk_source(args[2], &n)) {
+      return ThrowException(Exception::TypeError(String::New("Data must be a FloatVec, array, typed array or Buffer")));
+    }
+    if (n != rows * cols) {
+      return ThrowException(Exception::TypeError(String::New("Data must have rows * cols elements")));
+    }
+  }
+
+  double *values = 0;
+  if (n && ! from_vec && ! bulk_convert(args[2]->ToObject(), n, ELEM_F32, &values)) {
+    return Handle<Value>();
+  }
+
+  FloatMatrix* hw = new FloatMatrix();
+  hw->rows = rows;
+  hw->cols = cols;
+  if (hw->size()) {
+    hw->vec = (float *) vec_alloc(MEM_FLOATMATRIX, sizeof(float) * hw->size());
+    if (! hw->vec) {
+      delete hw;
+      free(values);
+      return ThrowException(Exception::TypeError(String::New("Out of memory")));
+    }
+    V8::AdjustAmountOfExternalAllocatedMemory(sizeof(float) * hw->size());
+  }
+  if (from_vec && n) {
+    memcpy(hw->vec, ObjectWrap::Unwrap<FloatVec>(args[2]->ToObject())->data(), sizeof(float) * n);
+  } else if (n) {
+    bulk_copy_in(args[2]->ToObject(), values, n, hw->vec, ELEM_F32, 0);
+    free(values);
+  }
+
+  hw->Wrap(args.This());
+  return args.This();
+}
+
+Handle<Value>
+FloatMatrix::GetRows(Local<String> property, const AccessorInfo& info)
+{
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(info.This());
+  return Integer::NewFromUnsigned(hw->rows);
+}
+
+Handle<Value>
+FloatMatrix::GetCols(Local<String> property, const AccessorInfo& info)
+{
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(info.This());
+  return Integer::NewFromUnsigned(hw->cols);
+}
+
+// Row and column arguments at args[0] and args[1]; false if either is
+// not an index into the matrix.
+static bool
+cell_args(const Arguments& args, uint32_t rows, uint32_t cols, uint32_t *i, uint32_t *j)
+{
+  if (args.Length() < 2 || ! args[0]->IsUint32() || ! args[1]->IsUint32()) { return false; }
+  *i = args[0]->Uint32Value();
+  *j = args[1]->Uint32Value();
+  return *i < rows && *j < cols;
+}
+
+/*
+ * A FloatVec over row i, sharing the matrix storage: writes to either
+ * show in the other, and the row keeps the matrix alive.  A row grown
+ * past cols elements moves to storage of its own.
+ */
+Handle<Value>
+FloatMatrix::Row(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsUint32() || args[0]->Uint32Value() >= hw->rows) {
+    return ThrowException(Exception::TypeError(String::New("Row out of range")));
+  }
+  uint32_t i = args[0]->Uint32Value();
+  return scope.Close(FloatVec::NewView(args.This(), hw->vec + (size_t) i * hw->cols, hw->cols));
+}
+
+Handle<Value>
+FloatMatrix::Get(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  uint32_t i, j;
+  if (! cell_args(args, hw->rows, hw->cols, &i, &j)) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  return scope.Close(Number::New(hw->vec[(size_t) i * hw->cols + j]));
+}
+
+Handle<Value>
+FloatMatrix::Set(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  uint32_t i, j;
+  if (! cell_args(args, hw->rows, hw->cols, &i, &j)) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  hw->vec[(size_t) i * hw->cols + j] = args.Length() > 2 ? args[2]->NumberValue() : 0;
+  return scope.Close(args.This());
+}
+
+// A copy of the whole matrix, row after row, as a FloatVec.
+Handle<Value>
+FloatMatrix::ToFloatVec(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  Handle<Object> ret = FloatVec::NewInstance(hw->size());
+  if (ret.IsEmpty()) { return Handle<Value>(); }
+  if (hw->size()) { memcpy(ObjectWrap::Unwrap<FloatVec>(ret)->data(), hw->vec, sizeof(float) * hw->size()); }
+  return scope.Close(ret);
+}
+
+/*
+ * The product of this matrix and a FloatVec of cols elements, as a new
+ * FloatVec of rows elements.
+ */
+Handle<Value>
+FloatMatrix::Gemv(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  if (args.Length() < 1 || ! FloatVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a FloatVec")));
+  }
+  FloatVec *x = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+  if (x->size() != hw->cols) {
+    return ThrowException(Exception::TypeError(String::New("Vector length must match the columns")));
+  }
+
+  Handle<Object> ret = FloatVec::NewInstance(hw->rows);
+  if (ret.IsEmpty()) { return Handle<Value>(); }
+  gemv_f32(hw->vec, hw->rows, hw->cols, x->data(), ObjectWrap::Unwrap<FloatVec>(ret)->data());
+  return scope.Close(ret);
+}
+
+/*
+ * The product of this matrix and another with as many rows as this has
+ * columns, as a new FloatMatrix.
+ */
+Handle<Value>
+FloatMatrix::Gemm(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  if (args.Length() < 1 || ! HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a FloatMatrix")));
+  }
+  FloatMatrix *b = ObjectWrap::Unwrap<FloatMatrix>(args[0]->ToObject());
+  if (b->rows != hw->cols) {
+    return ThrowException(Exception::TypeError(String::New("Matrix rows must match the columns")));
+  }
+  if (too_large(hw->rows, b->cols)) {
+    return ThrowException(Exception::TypeError(String::New("Matrix too large")));
+  }
+
+  Handle<Object> ret = NewInstance(hw->rows, b->cols);
+  if (ret.IsEmpty()) { return Handle<Value>(); }
+  FloatMatrix *c = ObjectWrap::Unwrap<FloatMatrix>(ret);
+  if (c->size()) { gemm_f32(hw->vec, b->vec, hw->rows, hw->cols, b->cols, c->vec); }
+  return scope.Close(ret);
+}
+
+/*
+ * knn(query, k, metric) finds the k rows nearest to a FloatVec of cols
+ * elements, best first and ties to the lower row, as {indices: IntVec,
+ * scores: FloatVec}.  The metric is "l2" (the default) for the smallest
+ * euclidean distances, or "dot" or "cosine" for the largest dot products
+ * or cosine similarities.  Rows scoring NaN are never chosen.
+ */
+Handle<Value>
+FloatMatrix::Knn(const Arguments& args)
+{
+  HandleScope scope;
+  FloatMatrix* hw = ObjectWrap::Unwrap<FloatMatrix>(args.This());
+
+  if (args.Length() < 1 || ! FloatVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Query must be a FloatVec")));
+  }
+  FloatVec *q = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+  if (q->size() != hw->cols) {
+    return ThrowException(Exception::TypeError(String::New("Query length must match the columns")));
+  }
+  if (args.Length() < 2 || ! args[1]->IsInt32() || args[1]->Int32Value() < 0) {
+    return ThrowException(Exception::TypeError(String::New("k must be a non-negative integer")));
+  }
+  int metric = KNN_L2;
+  if (args.Length() > 2 && ! args[2]->IsUndefined()) {
+    metric = -1;
+    if (args[2]->IsString()) {
+      String::Utf8Value name(args[2]);
+      metric = knn_metric(*name);
+    }
+    if (metric < 0) {
+      return ThrowException(Exception::TypeError(String::New("Metric must be l2, dot or cosine")));
+    }
+  }
+
+  uint32_t k = args[1]->Int32Value();
+  if (k > hw->rows) { k = hw->rows; }
+  uint32_t *idx = (uint32_t *) malloc(k * sizeof(uint32_t));
+  float *scores = (float *) malloc(k * sizeof(float));
+  uint32_t m = knn_f32(hw->vec, hw->rows, hw->cols, q->data(), k, metric, idx, scores);
+
+  Handle<Object> indices = IntVec::NewInstance(m), values = FloatVec::NewInstance(m);
+  if (indices.IsEmpty() || values.IsEmpty()) {
+    free(idx);
+    free(scores);
+    return Handle<Value>();
+  }
+  int32_t *iout = ObjectWrap::Unwrap<IntVec>(indices)->data();
+  float *vout = ObjectWrap::Unwrap<FloatVec>(values)->data();
+  for (uint32_t j = 0; j < m; ++j) {
+    iout[j] = idx[j];
+    vout[j] = scores[j];
+  }
+  free(idx);
+  free(scores);
+
+  Handle<Object> ret = Object::New();
+  ret->Set(String::NewSymbol("indices"), indices);
+  ret->Set(String::NewSymbol("scores"), values);
+  return scope.Close(ret);
+}
+
+void
+FloatMatrix::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("FloatMatrix"));
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "row", Row);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "get", Get);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "set", Set);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toFloatVec", ToFloatVec);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "gemv", Gemv);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "gemm", Gemm);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "knn", Knn);
+
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("rows"), GetRows);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("cols"), GetCols);
+
+  target->Set(String::NewSymbol("FloatMatrix"), s_ct->GetFunction());
+}
@@ -0,0 +1,60 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef FLOATMATRIX_H
+#define FLOATMATRIX_H
+
+#include <v8.h>
+#include <node.h>
+
+#include "vecmem.h"
+
+using namespace node;
+using namespace v8;
+
+/*
+ * A rows x cols matrix of floats, stored row-major in one contiguous
+ * block of vector storage.  row(i) is a FloatVec view of a row that
+ * writes through to the matrix, and gemv, gemm and knn run natively over
+ * the whole block.  Rows, columns and elements are each at most
+ * 2^31-1, the longest FloatVec, so rows, gemv results and the whole
+ * matrix all fit in one.
+ */
+class FloatMatrix: ObjectWrap
+{
+private:
+  uint32_t rows;
+  uint32_t cols;
+  float *vec;
+
+public:
+
+  static void Init(Handle<Object> target);
+  static bool HasInstance(Handle<Value> val);
+  static Handle<Object> NewInstance(uint32_t rows, uint32_t cols);
+
+  FloatMatrix() : rows(0), cols(0), vec(0) { vec_live(MEM_FLOATMATRIX, 1); }
+  ~FloatMatrix();
+
+  // Prototype methods.
+  static Handle<Value> New(const Arguments& args);
+  static Handle<Value> Row(const Arguments& args);
+  static Handle<Value> Get(const Arguments& args);
+  static Handle<Value> Set(const Arguments& args);
+  static Handle<Value> ToFloatVec(const Arguments& args);
+  static Handle<Value> Gemv(const Arguments& args);
+  static Handle<Value> Gemm(const Arguments& args);
+  static Handle<Value> Knn(const Arguments& args);
+
+  // Getters
+  static Handle<Value> GetRows(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetCols(Local<String> property, const AccessorInfo& info);
+
+  // Raw access for native kernels.
+  uint32_t size() { return rows * cols; }
+  float *data() { return vec; }
+};
+
+#endif
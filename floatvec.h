@@ -3,32 +3,95 @@
 * LICENSE file.
 */
 
+#ifndef FLOATVEC_H
+#define FLOATVEC_H
+
 #include <v8.h>
 #include <node.h>
 
+#include "vecmem.h"
+#include "dirty.h"
+
 using namespace node;
 using namespace v8;
 
 class FloatVec: ObjectWrap
 {
 private:
+  uint32_t buflen;
   uint32_t length;
   float *vec;
+  float inline_vec[VEC_INLINE_BYTES / sizeof(float)];
+  VecShare *share;  // Heap storage shared with clones, if any
+  Persistent<Object> owner;  // Holder of the storage of a view, if any
+  bool shared;      // Storage is a shared memory segment
+  VecDirty dirty;   // Blocks written since the last delta
+  uint64_t cached_hash;
+  bool hash_valid;  // cached_hash is of the current contents
 
 public:
 
   static void Init(Handle<Object> target);
+  static bool HasInstance(Handle<Value> val);
+  static Handle<Object> NewInstance(uint32_t len);
+  static Handle<Object> NewView(Handle<Object> owner, float *data, uint32_t len);
+  static Handle<Object> NewShared(float *data, uint32_t len);
 
- FloatVec() : length(0), vec(0) {}
+ FloatVec() : buflen(0), length(0), vec(0), inline_vec(), share(0), owner(), shared(false), dirty(), cached_hash(0), hash_valid(false) { vec_live(MEM_FLOATVEC, 1); }
   ~FloatVec();
 
   // Prototype methods.
   static Handle<Value> New(const Arguments& args);
   static Handle<Value> ToString(const Arguments& args);
+  static Handle<Value> Clone(const Arguments& args);
+  static Handle<Value> CopyFrom(const Arguments& args);
+  static Handle<Value> Fill(const Arguments& args);
+  static Handle<Value> Set(const Arguments& args);
+  static Handle<Value> ToArray(const Arguments& args);
+  static Handle<Value> ToTypedArray(const Arguments& args);
+  static Handle<Value> DirtyRanges(const Arguments& args);
+  static Handle<Value> ClearDirty(const Arguments& args);
+  static Handle<Value> SerializeDelta(const Arguments& args);
+  static Handle<Value> ApplyDelta(const Arguments& args);
+  static Handle<Value> Hash(const Arguments& args);
+  static Handle<Value> Equals(const Arguments& args);
+  static Handle<Value> Share(const Arguments& args);
+  static Handle<Value> ToSparse(const Arguments& args);
 
   static Handle<Value> ForEach(const Arguments& args);
   static Handle<Value> Map(const Arguments& args);
   static Handle<Value> Reduce(const Arguments& args);
+  static Handle<Value> MapInto(const Arguments& args);
+  static Handle<Value> Transform(const Arguments& args);
+  static Handle<Value> ForEachChunk(const Arguments& args);
+  static Handle<Value> MapChunk(const Arguments& args);
+  static Handle<Value> ReduceChunk(const Arguments& args);
+
+  static Handle<Value> Histogram(const Arguments& args);
+  static Handle<Value> Quantiles(const Arguments& args);
+  static Handle<Value> TopK(const Arguments& args);
+  static Handle<Value> Argpartition(const Arguments& args);
+
+  static Handle<Value> Scan(const Arguments& args);
+  static Handle<Value> Diff(const Arguments& args);
+
+  static Handle<Value> Take(const Arguments& args);
+  static Handle<Value> Put(const Arguments& args);
+  static Handle<Value> Compress(const Arguments& args);
+  static Handle<Value> Expand(const Arguments& args);
+
+  static Handle<Value> Sum(const Arguments& args);
+  static Handle<Value> Min(const Arguments& args);
+  static Handle<Value> Max(const Arguments& args);
+  static Handle<Value> Count(const Arguments& args);
+
+  static Handle<Value> Gt(const Arguments& args);
+  static Handle<Value> Ge(const Arguments& args);
+  static Handle<Value> Lt(const Arguments& args);
+  static Handle<Value> Le(const Arguments& args);
+  static Handle<Value> Eq(const Arguments& args);
+  static Handle<Value> Ne(const Arguments& args);
+  static Handle<Value> Between(const Arguments& args);
 
   // Getter
   static Handle<Value> GetLength(Local<String> property, const AccessorInfo& info);
@@ -39,8 +102,28 @@ public:
 
   // Internal manipulators
   float get(uint32_t idx);
-  float set(uint32_t idx, float v);
-  void extend(uint32_t len);
-  int setString(Local<String> str);
+  bool set(uint32_t idx, float v);
+  bool extend(uint32_t len);
+  void release();
+  int setString(Local<String> str);  // -1 if malformed, -2 if out of memory
   Handle<Value> toString(bool json = false);
+
+  // Call before writing to the storage, which clones share until then,
+  // with the elements about to be written (by default all of them).
+  void willWrite(uint32_t start = 0, uint32_t end = ~0u) {
+    unshare();
+    dirty_mark(&dirty, ELEM_F32, start, end);
+  }
+  // willWrite() for writers that mark their own dirty blocks.
+  void unshare() {
+    hash_valid = false;
+    if (share) { vec = (float *) vec_unshare(MEM_FLOATVEC, vec, sizeof(float) * buflen, &share); }
+  }
+
+  // Raw access for native kernels in the other vector types; call
+  // willWrite() before writing through data().
+  uint32_t size() { return length; }
+  float *data() { return vec; }
 };
+
+#endif
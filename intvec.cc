@@ -8,23 +8,83 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 using namespace node;
 using namespace v8;
 
 #include "intvec.h"
+#include "floatvec.h"
+#include "bitvec.h"
+#include "stats.h"
+#include "kernels.h"
+#include "chunk.h"
+#include "mapinto.h"
+#include "bulk.h"
 
 IntVec::~IntVec()
+{
+  release();
+  dirty_free(&dirty);
+  vec_live(MEM_INTVEC, -1);
+}
+
+// Give up the storage, wherever it is, leaving the vector without any.
+void
+IntVec::release()
 {
   if (vec) {
-    fprintf(stderr, "intvec: free vec @%p\n", vec);
-    free(vec);
+    //fprintf(stderr, "intvec: free vec @%p\n", vec);
+    if (shared) {
+      vec_shm_close(MEM_INTVEC, vec);
+    } else if (! share || vec_unshare_release(&share)) {
+      vec_release(MEM_INTVEC, vec, inline_vec, sizeof(int32_t) * buflen);
+    }
     V8::AdjustAmountOfExternalAllocatedMemory(-sizeof(int32_t) * buflen);
   }
+  vec = 0;
+  buflen = 0;
+  shared = false;
 }
 
 static Persistent<FunctionTemplate> s_ct;
 
+bool
+IntVec::HasInstance(Handle<Value> val)
+{
+  return val->IsObject() && s_ct->HasInstance(val);
+}
+
+Handle<Object>
+IntVec::NewInstance(uint32_t len)
+{
+  HandleScope scope;
+  Handle<Value> argv[1] = { Integer::NewFromUnsigned(len) };
+  return scope.Close(s_ct->GetFunction()->NewInstance(1, argv));
+}
+
+/*
+ * A vector over len ints of a shared memory segment, which it unmaps
+ * when collected.  Writes are seen by every process that has the segment
+ * mapped, until the vector grows past len and moves to storage of its
+ * own.
+ */
+Handle<Object>
+IntVec::NewShared(int32_t *data, uint32_t len)
+{
+  HandleScope scope;
+  Handle<Object> ret = NewInstance(0);
+  IntVec *hw = ObjectWrap::Unwrap<IntVec>(ret);
+  hw->vec = data;
+  hw->buflen = hw->length = len;
+  hw->shared = true;
+  hw->hash_valid = false;  // other processes may write it from now on
+  dirty_resize(&hw->dirty, ELEM_I32, len);
+  dirty_mark(&hw->dirty, ELEM_I32, 0, len);
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * len);
+  return scope.Close(ret);
+}
+
 Handle<Value>
 IntVec::New(const Arguments& args)
 {
@@ -39,9 +99,14 @@ IntVec::New(const Arguments& args)
       if (len < 0) {
         return ThrowException(Exception::TypeError(String::New("Bad argument")));
       }
-      hw->extend(len);
+      if (! hw->extend(len)) {
+        return ThrowException(Exception::TypeError(String::New("Out of memory")));
+      }
     } else if (args[0]->IsString()) {
-      if (hw->setString(Local<String>::Cast(args[0])) < 0) {
+      int r = hw->setString(Local<String>::Cast(args[0]));
+      if (r == -2) {
+        return ThrowException(Exception::TypeError(String::New("Out of memory")));
+      } else if (r < 0) {
         return ThrowException(Exception::TypeError(String::New("Invalid IntVec string")));
       }
     } else {
@@ -74,15 +139,17 @@ IntVec::get(int idx)
   return vec[idx];
 }
 
-int32_t
+// False if the vector could not grow to hold idx.
+bool
 IntVec::set(uint32_t idx, int32_t value)
 {
   if (idx < length || value) {
-    extend(idx+1);
+    if (! extend(idx+1)) { return false; }
+    willWrite(idx, idx+1);
     //fprintf(stderr, "intvec: set(%d,%d)\n", idx, value);
     vec[idx] = value;
   }
-  return value;
+  return true;
 }
 
 int
@@ -97,7 +164,7 @@ IntVec::setString(Local<String> str) {
   int i = 0;
   for (p = start; p; ++i, p = index(p+1, ',')) {}
   //fprintf(stderr, "intvec: setString len %d\n", i);
-  extend(i);
+  if (! extend(i)) { free(data); return -2; }
 
   int v;
   for (i = 0, p = start; (q = index(p, ',')); ++i, p = q+1) {
@@ -138,30 +205,46 @@ IntVec::ToString(const Arguments& args)
   return scope.Close(hw->toString());
 }
 
-void
+// False, with the storage as it was, if it cannot grow to len elements.
+bool
 IntVec::extend(uint32_t len) {
+  dirty_resize(&dirty, ELEM_I32, len);
+  hash_valid = false;
   uint32_t new_buflen = len;
 
   if (new_buflen <= buflen) {
-    return;
+    if (len > length) { length = len; }
+    return true;
   } else if (new_buflen < 5*buflen/4) {
     new_buflen = 5*buflen/4;
   }
 
-  if (vec) {
-    vec = (int32_t *) realloc(vec, new_buflen * sizeof(int32_t));
-    //fprintf(stderr, "intvec: realloc %d ints @%p\n", new_buflen, vec);
-    int32_t prev_len = length;
-    bzero(vec + prev_len, (new_buflen - prev_len) * sizeof(int32_t));
+  // Small vectors use all of the inline buffer straight away.
+  if (new_buflen * sizeof(int32_t) <= VEC_INLINE_BYTES) {
+    new_buflen = VEC_INLINE_BYTES / sizeof(int32_t);
+  }
+  if (shared) {
+    // Leaving the shared segment, for storage only this vector sees.
+    int32_t *own = (int32_t *) vec_grow(MEM_INTVEC, 0, inline_vec, 0, new_buflen * sizeof(int32_t));
+    if (! own) { return false; }
+    memcpy(own, vec, sizeof(int32_t) * length);
+    vec_shm_close(MEM_INTVEC, vec);
+    shared = false;
+    vec = own;
   } else {
-    vec = (int32_t *) calloc(new_buflen, sizeof(int32_t));
-    //fprintf(stderr, "intvec: calloc %d ints @%p\n", len, vec);
+    unshare();
+    int32_t *grown = (int32_t *) vec_grow(MEM_INTVEC, vec, inline_vec, buflen * sizeof(int32_t),
+                                          new_buflen * sizeof(int32_t));
+    if (! grown) { return false; }
+    vec = grown;
   }
+  //fprintf(stderr, "intvec: realloc %d ints @%p\n", new_buflen, vec);
 
   //fprintf(stderr, "intvec: [%d] extend %d -> %d\n", len, length, new_buflen);
   V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * (new_buflen - buflen));
   buflen = new_buflen;
   length = len;
+  return true;
 }
 
 /*
@@ -171,6 +254,7 @@ IntVec::extend(uint32_t len) {
 Handle<Value>
 IntVec::IndexGet(uint32_t idx, const AccessorInfo& info)
 {
+  VEC_COUNT(MEM_INTVEC, gets);
   IntVec* hw = ObjectWrap::Unwrap<IntVec>(info.This());
 
   int32_t retval = (idx >= hw->length ? 0 : hw->get(idx));
@@ -186,6 +270,7 @@ IntVec::IndexGet(uint32_t idx, const AccessorInfo& info)
 Handle<Value>
 IntVec::IndexSet(uint32_t idx, Local<Value> value, const AccessorInfo& info)
 {
+  VEC_COUNT(MEM_INTVEC, sets);
   if (idx < 0) {
     return ThrowException(Exception::TypeError(String::New("Bad argument")));
   }
@@ -194,10 +279,382 @@ IntVec::IndexSet(uint32_t idx, Local<Value> value, const AccessorInfo& info)
 
   //fprintf(stderr, "intvec: IndexSet(%d, %d)\n", idx, value->Int32Value());
 
-  hw->set(idx, value->Int32Value());
+  if (! hw->set(idx, value->Int32Value())) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
   return value;
 }
 
+/*
+ * A copy of this vector that shares its storage until either one is
+ * written to, when the writer takes a private copy.
+ */
+Handle<Value>
+IntVec::Clone(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (hw->shared) {
+    // Clones of shared vectors are private.
+    Handle<Object> ret = NewInstance(hw->length);
+    memcpy(ObjectWrap::Unwrap<IntVec>(ret)->vec, hw->vec, sizeof(int32_t) * hw->length);
+    return scope.Close(ret);
+  }
+
+  Handle<Object> ret = NewInstance(0);
+  IntVec *copy = ObjectWrap::Unwrap<IntVec>(ret);
+
+  copy->length = hw->length;
+  copy->buflen = hw->buflen;
+  if (hw->vec == hw->inline_vec) {
+    memcpy(copy->inline_vec, hw->inline_vec, sizeof(hw->inline_vec));
+    copy->vec = copy->inline_vec;
+  } else if (hw->vec) {
+    hw->share = copy->share = vec_share(hw->share);
+    copy->vec = hw->vec;
+  }
+  copy->cached_hash = hw->cached_hash;
+  copy->hash_valid = hw->hash_valid;
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * copy->buflen);
+
+  return scope.Close(ret);
+}
+
+/*
+ * Make this vector a copy of another one with a single memcpy.
+ */
+Handle<Value>
+IntVec::CopyFrom(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be an IntVec")));
+  }
+  IntVec *other = ObjectWrap::Unwrap<IntVec>(args[0]->ToObject());
+  if (other == hw) { return scope.Close(args.This()); }
+
+  if (! hw->extend(other->length)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite();
+  memcpy(hw->vec, other->vec, sizeof(int32_t) * other->length);
+  if (hw->length > other->length) {
+    memset(hw->vec + other->length, 0, sizeof(int32_t) * (hw->length - other->length));
+    hw->length = other->length;
+  }
+
+  return scope.Close(args.This());
+}
+
+/*
+ * Set elements [start, end) to a value, extending the vector if end is
+ * past its length.
+ */
+Handle<Value>
+IntVec::Fill(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t start, end;
+  if (args.Length() < 1 || ! args[0]->IsNumber() || ! range_args(args, 1, hw->length, &start, &end)) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  }
+  int32_t v = args[0]->Int32Value();
+  if (! hw->extend(end)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite(start, end);
+  for (uint32_t i = start; i < end; ++i) { hw->vec[i] = v; }
+
+  return scope.Close(args.This());
+}
+
+/*
+ * Copy a JS array, typed array or Buffer into this vector from offset,
+ * extending it as needed.
+ */
+Handle<Value>
+IntVec::Set(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t n, offset = 0;
+  if (args.Length() < 1 || ! bulk_source(args[0], &n)) {
+    return ThrowException(Exception::TypeError(String::New("Source must be an array, typed array or Buffer")));
+  }
+  if (args.Length() > 1 && ! args[1]->IsUndefined()) {
+    if (! args[1]->IsInt32() || args[1]->Int32Value() < 0) {
+      return ThrowException(Exception::TypeError(String::New("Offset must be a non-negative integer")));
+    }
+    offset = args[1]->Int32Value();
+  }
+
+  // Convert first: it may run JS that changes this vector.
+  double *values;
+  if (! bulk_convert(args[0]->ToObject(), n, ELEM_I32, &values)) { return Handle<Value>(); }
+  if (! hw->extend(offset + n)) {
+    free(values);
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite(offset, offset + n);
+  bulk_copy_in(args[0]->ToObject(), values, n, hw->vec, ELEM_I32, offset);
+  free(values);
+
+  return scope.Close(args.This());
+}
+
+// Elements [start, end) as a JS Array or a Int32Array.
+static bool
+intvec_range(const Arguments& args, uint32_t length, uint32_t *start, uint32_t *end)
+{
+  if (! range_args(args, 0, length, start, end)) { return false; }
+  if (*end > length) { *end = length; }
+  if (*start > *end) { *start = *end; }
+  return true;
+}
+
+Handle<Value>
+IntVec::ToArray(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t start, end;
+  if (! intvec_range(args, hw->length, &start, &end)) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  }
+  return scope.Close(bulk_to_array(hw->vec, ELEM_I32, start, end));
+}
+
+Handle<Value>
+IntVec::ToTypedArray(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t start, end;
+  if (! intvec_range(args, hw->length, &start, &end)) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  }
+  return scope.Close(bulk_to_typed_array(hw->vec, ELEM_I32, start, end));
+}
+
+/*
+ * Call back with the start and end of each run of elements written since
+ * the last delta or clearDirty(), in whole blocks; before either, the
+ * whole vector is one run.
+ */
+Handle<Value>
+IntVec::DirtyRanges(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  }
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  uint32_t start, end;
+  for (uint32_t i = 0; dirty_next(&hw->dirty, ELEM_I32, hw->length, i, &start, &end); i = end) {
+    Handle<Value> argv[2] = { Integer::NewFromUnsigned(start), Integer::NewFromUnsigned(end) };
+    VEC_COUNT(MEM_INTVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 2, argv);
+    if (ret.IsEmpty()) { return ret; }
+  }
+
+  return scope.Close(args.This());
+}
+
+Handle<Value>
+IntVec::ClearDirty(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  dirty_clear(&hw->dirty, ELEM_I32, hw->length);
+  return scope.Close(args.This());
+}
+
+/*
+ * A Buffer of the runs written since the last delta, for applyDelta() on
+ * a copy of this vector as it was then.  The first delta holds all of it.
+ */
+Handle<Value>
+IntVec::SerializeDelta(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  return scope.Close(delta_serialize(&hw->dirty, ELEM_I32, hw->vec, hw->length));
+}
+
+Handle<Value>
+IntVec::ApplyDelta(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t len;
+  if (args.Length() < 1 || ! delta_check(args[0], ELEM_I32, &len)) {
+    return ThrowException(Exception::TypeError(String::New("Bad delta")));
+  }
+
+  if (! hw->extend(len)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->unshare();
+  if (hw->length > len) {
+    memset(hw->vec + len, 0, sizeof(int32_t) * (hw->length - len));
+    hw->length = len;
+  }
+  delta_apply(args[0], &hw->dirty, ELEM_I32, hw->vec);
+
+  return scope.Close(args.This());
+}
+
+/*
+ * A 64-bit hash of the contents, as 16 hex digits, cached until the
+ * next write.  Vectors that are equals() hash the same.
+ */
+Handle<Value>
+IntVec::Hash(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (! hw->hash_valid) {
+    hw->cached_hash = hash64(hw->vec, sizeof(int32_t) * hw->length, hw->length);
+    // Shared storage can be written by other processes.
+    hw->hash_valid = ! hw->shared;
+  }
+  char buffer[17];
+  sprintf(buffer, "%016llx", (unsigned long long) hw->cached_hash);
+  return scope.Close(String::New(buffer));
+}
+
+/*
+ * Whether another IntVec has the same length and the same contents, element for element.
+ */
+Handle<Value>
+IntVec::Equals(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! HasInstance(args[0])) { return scope.Close(False()); }
+  IntVec *other = ObjectWrap::Unwrap<IntVec>(args[0]->ToObject());
+
+  if (hw->length != other->length) { return scope.Close(False()); }
+  if (hw->hash_valid && other->hash_valid && hw->cached_hash != other->cached_hash) {
+    return scope.Close(False());
+  }
+  bool eq = hw->vec == other->vec || hw->length == 0 || ! memcmp(hw->vec, other->vec, sizeof(int32_t) * hw->length);
+  return scope.Close(eq ? True() : False());
+}
+
+/*
+ * Move the storage into a new shared memory segment of this name, which
+ * vec.openShared(name) opens in other processes as an IntVec over the
+ * same elements.  The name lasts until vec.unlinkShared(name).
+ */
+Handle<Value>
+IntVec::Share(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsString()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a name")));
+  }
+  String::Utf8Value name(args[0]);
+  uint32_t len = hw->length;
+  int32_t *p = (int32_t *) vec_shm_create(*name, MEM_INTVEC, len, sizeof(int32_t) * len);
+  if (! p) {
+    return ThrowException(Exception::TypeError(String::Concat(
+        String::New("Cannot create shared memory: "), String::New(strerror(errno)))));
+  }
+  if (len) { memcpy(p, hw->vec, sizeof(int32_t) * len); }
+  hw->release();
+  hw->vec = p;
+  hw->buflen = len;
+  hw->shared = true;
+  hw->hash_valid = false;  // other processes may write it from now on
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int32_t) * len);
+
+  return scope.Close(args.This());
+}
+
+// The element an atomic operation works on, or -1.
+static int64_t
+atomic_index(const Arguments& args, uint32_t length)
+{
+  if (args.Length() < 1 || ! args[0]->IsUint32()) { return -1; }
+  uint32_t idx = args[0]->Uint32Value();
+  return idx < length ? idx : -1;
+}
+
+/*
+ * Atomic updates, safe against other processes and threads writing the
+ * same shared storage.  Each returns the element's previous value.
+ * Unlike indexed writes they never extend the vector.
+ */
+Handle<Value>
+IntVec::AtomicSet(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  int64_t idx = atomic_index(args, hw->length);
+  if (idx < 0) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  int32_t v = args.Length() > 1 ? args[1]->Int32Value() : 0;
+  hw->willWrite(idx, idx + 1);
+  __sync_synchronize();
+  return scope.Close(Integer::New(__sync_lock_test_and_set(&hw->vec[idx], v)));
+}
+
+Handle<Value>
+IntVec::AtomicAdd(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  int64_t idx = atomic_index(args, hw->length);
+  if (idx < 0) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  int32_t delta = args.Length() > 1 ? args[1]->Int32Value() : 1;
+  hw->willWrite(idx, idx + 1);
+  return scope.Close(Integer::New(__sync_fetch_and_add(&hw->vec[idx], delta)));
+}
+
+// Set the element to value if it is expected; it was if that is returned.
+Handle<Value>
+IntVec::CompareExchange(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  int64_t idx = atomic_index(args, hw->length);
+  if (idx < 0) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  if (args.Length() < 3) {
+    return ThrowException(Exception::TypeError(String::New("Must provide expected and new values")));
+  }
+  int32_t expected = args[1]->Int32Value(), v = args[2]->Int32Value();
+  hw->willWrite(idx, idx + 1);
+  return scope.Close(Integer::New(__sync_val_compare_and_swap(&hw->vec[idx], expected, v)));
+}
+
 Handle<Value>
 IntVec::ForEach(const Arguments& args)
 {
@@ -215,6 +672,7 @@ IntVec::ForEach(const Arguments& args)
   for (uint32_t i = 0; i < hw->length; ++i) {
     argv[0] = Int32::New(hw->get(i));
     argv[1] = Int32::New(i);
+    VEC_COUNT(MEM_INTVEC, callbacks);
     cb->Call(global, 2, argv);
   }
 
@@ -239,54 +697,814 @@ IntVec::Map(const Arguments& args)
   Local<Value> argv[1];
   for (uint32_t i = 0; i < hw->length; ++i) {
     argv[0] = Int32::New(hw->vec[i]);
+    VEC_COUNT(MEM_INTVEC, callbacks);
     retval->Set(i, cb->Call(global, 1, argv));
   }
 
   return scope.Close(retval);
 }
 
+/*
+ * Like map, but the callback results are stored straight into a native
+ * vector: [out] is an existing IntVec, FloatVec or BitVec, or the name
+ * of the type of a new one ("int", "float" or "bit"), by default a new
+ * IntVec.  Returns the output vector.
+ */
 Handle<Value>
-IntVec::Reduce(const Arguments& args)
+IntVec::MapInto(const Arguments& args)
 {
   HandleScope scope;
   IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
 
-  if (args.Length() < 1) {
-    return ThrowException(Exception::TypeError(String::New("Must provide a reduce argument")));
-  } else if (args.Length() < 2 || !args[1]->IsFunction()) {
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
     return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
   }
 
-  Local<Function> cb = Local<Function>::Cast(args[1]);
+  Handle<Object> out;
+  int type;
+  if (! map_output(args.Length() > 1 ? args[1] : Handle<Value>(Undefined()), ELEM_I32,
+                   hw->length, &out, &type)) {
+    return Handle<Value>();
+  }
 
+  Local<Function> cb = Local<Function>::Cast(args[0]);
   Handle<Object> global = Context::GetCurrent()->Global();
 
-  Local<Value> argv[2];
-  argv[0] = args[0];
   for (uint32_t i = 0; i < hw->length; ++i) {
-    argv[1] = Int32::New(hw->vec[i]);
-    argv[0] = cb->Call(global, 2, argv);
+    HandleScope elem_scope;
+    Handle<Value> argv[2] = { Int32::New(hw->get(i)), Integer::NewFromUnsigned(i) };
+    VEC_COUNT(MEM_INTVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 2, argv);
+    if (ret.IsEmpty()) { return ret; }
+    if (! map_store(out, type, i, ret)) {
+      return ThrowException(Exception::TypeError(String::New("Out of memory")));
+    }
   }
 
-  return scope.Close(argv[0]);
+  return scope.Close(out);
 }
 
-void
-IntVec::Init(Handle<Object> target)
+/*
+ * Apply a named transform natively, with no callback: one of cast, sqrt,
+ * log, exp, round, floor, ceil, abs or neg, into [out] as for mapInto,
+ * which may be this vector itself.
+ * The default output is a new IntVec, or a FloatVec for sqrt, log and exp.
+ */
+Handle<Value>
+IntVec::Transform(const Arguments& args)
 {
   HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
 
-  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+  if (args.Length() < 1 || ! args[0]->IsString()) {
+    return ThrowException(Exception::TypeError(String::New("Transform must be a name")));
+  }
+  int op = transform_op(*String::AsciiValue(args[0]));
+  if (op < 0) {
+    return ThrowException(Exception::TypeError(String::New("Unknown transform")));
+  }
 
-  s_ct = Persistent<FunctionTemplate>::New(t);
-  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
-  s_ct->SetClassName(String::NewSymbol("IntVec"));
+  Handle<Object> out;
+  int type;
+  if (! map_output(args.Length() > 1 ? args[1] : Handle<Value>(Undefined()),
+                   op == XF_SQRT || op == XF_LOG || op == XF_EXP ? ELEM_F32 : ELEM_I32, hw->length, &out, &type)) {
+    return Handle<Value>();
+  }
 
-  NODE_SET_PROTOTYPE_METHOD(s_ct, "toString", ToString);
+  transform(hw->vec, ELEM_I32, hw->length, op, map_data(out, type), type);
 
-  NODE_SET_PROTOTYPE_METHOD(s_ct, "forEach", ForEach);
-  NODE_SET_PROTOTYPE_METHOD(s_ct, "map", Map);
-  NODE_SET_PROTOTYPE_METHOD(s_ct, "reduce", Reduce);
+  return scope.Close(out);
+}
+
+Handle<Value>
+IntVec::Reduce(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1) {
+    return ThrowException(Exception::TypeError(String::New("Must provide a reduce argument")));
+  } else if (args.Length() < 2 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[1]);
+
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  Local<Value> argv[2];
+  argv[0] = args[0];
+  for (uint32_t i = 0; i < hw->length; ++i) {
+    argv[1] = Int32::New(hw->vec[i]);
+    VEC_COUNT(MEM_INTVEC, callbacks);
+    argv[0] = cb->Call(global, 2, argv);
+  }
+
+  return scope.Close(argv[0]);
+}
+
+/*
+ * Chunked forms of forEach, map and reduce: the callback gets a typed
+ * window over a copy of up to [size] elements (4096 by default) and the
+ * offset of its first element, instead of one call per element.  The
+ * copy is a memcpy per chunk, and leaves the callback free to change the
+ * vector, which the window never points into.
+ */
+Handle<Value>
+IntVec::ForEachChunk(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t size;
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  } else if (! chunk_size_arg(args, 1, &size)) {
+    return ThrowException(Exception::TypeError(String::New("Chunk size must be a positive integer")));
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  int32_t *chunk = (int32_t *) chunk_buffer(&size, hw->length, sizeof(int32_t));
+  if (! chunk) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  for (uint32_t i = 0; i < hw->length; i += size) {
+    HandleScope chunk_scope;
+    uint32_t n = hw->length - i < size ? hw->length - i : size;
+    memcpy(chunk, hw->vec + i, sizeof(int32_t) * n);
+    Handle<Object> window = chunk_window(chunk, kExternalIntArray, n);
+    Handle<Value> argv[2] = { window, Integer::NewFromUnsigned(i) };
+    VEC_COUNT(MEM_INTVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 2, argv);
+    chunk_detach(window);
+    if (ret.IsEmpty()) {
+      free(chunk);
+      return ret;
+    }
+  }
+  free(chunk);
+
+  return scope.Close(args.This());
+}
+
+/*
+ * The callback gets an input window, an output window of the same length
+ * over a new IntVec, and the offset; it fills in the output.
+ */
+Handle<Value>
+IntVec::MapChunk(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t size;
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  } else if (! chunk_size_arg(args, 1, &size)) {
+    return ThrowException(Exception::TypeError(String::New("Chunk size must be a positive integer")));
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  Handle<Object> retval = NewInstance(hw->length);
+  IntVec *out = ObjectWrap::Unwrap<IntVec>(retval);
+  int32_t *chunk = (int32_t *) chunk_buffer(&size, hw->length, sizeof(int32_t));
+  if (! chunk) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+
+  // The output is not reachable from the callback, so its window can be
+  // over its storage.
+  for (uint32_t i = 0; i < hw->length && i < out->length; i += size) {
+    HandleScope chunk_scope;
+    uint32_t n = hw->length - i < size ? hw->length - i : size;
+    if (out->length - i < n) { n = out->length - i; }
+    memcpy(chunk, hw->vec + i, sizeof(int32_t) * n);
+    Handle<Object> in = chunk_window(chunk, kExternalIntArray, n);
+    Handle<Object> dst = chunk_window(out->vec + i, kExternalIntArray, n);
+    Handle<Value> argv[3] = { in, dst, Integer::NewFromUnsigned(i) };
+    VEC_COUNT(MEM_INTVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 3, argv);
+    chunk_detach(in);
+    chunk_detach(dst);
+    if (ret.IsEmpty()) {
+      free(chunk);
+      return ret;
+    }
+  }
+  free(chunk);
+
+  return scope.Close(retval);
+}
+
+Handle<Value>
+IntVec::ReduceChunk(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t size;
+  if (args.Length() < 1) {
+    return ThrowException(Exception::TypeError(String::New("Must provide a reduce argument")));
+  } else if (args.Length() < 2 || !args[1]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  } else if (! chunk_size_arg(args, 2, &size)) {
+    return ThrowException(Exception::TypeError(String::New("Chunk size must be a positive integer")));
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[1]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  int32_t *chunk = (int32_t *) chunk_buffer(&size, hw->length, sizeof(int32_t));
+  if (! chunk) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  Local<Value> acc = args[0];
+  for (uint32_t i = 0; i < hw->length; i += size) {
+    HandleScope chunk_scope;
+    uint32_t n = hw->length - i < size ? hw->length - i : size;
+    memcpy(chunk, hw->vec + i, sizeof(int32_t) * n);
+    Handle<Object> window = chunk_window(chunk, kExternalIntArray, n);
+    Handle<Value> argv[3] = { acc, window, Integer::NewFromUnsigned(i) };
+    VEC_COUNT(MEM_INTVEC, callbacks);
+    Handle<Value> ret = cb->Call(global, 3, argv);
+    chunk_detach(window);
+    if (ret.IsEmpty()) {
+      free(chunk);
+      return ret;
+    }
+    acc = chunk_scope.Close(ret);
+  }
+  free(chunk);
+
+  return scope.Close(acc);
+}
+
+/*
+ * Count the elements in each of [bins] equal-width bins over [min,max],
+ * which defaults to the range of the vector.  Returns an IntVec.
+ */
+Handle<Value>
+IntVec::Histogram(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  // The counts are an IntVec, so at most 2^31-1 of them.
+  if (args.Length() < 1 || ! args[0]->IsUint32() || args[0]->Uint32Value() == 0 ||
+      args[0]->Uint32Value() > 0x7fffffffu) {
+    return ThrowException(Exception::TypeError(String::New("Number of bins must be a positive integer")));
+  }
+  uint32_t bins = args[0]->Uint32Value();
+
+  double lo, hi;
+  if (args.Length() >= 3) {
+    if (! args[1]->IsNumber() || ! args[2]->IsNumber()) {
+      return ThrowException(Exception::TypeError(String::New("Range must be numbers")));
+    }
+    lo = args[1]->NumberValue();
+    hi = args[2]->NumberValue();
+  } else {
+    minmax(hw->vec, hw->length, &lo, &hi);
+  }
+
+  Handle<Object> ret = IntVec::NewInstance(bins);
+  if (ret.IsEmpty()) { return Handle<Value>(); }
+  histogram(hw->vec, hw->length, bins, lo, hi, ObjectWrap::Unwrap<IntVec>(ret)->data());
+  return scope.Close(ret);
+}
+
+/*
+ * Exact quantiles by selection on a copy of the vector.  A single p
+ * returns a number; an Array or FloatVec of ps returns a FloatVec.
+ */
+Handle<Value>
+IntVec::Quantiles(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t m;
+  double *ps;
+  if (args.Length() >= 1 && args[0]->IsNumber()) {
+    m = 1;
+    ps = new double[1];
+    ps[0] = args[0]->NumberValue();
+  } else if (args.Length() >= 1 && args[0]->IsArray()) {
+    Local<Array> arr = Local<Array>::Cast(args[0]);
+    m = arr->Length();
+    ps = new double[m];
+    for (uint32_t j = 0; j < m; ++j) { ps[j] = arr->Get(j)->NumberValue(); }
+  } else if (args.Length() >= 1 && FloatVec::HasInstance(args[0])) {
+    FloatVec *fv = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+    m = fv->size();
+    ps = new double[m];
+    for (uint32_t j = 0; j < m; ++j) { ps[j] = fv->data()[j]; }
+  } else {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a number, Array or FloatVec")));
+  }
+  // x - x is 0 only for finite x.
+  for (uint32_t j = 0; j < m; ++j) {
+    if (ps[j] - ps[j] != 0) {
+      delete[] ps;
+      return ThrowException(Exception::TypeError(String::New("Quantiles must be finite numbers")));
+    }
+  }
+
+  int32_t *work = (int32_t *) malloc(hw->length * sizeof(int32_t));
+  memcpy(work, hw->vec, hw->length * sizeof(int32_t));
+  uint32_t n = hw->length;
+
+  double *qs = new double[m];
+  quantiles(work, n, ps, m, qs);
+  free(work);
+
+  Handle<Value> ret;
+  if (args[0]->IsNumber()) {
+    ret = Number::New(qs[0]);
+  } else {
+    Handle<Object> fv = FloatVec::NewInstance(m);
+    float *out = ObjectWrap::Unwrap<FloatVec>(fv)->data();
+    for (uint32_t j = 0; j < m; ++j) { out[j] = qs[j]; }
+    ret = fv;
+  }
+
+  delete[] ps;
+  delete[] qs;
+  return scope.Close(ret);
+}
+
+/*
+ * The k largest elements, best first and ties to the lower index, as
+ * {values: IntVec, indices: IntVec}.  {largest: false} selects the k
+ * smallest instead.
+ */
+Handle<Value>
+IntVec::TopK(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsInt32() || args[0]->Int32Value() < 0) {
+    return ThrowException(Exception::TypeError(String::New("k must be a non-negative integer")));
+  }
+  bool largest = true;
+  if (args.Length() >= 2 && args[1]->IsObject()) {
+    Local<Value> opt = args[1]->ToObject()->Get(String::NewSymbol("largest"));
+    if (! opt->IsUndefined()) { largest = opt->BooleanValue(); }
+  }
+
+  uint32_t k = args[0]->Int32Value();
+  if (k > hw->length) { k = hw->length; }
+  uint32_t *idx = (uint32_t *) malloc(k * sizeof(uint32_t));
+  uint32_t m = top_k(hw->vec, hw->length, k, largest, idx);
+
+  Handle<Object> values = NewInstance(m), indices = IntVec::NewInstance(m);
+  int32_t *vout = ObjectWrap::Unwrap<IntVec>(values)->vec;
+  int32_t *iout = ObjectWrap::Unwrap<IntVec>(indices)->data();
+  for (uint32_t j = 0; j < m; ++j) {
+    vout[j] = hw->vec[idx[j]];
+    iout[j] = idx[j];
+  }
+  free(idx);
+
+  Handle<Object> ret = Object::New();
+  ret->Set(String::NewSymbol("values"), values);
+  ret->Set(String::NewSymbol("indices"), indices);
+  return scope.Close(ret);
+}
+
+/*
+ * An IntVec of all the indices, reordered so that the k-th indexes the
+ * element that would be k-th in increasing order, with no greater ones
+ * before it and no smaller ones after.
+ */
+Handle<Value>
+IntVec::Argpartition(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsInt32() || args[0]->Int32Value() < 0) {
+    return ThrowException(Exception::TypeError(String::New("k must be a non-negative integer")));
+  }
+
+  Handle<Object> ret = IntVec::NewInstance(hw->length);
+  argpartition(hw->vec, hw->length, args[0]->Int32Value(),
+               (uint32_t *) ObjectWrap::Unwrap<IntVec>(ret)->data());
+  return scope.Close(ret);
+}
+
+/*
+ * Cumulative sum, min, max or product.  Options are {exclusive: true}
+ * to start each element from the identity rather than include it, and
+ * {inPlace: true} to overwrite this vector instead of returning a new one.
+ */
+Handle<Value>
+IntVec::Scan(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  int op = -1;
+  if (args.Length() >= 1 && args[0]->IsString()) {
+    String::Utf8Value name(args[0]);
+    op = scan_op(*name);
+  }
+  if (op < 0) {
+    return ThrowException(Exception::TypeError(String::New("Operation must be sum, min, max or product")));
+  }
+
+  bool exclusive = false, in_place = false;
+  if (args.Length() >= 2 && args[1]->IsObject()) {
+    Local<Object> opts = args[1]->ToObject();
+    exclusive = opts->Get(String::NewSymbol("exclusive"))->BooleanValue();
+    in_place = opts->Get(String::NewSymbol("inPlace"))->BooleanValue();
+  }
+
+  Handle<Object> ret = in_place ? args.This() : NewInstance(hw->length);
+  IntVec *out = ObjectWrap::Unwrap<IntVec>(ret);
+  out->willWrite();
+  scan_i32(hw->vec, out->vec, hw->length, op, exclusive);
+
+  return scope.Close(ret);
+}
+
+/*
+ * Differences between adjacent elements (the first is kept as is), which
+ * undoes an inclusive sum scan.  Takes the same inPlace option as scan.
+ */
+Handle<Value>
+IntVec::Diff(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  bool in_place = args.Length() >= 1 && args[0]->IsObject()
+    && args[0]->ToObject()->Get(String::NewSymbol("inPlace"))->BooleanValue();
+
+  Handle<Object> ret = in_place ? args.This() : NewInstance(hw->length);
+  IntVec *out = ObjectWrap::Unwrap<IntVec>(ret);
+  out->willWrite();
+  diff_i32(hw->vec, out->vec, hw->length);
+
+  return scope.Close(ret);
+}
+
+/*
+ * Gather: a new IntVec of this[indices[j]].  Indices out of range give
+ * zero, as they do for [].
+ */
+Handle<Value>
+IntVec::Take(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! IntVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Indices must be an IntVec")));
+  }
+  IntVec *iv = ObjectWrap::Unwrap<IntVec>(args[0]->ToObject());
+  const int32_t *idx = iv->data();
+  uint32_t n = iv->size();
+
+  Handle<Object> ret = NewInstance(n);
+  int32_t *out = ObjectWrap::Unwrap<IntVec>(ret)->vec;
+  for (uint32_t j = 0; j < n; ++j) {
+    uint32_t i = idx[j];
+    out[j] = i < hw->length ? hw->vec[i] : 0;
+  }
+
+  return scope.Close(ret);
+}
+
+/*
+ * Scatter: this[indices[j]] = values[j], where values is a IntVec of
+ * at least as many elements or a single number.  Extends as needed.
+ */
+Handle<Value>
+IntVec::Put(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 2 || ! IntVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Indices must be an IntVec")));
+  }
+  IntVec *iv = ObjectWrap::Unwrap<IntVec>(args[0]->ToObject());
+  const int32_t *idx = iv->data();
+  uint32_t n = iv->size();
+
+  IntVec *values = 0;
+  if (HasInstance(args[1])) {
+    values = ObjectWrap::Unwrap<IntVec>(args[1]->ToObject());
+    if (values->length < n) {
+      return ThrowException(Exception::TypeError(String::New("Not enough values")));
+    }
+  } else if (! args[1]->IsNumber()) {
+    return ThrowException(Exception::TypeError(String::New("Values must be a IntVec or a number")));
+  }
+
+  int32_t top = -1;
+  for (uint32_t j = 0; j < n; ++j) {
+    if (idx[j] < 0) {
+      return ThrowException(Exception::TypeError(String::New("Indices must be non-negative")));
+    }
+    if (idx[j] > top) { top = idx[j]; }
+  }
+  if (! hw->extend(top+1)) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->unshare();
+
+  if (values) {
+    // Copy first in case values is this vector.
+    int32_t *src = (int32_t *) malloc(n * sizeof(int32_t));
+    memcpy(src, values->vec, n * sizeof(int32_t));
+    for (uint32_t j = 0; j < n; ++j) {
+      dirty_mark(&hw->dirty, ELEM_I32, idx[j], idx[j]+1);
+      hw->vec[idx[j]] = src[j];
+    }
+    free(src);
+  } else {
+    int32_t v = args[1]->Int32Value();
+    for (uint32_t j = 0; j < n; ++j) {
+      dirty_mark(&hw->dirty, ELEM_I32, idx[j], idx[j]+1);
+      hw->vec[idx[j]] = v;
+    }
+  }
+
+  return scope.Close(args.This());
+}
+
+/*
+ * A new IntVec of the elements whose bit is set in a BitVec mask.
+ */
+Handle<Value>
+IntVec::Compress(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 1 || ! BitVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Mask must be a BitVec")));
+  }
+  BitVec *mask = ObjectWrap::Unwrap<BitVec>(args[0]->ToObject());
+  uint32_t n = hw->length < mask->size() ? hw->length : mask->size();
+
+  Handle<Object> ret = NewInstance(count_bits(mask->data(), n));
+  compress_u32((const uint32_t *) hw->vec, mask->data(), n,
+               (uint32_t *) ObjectWrap::Unwrap<IntVec>(ret)->vec);
+
+  return scope.Close(ret);
+}
+
+/*
+ * The inverse of compress: store consecutive elements of values at the
+ * positions whose bit is set in the mask, in place.
+ */
+Handle<Value>
+IntVec::Expand(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  if (args.Length() < 2 || ! BitVec::HasInstance(args[0]) || ! HasInstance(args[1])) {
+    return ThrowException(Exception::TypeError(String::New("Arguments must be a BitVec and a IntVec")));
+  }
+  BitVec *mask = ObjectWrap::Unwrap<BitVec>(args[0]->ToObject());
+  IntVec *values = ObjectWrap::Unwrap<IntVec>(args[1]->ToObject());
+  if (values == hw) {
+    return ThrowException(Exception::TypeError(String::New("Cannot expand a vector into itself")));
+  }
+
+  if (! hw->extend(mask->size())) {
+    return ThrowException(Exception::TypeError(String::New("Out of memory")));
+  }
+  hw->willWrite();
+  expand_u32((const uint32_t *) values->vec, values->length, mask->data(), mask->size(),
+             (uint32_t *) hw->vec);
+
+  return scope.Close(args.This());
+}
+
+// Optional BitVec mask argument of the reductions, which clips n to its
+// length.  Returns false if the argument is not a BitVec.
+static bool
+mask_arg(const Arguments& args, uint32_t *n, const uint32_t **mask)
+{
+  *mask = 0;
+  if (args.Length() < 1 || args[0]->IsUndefined()) { return true; }
+  if (! BitVec::HasInstance(args[0])) { return false; }
+
+  BitVec *bv = ObjectWrap::Unwrap<BitVec>(args[0]->ToObject());
+  if (bv->size() < *n) { *n = bv->size(); }
+  *mask = bv->data();
+  return true;
+}
+
+Handle<Value>
+IntVec::Sum(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t n = hw->length;
+  const uint32_t *mask;
+  if (! mask_arg(args, &n, &mask)) {
+    return ThrowException(Exception::TypeError(String::New("Mask must be a BitVec")));
+  }
+
+  return scope.Close(Number::New(sum_i32(hw->vec, n, mask)));
+}
+
+Handle<Value>
+IntVec::Min(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t n = hw->length;
+  const uint32_t *mask;
+  if (! mask_arg(args, &n, &mask)) {
+    return ThrowException(Exception::TypeError(String::New("Mask must be a BitVec")));
+  }
+
+  return scope.Close(Number::New(min_i32(hw->vec, n, mask)));
+}
+
+Handle<Value>
+IntVec::Max(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t n = hw->length;
+  const uint32_t *mask;
+  if (! mask_arg(args, &n, &mask)) {
+    return ThrowException(Exception::TypeError(String::New("Mask must be a BitVec")));
+  }
+
+  return scope.Close(Number::New(max_i32(hw->vec, n, mask)));
+}
+
+Handle<Value>
+IntVec::Count(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  uint32_t n = hw->length;
+  const uint32_t *mask;
+  if (! mask_arg(args, &n, &mask)) {
+    return ThrowException(Exception::TypeError(String::New("Mask must be a BitVec")));
+  }
+
+  return scope.Close(Integer::NewFromUnsigned(mask ? count_bits(mask, n) : n));
+}
+
+// Compare each element against a number or a IntVec, whose missing
+// elements compare as 0, into out.  Returns false for any other argument.
+static bool
+compare_into(IntVec *hw, Handle<Value> arg, int op, uint32_t *out)
+{
+  uint32_t n = hw->size();
+  if (arg->IsNumber()) {
+    cmp_i32(hw->data(), n, op, arg->NumberValue(), out);
+    return true;
+  }
+  if (! IntVec::HasInstance(arg)) { return false; }
+
+  IntVec *other = ObjectWrap::Unwrap<IntVec>(arg->ToObject());
+  if (other->size() >= n) {
+    cmp_i32_vec(hw->data(), other->data(), n, op, out);
+  } else {
+    int32_t *padded = (int32_t *) calloc(n, sizeof(int32_t));
+    memcpy(padded, other->data(), other->size() * sizeof(int32_t));
+    cmp_i32_vec(hw->data(), padded, n, op, out);
+    free(padded);
+  }
+  return true;
+}
+
+static Handle<Value>
+compare(const Arguments& args, int op)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  Handle<Object> ret = BitVec::NewInstance(hw->size());
+  if (args.Length() < 1 ||
+      ! compare_into(hw, args[0], op, ObjectWrap::Unwrap<BitVec>(ret)->data())) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a number or an IntVec")));
+  }
+
+  return scope.Close(ret);
+}
+
+Handle<Value> IntVec::Gt(const Arguments& args) { return compare(args, CMP_GT); }
+Handle<Value> IntVec::Ge(const Arguments& args) { return compare(args, CMP_GE); }
+Handle<Value> IntVec::Lt(const Arguments& args) { return compare(args, CMP_LT); }
+Handle<Value> IntVec::Le(const Arguments& args) { return compare(args, CMP_LE); }
+Handle<Value> IntVec::Eq(const Arguments& args) { return compare(args, CMP_EQ); }
+Handle<Value> IntVec::Ne(const Arguments& args) { return compare(args, CMP_NE); }
+
+/*
+ * A BitVec of the elements within [lo, hi], each bound a number or
+ * an IntVec.
+ */
+Handle<Value>
+IntVec::Between(const Arguments& args)
+{
+  HandleScope scope;
+  IntVec* hw = ObjectWrap::Unwrap<IntVec>(args.This());
+
+  Handle<Object> ret = BitVec::NewInstance(hw->length);
+  uint32_t *out = ObjectWrap::Unwrap<BitVec>(ret)->data();
+  uint32_t words = (hw->length + 31) / 32;
+  uint32_t *upper = (uint32_t *) malloc((words ? words : 1) * sizeof(uint32_t));
+
+  bool ok = args.Length() >= 2 &&
+    compare_into(hw, args[0], CMP_GE, out) &&
+    compare_into(hw, args[1], CMP_LE, upper);
+  if (ok) {
+    for (uint32_t i = 0; i < words; ++i) { out[i] &= upper[i]; }
+  }
+  free(upper);
+
+  if (! ok) {
+    return ThrowException(Exception::TypeError(String::New("Bounds must be numbers or IntVecs")));
+  }
+  return scope.Close(ret);
+}
+
+void
+IntVec::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("IntVec"));
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toString", ToString);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "clone", Clone);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "copyFrom", CopyFrom);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "fill", Fill);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "set", Set);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toArray", ToArray);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toTypedArray", ToTypedArray);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "dirtyRanges", DirtyRanges);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "clearDirty", ClearDirty);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "serializeDelta", SerializeDelta);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "applyDelta", ApplyDelta);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "hash", Hash);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "equals", Equals);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "share", Share);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "atomicSet", AtomicSet);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "atomicAdd", AtomicAdd);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "compareExchange", CompareExchange);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "forEach", ForEach);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "map", Map);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "reduce", Reduce);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "mapInto", MapInto);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "transform", Transform);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "forEachChunk", ForEachChunk);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "mapChunk", MapChunk);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "reduceChunk", ReduceChunk);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "histogram", Histogram);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "quantiles", Quantiles);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "topK", TopK);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "argpartition", Argpartition);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "scan", Scan);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "diff", Diff);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "take", Take);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "put", Put);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "compress", Compress);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "expand", Expand);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "sum", Sum);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "min", Min);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "max", Max);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "count", Count);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "gt", Gt);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "ge", Ge);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "lt", Lt);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "le", Le);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "eq", Eq);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "ne", Ne);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "between", Between);
 
   s_ct->InstanceTemplate()->SetIndexedPropertyHandler(IndexGet, IndexSet);
 
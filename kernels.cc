@@ -0,0 +1,1816 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <float.h>
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+// Some GCC releases warn about the placeholder _mm*_undefined_*() values
+// inside their own AVX-512 intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+
+// Kernels for instruction sets beyond the build's baseline are compiled
+// for them a function at a time, and only bound once simd_bind() has
+// checked the CPU.
+#define SIMD_X86 1
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#include "kernels.h"
+#include "parallel.h"
+
+// The kernels with a version per SIMD level, bound by simd_bind().
+struct SimdKernels {
+  int64_t (*dot_i8)(const int8_t *a, const int8_t *b, uint32_t n);
+  uint32_t (*count_bits)(const uint32_t *mask, uint32_t n);
+  uint32_t (*compress_u32)(const uint32_t *src, const uint32_t *mask, uint32_t n, uint32_t *dst);
+  uint32_t (*expand_u32)(const uint32_t *values, uint32_t nvalues, const uint32_t *mask, uint32_t n, uint32_t *dst);
+  // Unmasked reductions, to the identity when empty.
+  int64_t (*sum_i32)(const int32_t *src, uint32_t n);
+  double (*sum_f32)(const float *src, uint32_t n);
+  double (*min_i32)(const int32_t *src, uint32_t n);
+  double (*min_f32)(const float *src, uint32_t n);
+  double (*max_i32)(const int32_t *src, uint32_t n);
+  double (*max_f32)(const float *src, uint32_t n);
+  // Compare a against b[i], or against t everywhere when b is null.
+  void (*cmp_i32)(const int32_t *a, const int32_t *b, int32_t t, uint32_t n, int op, uint32_t *out);
+  void (*cmp_f32)(const float *a, const float *b, float t, uint32_t n, int op, uint32_t *out);
+};
+static SimdKernels kern;
+
+// Below this many elements a scan isn't worth splitting across threads.
+#define PARALLEL_SCAN_MIN (1 << 22)
+
+#if defined(__SSE2__)
+
+// Sign-extend the low/high 8 bytes of an int8 register to int16.
+static inline __m128i lo_i16(__m128i v) {
+  return _mm_unpacklo_epi8(v, _mm_cmpgt_epi8(_mm_setzero_si128(), v));
+}
+static inline __m128i hi_i16(__m128i v) {
+  return _mm_unpackhi_epi8(v, _mm_cmpgt_epi8(_mm_setzero_si128(), v));
+}
+
+static inline int64_t hsum_i32(__m128i v) {
+  int32_t t[4];
+  _mm_storeu_si128((__m128i *) t, v);
+  return (int64_t) t[0] + t[1] + t[2] + t[3];
+}
+
+#endif
+
+// Each 16-byte step adds at most 4*128*128 to a 32-bit lane (and wider
+// steps no more), so flush the lanes to 64 bits well before they can
+// overflow.
+#define I8_FLUSH (1 << 16)
+
+static int64_t
+dot_i8_base(const int8_t *a, const int8_t *b, uint32_t n)
+{
+  int64_t sum = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  while (n - i >= 16) {
+    uint32_t end = i + ((n - i) & ~15u);
+    if (end - i > I8_FLUSH) { end = i + I8_FLUSH; }
+    __m128i acc = _mm_setzero_si128();
+    for (; i < end; i += 16) {
+      __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+      __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(lo_i16(va), lo_i16(vb)));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(hi_i16(va), hi_i16(vb)));
+    }
+    sum += hsum_i32(acc);
+  }
+#endif
+  for (; i < n; ++i) { sum += (int32_t) a[i] * b[i]; }
+  return sum;
+}
+
+#if defined(SIMD_X86)
+
+TARGET("avx2") static int64_t
+dot_i8_avx2(const int8_t *a, const int8_t *b, uint32_t n)
+{
+  int64_t sum = 0;
+  uint32_t i = 0;
+  while (n - i >= 32) {
+    uint32_t end = i + ((n - i) & ~31u);
+    if (end - i > I8_FLUSH) { end = i + I8_FLUSH; }
+    __m256i acc = _mm256_setzero_si256();
+    for (; i < end; i += 32) {
+      __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+      __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(va)),
+                                                    _mm256_cvtepi8_epi16(_mm256_castsi256_si128(vb))));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(va, 1)),
+                                                    _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vb, 1))));
+    }
+    int32_t t[8];
+    _mm256_storeu_si256((__m256i *) t, acc);
+    for (uint32_t j = 0; j < 8; ++j) { sum += t[j]; }
+  }
+  return sum + dot_i8_base(a + i, b + i, n - i);
+}
+
+TARGET("avx512f,avx512bw") static int64_t
+dot_i8_avx512(const int8_t *a, const int8_t *b, uint32_t n)
+{
+  int64_t sum = 0;
+  uint32_t i = 0;
+  while (n - i >= 64) {
+    uint32_t end = i + ((n - i) & ~63u);
+    if (end - i > I8_FLUSH) { end = i + I8_FLUSH; }
+    __m512i acc = _mm512_setzero_si512();
+    for (; i < end; i += 64) {
+      __m512i va = _mm512_loadu_si512(a + i), vb = _mm512_loadu_si512(b + i);
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_cvtepi8_epi16(_mm512_castsi512_si256(va)),
+                                                    _mm512_cvtepi8_epi16(_mm512_castsi512_si256(vb))));
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(va, 1)),
+                                                    _mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(vb, 1))));
+    }
+    int32_t t[16];
+    _mm512_storeu_si512(t, acc);
+    for (uint32_t j = 0; j < 16; ++j) { sum += t[j]; }
+  }
+  return sum + dot_i8_base(a + i, b + i, n - i);
+}
+
+#endif
+
+int64_t
+dot_i8(const int8_t *a, const int8_t *b, uint32_t n)
+{
+  return kern.dot_i8(a, b, n);
+}
+
+int64_t
+sum_i8(const int8_t *a, uint32_t n)
+{
+  int64_t sum = 0;
+  for (uint32_t i = 0; i < n; ++i) { sum += a[i]; }
+  return sum;
+}
+
+int64_t
+sumsq_i8(const int8_t *a, uint32_t n)
+{
+  return dot_i8(a, a, n);
+}
+
+/*
+ * Scan operations.  Integer arithmetic wraps like the JS |0 idiom rather
+ * than overflowing into undefined behaviour.
+ */
+template <class T> struct SumOp {
+  static T identity() { return 0; }
+  static T apply(T a, T b) { return a + b; }
+};
+template <> struct SumOp<int32_t> {
+  static int32_t identity() { return 0; }
+  static int32_t apply(int32_t a, int32_t b) { return (int32_t) ((uint32_t) a + (uint32_t) b); }
+};
+template <class T> struct ProductOp {
+  static T identity() { return 1; }
+  static T apply(T a, T b) { return a * b; }
+};
+template <> struct ProductOp<int32_t> {
+  static int32_t identity() { return 1; }
+  static int32_t apply(int32_t a, int32_t b) { return (int32_t) ((uint32_t) a * (uint32_t) b); }
+};
+template <class T> struct MinOp {
+  static T identity() {
+    return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+  }
+  static T apply(T a, T b) { return b < a ? b : a; }
+};
+template <class T> struct MaxOp {
+  static T identity() {
+    return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::min();
+  }
+  static T apply(T a, T b) { return b > a ? b : a; }
+};
+
+template <class T, class Op>
+static T scan_serial(const T *src, T *dst, uint32_t n, T carry, bool exclusive)
+{
+  if (exclusive) {
+    for (uint32_t i = 0; i < n; ++i) {
+      T x = src[i];
+      dst[i] = carry;
+      carry = Op::apply(carry, x);
+    }
+  } else {
+    for (uint32_t i = 0; i < n; ++i) {
+      carry = Op::apply(carry, src[i]);
+      dst[i] = carry;
+    }
+  }
+  return carry;
+}
+
+template <class T, class Op>
+struct Scanner {
+  // Scan n elements starting from carry; returns the final carry.
+  static T scan(const T *src, T *dst, uint32_t n, T carry, bool exclusive) {
+    return scan_serial<T, Op>(src, dst, n, carry, exclusive);
+  }
+
+  static T reduce(const T *src, uint32_t n) {
+    T a0 = Op::identity(), a1 = a0, a2 = a0, a3 = a0;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      a0 = Op::apply(a0, src[i]);
+      a1 = Op::apply(a1, src[i+1]);
+      a2 = Op::apply(a2, src[i+2]);
+      a3 = Op::apply(a3, src[i+3]);
+    }
+    for (; i < n; ++i) { a0 = Op::apply(a0, src[i]); }
+    return Op::apply(Op::apply(a0, a1), Op::apply(a2, a3));
+  }
+};
+
+#if defined(__SSE2__)
+
+/*
+ * In-register scans: two shift-and-combine steps give the prefix of four
+ * lanes, the carry from the previous block is combined in, and lane 3 of
+ * the result becomes the next carry.  Lanes shifted in are filled with
+ * the identity so that min and max work as well as sum.
+ */
+static inline __m128 vop(SumOp<float>, __m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 vop(MinOp<float>, __m128 a, __m128 b) { return _mm_min_ps(a, b); }
+static inline __m128 vop(MaxOp<float>, __m128 a, __m128 b) { return _mm_max_ps(a, b); }
+
+static inline __m128 shl_ps(__m128 x, __m128 fill, int lanes) {
+  __m128i v = _mm_castps_si128(x);
+  v = lanes == 1 ? _mm_slli_si128(v, 4) : _mm_slli_si128(v, 8);
+  return _mm_or_ps(_mm_castsi128_ps(v), fill);
+}
+
+template <class Op>
+static float scan_ps(const float *src, float *dst, uint32_t n, float carry, bool exclusive)
+{
+  float id = Op::identity();
+  __m128 fill1 = _mm_setr_ps(id, 0, 0, 0), fill2 = _mm_setr_ps(id, id, 0, 0);
+  __m128 c = _mm_set1_ps(carry);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_loadu_ps(src + i);
+    __m128 t = vop(Op(), x, shl_ps(x, fill1, 1));
+    t = vop(Op(), t, shl_ps(t, fill2, 2));
+    __m128 incl = vop(Op(), c, t);
+    _mm_storeu_ps(dst + i, exclusive ? vop(Op(), c, shl_ps(t, fill1, 1)) : incl);
+    c = _mm_shuffle_ps(incl, incl, _MM_SHUFFLE(3,3,3,3));
+  }
+  _mm_store_ss(&carry, c);
+  return scan_serial<float, Op>(src + i, dst + i, n - i, carry, exclusive);
+}
+
+template <> float Scanner<float, SumOp<float> >::scan(const float *src, float *dst, uint32_t n, float carry, bool exclusive) {
+  return scan_ps<SumOp<float> >(src, dst, n, carry, exclusive);
+}
+template <> float Scanner<float, MinOp<float> >::scan(const float *src, float *dst, uint32_t n, float carry, bool exclusive) {
+  return scan_ps<MinOp<float> >(src, dst, n, carry, exclusive);
+}
+template <> float Scanner<float, MaxOp<float> >::scan(const float *src, float *dst, uint32_t n, float carry, bool exclusive) {
+  return scan_ps<MaxOp<float> >(src, dst, n, carry, exclusive);
+}
+
+template <> int32_t Scanner<int32_t, SumOp<int32_t> >::scan(const int32_t *src, int32_t *dst, uint32_t n, int32_t carry, bool exclusive) {
+  __m128i c = _mm_set1_epi32(carry);
+  uint32_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+    __m128i t = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    t = _mm_add_epi32(t, _mm_slli_si128(t, 8));
+    __m128i incl = _mm_add_epi32(c, t);
+    _mm_storeu_si128((__m128i *) (dst + i), exclusive ? _mm_add_epi32(c, _mm_slli_si128(t, 4)) : incl);
+    c = _mm_shuffle_epi32(incl, _MM_SHUFFLE(3,3,3,3));
+  }
+  carry = _mm_cvtsi128_si32(c);
+  return scan_serial<int32_t, SumOp<int32_t> >(src + i, dst + i, n - i, carry, exclusive);
+}
+
+#endif
+
+template <class T>
+struct scan_ctx {
+  const T *src;
+  T *dst;
+  bool exclusive;
+  T *carries;
+};
+
+template <class T, class Op>
+static void scan_totals(void *ctx, uint32_t part, uint32_t start, uint32_t end)
+{
+  scan_ctx<T> *c = (scan_ctx<T> *) ctx;
+  c->carries[part] = Scanner<T, Op>::reduce(c->src + start, end - start);
+}
+
+template <class T, class Op>
+static void scan_slice(void *ctx, uint32_t part, uint32_t start, uint32_t end)
+{
+  scan_ctx<T> *c = (scan_ctx<T> *) ctx;
+  Scanner<T, Op>::scan(c->src + start, c->dst + start, end - start, c->carries[part], c->exclusive);
+}
+
+template <class T, class Op>
+static void scan(const T *src, T *dst, uint32_t n, bool exclusive)
+{
+  uint32_t parts = parallel_threads();
+  if (n < PARALLEL_SCAN_MIN || parts < 2) {
+    Scanner<T, Op>::scan(src, dst, n, Op::identity(), exclusive);
+    return;
+  }
+
+  // Pass one leaves each slice's total in carries[part], which is then
+  // turned into an exclusive scan of the totals for pass two.
+  T carries[64];
+  scan_ctx<T> ctx = { src, dst, exclusive, carries };
+  parallel_for(n, parts, scan_totals<T, Op>, &ctx);
+  T carry = Op::identity();
+  for (uint32_t p = 0; p < parts && p < 64; ++p) {
+    T total = carries[p];
+    carries[p] = carry;
+    carry = Op::apply(carry, total);
+  }
+  parallel_for(n, parts, scan_slice<T, Op>, &ctx);
+}
+
+int
+scan_op(const char *name)
+{
+  if (strcmp(name, "sum") == 0) { return SCAN_SUM; }
+  if (strcmp(name, "min") == 0) { return SCAN_MIN; }
+  if (strcmp(name, "max") == 0) { return SCAN_MAX; }
+  if (strcmp(name, "product") == 0) { return SCAN_PRODUCT; }
+  return -1;
+}
+
+void
+scan_i32(const int32_t *src, int32_t *dst, uint32_t n, int op, bool exclusive)
+{
+  switch (op) {
+  case SCAN_SUM: scan<int32_t, SumOp<int32_t> >(src, dst, n, exclusive); break;
+  case SCAN_MIN: scan<int32_t, MinOp<int32_t> >(src, dst, n, exclusive); break;
+  case SCAN_MAX: scan<int32_t, MaxOp<int32_t> >(src, dst, n, exclusive); break;
+  case SCAN_PRODUCT: scan<int32_t, ProductOp<int32_t> >(src, dst, n, exclusive); break;
+  }
+}
+
+void
+scan_f32(const float *src, float *dst, uint32_t n, int op, bool exclusive)
+{
+  switch (op) {
+  case SCAN_SUM: scan<float, SumOp<float> >(src, dst, n, exclusive); break;
+  case SCAN_MIN: scan<float, MinOp<float> >(src, dst, n, exclusive); break;
+  case SCAN_MAX: scan<float, MaxOp<float> >(src, dst, n, exclusive); break;
+  case SCAN_PRODUCT: scan<float, ProductOp<float> >(src, dst, n, exclusive); break;
+  }
+}
+
+void
+diff_i32(const int32_t *src, int32_t *dst, uint32_t n)
+{
+  int32_t prev = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    int32_t x = src[i];
+    dst[i] = (int32_t) ((uint32_t) x - (uint32_t) prev);
+    prev = x;
+  }
+}
+
+void
+diff_f32(const float *src, float *dst, uint32_t n)
+{
+  float prev = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    float x = src[i];
+    dst[i] = x - prev;
+    prev = x;
+  }
+}
+
+/*
+ * Mask words are walked 32 elements at a time: empty words are skipped,
+ * full words are copied or reduced densely, and mixed words visit just
+ * their set bits.
+ */
+static inline uint32_t
+word_bits(const uint32_t *mask, uint32_t w, uint32_t n)
+{
+  uint32_t bits = mask[w];
+  uint32_t rest = n - w*32;
+  return rest >= 32 ? bits : bits & ((1u << rest) - 1);
+}
+
+static uint32_t
+count_bits_base(const uint32_t *mask, uint32_t n)
+{
+  uint32_t count = 0, words = (n+31)/32;
+  for (uint32_t w = 0; w < words; ++w) {
+    count += __builtin_popcount(word_bits(mask, w, n));
+  }
+  return count;
+}
+
+static uint32_t
+compress_u32_base(const uint32_t *src, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  uint32_t k = 0, words = (n+31)/32;
+  for (uint32_t w = 0; w < words; ++w) {
+    uint32_t bits = word_bits(mask, w, n);
+    const uint32_t *s = src + w*32;
+    if (bits == 0) {
+      continue;
+    } else if (bits == 0xffffffffu) {
+      memcpy(dst + k, s, 32 * sizeof(uint32_t));
+      k += 32;
+      continue;
+    }
+    while (bits) {
+      dst[k++] = s[__builtin_ctz(bits)];
+      bits &= bits - 1;
+    }
+  }
+  return k;
+}
+
+static uint32_t
+expand_u32_base(const uint32_t *values, uint32_t nvalues, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  uint32_t k = 0, words = (n+31)/32;
+  for (uint32_t w = 0; w < words && k < nvalues; ++w) {
+    uint32_t bits = word_bits(mask, w, n);
+    uint32_t *d = dst + w*32;
+    if (bits == 0xffffffffu && k + 32 <= nvalues) {
+      memcpy(d, values + k, 32 * sizeof(uint32_t));
+      k += 32;
+      continue;
+    }
+    while (bits && k < nvalues) {
+      d[__builtin_ctz(bits)] = values[k++];
+      bits &= bits - 1;
+    }
+  }
+  return k;
+}
+
+#if defined(SIMD_X86)
+
+TARGET("popcnt") static uint32_t
+count_bits_popcnt(const uint32_t *mask, uint32_t n)
+{
+  uint32_t count = 0, words = (n+31)/32, w = 0;
+  for (; w + 2 <= n/32; w += 2) {
+    uint64_t pair;
+    memcpy(&pair, mask + w, sizeof(pair));
+    count += __builtin_popcountll(pair);
+  }
+  for (; w < words; ++w) { count += __builtin_popcount(word_bits(mask, w, n)); }
+  return count;
+}
+
+// Counts 8 words at a time by looking up each nibble with a byte shuffle.
+TARGET("avx2,popcnt") static uint32_t
+count_bits_avx2(const uint32_t *mask, uint32_t n)
+{
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  uint32_t w = 0;
+  for (; w + 8 <= n/32; w += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (mask + w));
+    __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+                                _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+  }
+  uint64_t t[4];
+  _mm256_storeu_si256((__m256i *) t, acc);
+  return t[0] + t[1] + t[2] + t[3] + count_bits_popcnt(mask + w, n - 32*w);
+}
+
+TARGET("avx512f,avx512vpopcntdq,popcnt") static uint32_t
+count_bits_avx512(const uint32_t *mask, uint32_t n)
+{
+  __m512i acc = _mm512_setzero_si512();
+  uint32_t w = 0;
+  for (; w + 16 <= n/32; w += 16) {
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(mask + w)));
+  }
+  uint64_t t[8], count = 0;
+  _mm512_storeu_si512(t, acc);
+  for (uint32_t j = 0; j < 8; ++j) { count += t[j]; }
+  return count + count_bits_popcnt(mask + w, n - 32*w);
+}
+
+// For each 8-bit mask, the lane indices of its set bits packed to the front.
+static uint32_t compress_lut[256][8];
+
+static void
+init_compress_lut()
+{
+  for (uint32_t m = 0; m < 256; ++m) {
+    uint32_t k = 0;
+    for (uint32_t b = 0; b < 8; ++b) {
+      if (m & (1u << b)) { compress_lut[m][k++] = b; }
+    }
+    while (k < 8) { compress_lut[m][k++] = 0; }
+  }
+}
+
+TARGET("avx2,popcnt") static uint32_t
+compress_u32_avx2(const uint32_t *src, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  uint32_t k = 0, words = (n+31)/32;
+  uint32_t total = count_bits(mask, n);
+  for (uint32_t w = 0; w < words; ++w) {
+    uint32_t bits = word_bits(mask, w, n);
+    const uint32_t *s = src + w*32;
+    if (bits == 0) {
+      continue;
+    } else if (bits == 0xffffffffu) {
+      memcpy(dst + k, s, 32 * sizeof(uint32_t));
+      k += 32;
+      continue;
+    }
+    // Each byte of the mask selects up to 8 lanes with one permute.  The
+    // full 8-lane store may run past the output, so stop short of the end.
+    if (k + 32 + 8 <= total) {
+      for (uint32_t b = 0; b < 4; ++b) {
+        uint32_t m = (bits >> (8*b)) & 0xff;
+        __m256i v = _mm256_loadu_si256((const __m256i *) (s + 8*b));
+        __m256i idx = _mm256_loadu_si256((const __m256i *) compress_lut[m]);
+        _mm256_storeu_si256((__m256i *) (dst + k), _mm256_permutevar8x32_epi32(v, idx));
+        k += __builtin_popcount(m);
+      }
+      continue;
+    }
+    while (bits) {
+      dst[k++] = s[__builtin_ctz(bits)];
+      bits &= bits - 1;
+    }
+  }
+  return k;
+}
+
+// Masked loads and compressing stores touch only the selected lanes, so
+// need no care at the ends.
+TARGET("avx512f,popcnt") static uint32_t
+compress_u32_avx512(const uint32_t *src, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  uint32_t k = 0, words = (n+31)/32;
+  for (uint32_t w = 0; w < words; ++w) {
+    uint32_t bits = word_bits(mask, w, n);
+    const uint32_t *s = src + w*32;
+    if (bits == 0xffffffffu) {
+      memcpy(dst + k, s, 32 * sizeof(uint32_t));
+      k += 32;
+      continue;
+    }
+    for (uint32_t h = 0; h < 32 && (bits >> h); h += 16) {
+      __mmask16 m = (__mmask16) (bits >> h);
+      _mm512_mask_compressstoreu_epi32(dst + k, m, _mm512_maskz_loadu_epi32(m, s + h));
+      k += __builtin_popcount(m);
+    }
+  }
+  return k;
+}
+
+TARGET("avx512f,popcnt") static uint32_t
+expand_u32_avx512(const uint32_t *values, uint32_t nvalues, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  uint32_t k = 0, words = (n+31)/32;
+  for (uint32_t w = 0; w < words && k < nvalues; ++w) {
+    uint32_t bits = word_bits(mask, w, n);
+    uint32_t *d = dst + w*32;
+    if (k + __builtin_popcount(bits) > nvalues) {
+      // The last values run out within this word.
+      while (bits && k < nvalues) {
+        d[__builtin_ctz(bits)] = values[k++];
+        bits &= bits - 1;
+      }
+      break;
+    }
+    for (uint32_t h = 0; h < 32 && (bits >> h); h += 16) {
+      __mmask16 m = (__mmask16) (bits >> h);
+      _mm512_mask_storeu_epi32(d + h, m, _mm512_maskz_expandloadu_epi32(m, values + k));
+      k += __builtin_popcount(m);
+    }
+  }
+  return k;
+}
+
+#endif
+
+uint32_t
+count_bits(const uint32_t *mask, uint32_t n)
+{
+  return kern.count_bits(mask, n);
+}
+
+uint32_t
+compress_u32(const uint32_t *src, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  return kern.compress_u32(src, mask, n, dst);
+}
+
+uint32_t
+expand_u32(const uint32_t *values, uint32_t nvalues, const uint32_t *mask, uint32_t n, uint32_t *dst)
+{
+  return kern.expand_u32(values, nvalues, mask, n, dst);
+}
+
+template <class T, class Op, class Acc>
+static Acc
+reduce_base(const T *src, uint32_t n)
+{
+  Acc acc = Op::identity();
+  for (uint32_t i = 0; i < n; ++i) { acc = Op::apply(acc, (Acc) src[i]); }
+  return acc;
+}
+
+// Runs of full mask words, like unmasked vectors, go to the dense
+// reduction bound for the SIMD level.
+template <class T, class Op, class Acc>
+static Acc
+masked_reduce(const T *src, uint32_t n, const uint32_t *mask, Acc (*dense)(const T *, uint32_t))
+{
+  if (! mask) { return dense(src, n); }
+
+  Acc acc = Op::identity();
+  uint32_t words = (n+31)/32;
+  for (uint32_t w = 0; w < words; ++w) {
+    uint32_t bits = word_bits(mask, w, n);
+    const T *s = src + w*32;
+    if (bits == 0xffffffffu) {
+      uint32_t run = 1;
+      while (w + run < words && word_bits(mask, w + run, n) == 0xffffffffu) { ++run; }
+      acc = Op::apply(acc, dense(s, 32 * run));
+      w += run - 1;
+    } else {
+      while (bits) {
+        acc = Op::apply(acc, (Acc) s[__builtin_ctz(bits)]);
+        bits &= bits - 1;
+      }
+    }
+  }
+  return acc;
+}
+
+#if defined(SIMD_X86)
+
+// Integer sums widen each lane to 64 bits, so stay exact.
+TARGET("avx2") static int64_t
+sum_i32_avx2(const int32_t *src, uint32_t n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  int64_t t[4];
+  _mm256_storeu_si256((__m256i *) t, acc);
+  return t[0] + t[1] + t[2] + t[3] + reduce_base<int32_t, SumOp<int64_t>, int64_t>(src + i, n - i);
+}
+
+TARGET("avx512f") static int64_t
+sum_i32_avx512(const int32_t *src, uint32_t n)
+{
+  __m512i acc = _mm512_setzero_si512();
+  uint32_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i v = _mm512_loadu_si512(src + i);
+    acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+    acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+  }
+  int64_t t[8], sum = 0;
+  _mm512_storeu_si512(t, acc);
+  for (uint32_t j = 0; j < 8; ++j) { sum += t[j]; }
+  return sum + reduce_base<int32_t, SumOp<int64_t>, int64_t>(src + i, n - i);
+}
+
+// Float sums are still in double, but spread over lanes, so reassociated.
+TARGET("avx2") static double
+sum_f32_avx2(const float *src, uint32_t n)
+{
+  __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+  uint32_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    a0 = _mm256_add_pd(a0, _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+    a1 = _mm256_add_pd(a1, _mm256_cvtps_pd(_mm_loadu_ps(src + i + 4)));
+  }
+  double t[4];
+  _mm256_storeu_pd(t, _mm256_add_pd(a0, a1));
+  return (t[0] + t[1]) + (t[2] + t[3]) + reduce_base<float, SumOp<double>, double>(src + i, n - i);
+}
+
+TARGET("avx512f") static double
+sum_f32_avx512(const float *src, uint32_t n)
+{
+  __m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+  uint32_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    a0 = _mm512_add_pd(a0, _mm512_cvtps_pd(_mm256_loadu_ps(src + i)));
+    a1 = _mm512_add_pd(a1, _mm512_cvtps_pd(_mm256_loadu_ps(src + i + 8)));
+  }
+  double t[8], sum = 0;
+  _mm512_storeu_pd(t, _mm512_add_pd(a0, a1));
+  for (uint32_t j = 0; j < 8; ++j) { sum += t[j]; }
+  return sum + reduce_base<float, SumOp<double>, double>(src + i, n - i);
+}
+
+/*
+ * Min and max keep one candidate per lane.  The new element goes first,
+ * as the min/max instructions return their second operand when either
+ * is NaN, so NaNs are skipped just as MinOp and MaxOp skip them.
+ */
+#define MINMAX_LANES(name, isa, T, V, W, load, set1, store, vop, Op) \
+  TARGET(isa) static double \
+  name(const T *src, uint32_t n) \
+  { \
+    V acc = set1(Op<T>::identity()); \
+    uint32_t i = 0; \
+    for (; i + W <= n; i += W) { acc = vop(load(src + i), acc); } \
+    double tail = reduce_base<T, Op<double>, double>(src + i, n - i); \
+    /* The lanes hold T's identity, not the double's, until loaded. */ \
+    if (i == 0) { return tail; } \
+    T lanes[W]; \
+    store(lanes, acc); \
+    return Op<double>::apply(reduce_base<T, Op<double>, double>(lanes, W), tail); \
+  }
+
+TARGET("sse4.2") static inline __m128i load4_i32(const int32_t *p) { return _mm_loadu_si128((const __m128i *) p); }
+TARGET("sse4.2") static inline void store4_i32(int32_t *p, __m128i v) { _mm_storeu_si128((__m128i *) p, v); }
+TARGET("avx2") static inline __m256i load8_i32(const int32_t *p) { return _mm256_loadu_si256((const __m256i *) p); }
+TARGET("avx2") static inline void store8_i32(int32_t *p, __m256i v) { _mm256_storeu_si256((__m256i *) p, v); }
+
+MINMAX_LANES(min_i32_sse4, "sse4.2", int32_t, __m128i, 4, load4_i32, _mm_set1_epi32, store4_i32, _mm_min_epi32, MinOp)
+MINMAX_LANES(max_i32_sse4, "sse4.2", int32_t, __m128i, 4, load4_i32, _mm_set1_epi32, store4_i32, _mm_max_epi32, MaxOp)
+MINMAX_LANES(min_f32_sse4, "sse4.2", float, __m128, 4, _mm_loadu_ps, _mm_set1_ps, _mm_storeu_ps, _mm_min_ps, MinOp)
+MINMAX_LANES(max_f32_sse4, "sse4.2", float, __m128, 4, _mm_loadu_ps, _mm_set1_ps, _mm_storeu_ps, _mm_max_ps, MaxOp)
+MINMAX_LANES(min_i32_avx2, "avx2", int32_t, __m256i, 8, load8_i32, _mm256_set1_epi32, store8_i32, _mm256_min_epi32, MinOp)
+MINMAX_LANES(max_i32_avx2, "avx2", int32_t, __m256i, 8, load8_i32, _mm256_set1_epi32, store8_i32, _mm256_max_epi32, MaxOp)
+MINMAX_LANES(min_f32_avx2, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_set1_ps, _mm256_storeu_ps, _mm256_min_ps, MinOp)
+MINMAX_LANES(max_f32_avx2, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_set1_ps, _mm256_storeu_ps, _mm256_max_ps, MaxOp)
+MINMAX_LANES(min_i32_avx512, "avx512f", int32_t, __m512i, 16, _mm512_loadu_si512, _mm512_set1_epi32, _mm512_storeu_si512, _mm512_min_epi32, MinOp)
+MINMAX_LANES(max_i32_avx512, "avx512f", int32_t, __m512i, 16, _mm512_loadu_si512, _mm512_set1_epi32, _mm512_storeu_si512, _mm512_max_epi32, MaxOp)
+MINMAX_LANES(min_f32_avx512, "avx512f", float, __m512, 16, _mm512_loadu_ps, _mm512_set1_ps, _mm512_storeu_ps, _mm512_min_ps, MinOp)
+MINMAX_LANES(max_f32_avx512, "avx512f", float, __m512, 16, _mm512_loadu_ps, _mm512_set1_ps, _mm512_storeu_ps, _mm512_max_ps, MaxOp)
+
+#endif
+
+double
+sum_i32(const int32_t *src, uint32_t n, const uint32_t *mask)
+{
+  // 64-bit integer accumulation is exact for any IntVec.
+  return (double) masked_reduce<int32_t, SumOp<int64_t>, int64_t>(src, n, mask, kern.sum_i32);
+}
+
+double
+sum_f32(const float *src, uint32_t n, const uint32_t *mask)
+{
+  return masked_reduce<float, SumOp<double>, double>(src, n, mask, kern.sum_f32);
+}
+
+double
+min_i32(const int32_t *src, uint32_t n, const uint32_t *mask)
+{
+  return masked_reduce<int32_t, MinOp<double>, double>(src, n, mask, kern.min_i32);
+}
+
+double
+min_f32(const float *src, uint32_t n, const uint32_t *mask)
+{
+  return masked_reduce<float, MinOp<double>, double>(src, n, mask, kern.min_f32);
+}
+
+double
+max_i32(const int32_t *src, uint32_t n, const uint32_t *mask)
+{
+  return masked_reduce<int32_t, MaxOp<double>, double>(src, n, mask, kern.max_i32);
+}
+
+double
+max_f32(const float *src, uint32_t n, const uint32_t *mask)
+{
+  return masked_reduce<float, MaxOp<double>, double>(src, n, mask, kern.max_f32);
+}
+
+/*
+ * Comparison predicates, each with a scalar test and (under SSE2) a
+ * four-lane test whose sign bits are gathered with movemask.
+ */
+#if defined(__SSE2__)
+
+template <class T> struct Simd;
+template <> struct Simd<int32_t> {
+  typedef __m128i V;
+  static V load(const int32_t *p) { return _mm_loadu_si128((const __m128i *) p); }
+  static V set1(int32_t t) { return _mm_set1_epi32(t); }
+  static uint32_t movemask(V m) { return _mm_movemask_ps(_mm_castsi128_ps(m)); }
+};
+template <> struct Simd<float> {
+  typedef __m128 V;
+  static V load(const float *p) { return _mm_loadu_ps(p); }
+  static V set1(float t) { return _mm_set1_ps(t); }
+  static uint32_t movemask(V m) { return _mm_movemask_ps(m); }
+};
+
+static inline __m128i vnot(__m128i m) { return _mm_xor_si128(m, _mm_set1_epi32(-1)); }
+
+#define SIMD_PRED(name, iexpr, fexpr) \
+  static inline __m128i name(__m128i x, __m128i t) { return iexpr; } \
+  static inline __m128 name(__m128 x, __m128 t) { return fexpr; }
+
+SIMD_PRED(vgt, _mm_cmpgt_epi32(x, t), _mm_cmpgt_ps(x, t))
+SIMD_PRED(vge, vnot(_mm_cmplt_epi32(x, t)), _mm_cmpge_ps(x, t))
+SIMD_PRED(vlt, _mm_cmplt_epi32(x, t), _mm_cmplt_ps(x, t))
+SIMD_PRED(vle, vnot(_mm_cmpgt_epi32(x, t)), _mm_cmple_ps(x, t))
+SIMD_PRED(veq, _mm_cmpeq_epi32(x, t), _mm_cmpeq_ps(x, t))
+SIMD_PRED(vne, vnot(_mm_cmpeq_epi32(x, t)), _mm_cmpneq_ps(x, t))
+
+#define PRED(name, op, vop) \
+  struct name { \
+    template <class T> static bool s(T x, T t) { return x op t; } \
+    template <class V> static V v(V x, V t) { return vop(x, t); } \
+  };
+
+#else
+
+#define PRED(name, op, vop) \
+  struct name { \
+    template <class T> static bool s(T x, T t) { return x op t; } \
+  };
+
+#endif
+
+PRED(Gt, >, vgt)
+PRED(Ge, >=, vge)
+PRED(Lt, <, vlt)
+PRED(Le, <=, vle)
+PRED(Eq, ==, veq)
+PRED(Ne, !=, vne)
+
+// Compare a against b[i], or against t everywhere when b is null.
+template <class T, class P>
+static void
+cmp_words(const T *a, const T *b, T t, uint32_t n, uint32_t *out)
+{
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  typename Simd<T>::V vt = Simd<T>::set1(t);
+  for (; i + 32 <= n; i += 32) {
+    uint32_t bits = 0;
+    for (uint32_t j = 0; j < 32; j += 4) {
+      if (b) { vt = Simd<T>::load(b + i + j); }
+      bits |= Simd<T>::movemask(P::v(Simd<T>::load(a + i + j), vt)) << j;
+    }
+    out[i/32] = bits;
+  }
+#endif
+  for (; i < n; i += 32) {
+    uint32_t bits = 0, m = n - i < 32 ? n - i : 32;
+    for (uint32_t j = 0; j < m; ++j) {
+      bits |= (uint32_t) P::s(a[i+j], b ? b[i+j] : t) << j;
+    }
+    out[i/32] = bits;
+  }
+}
+
+template <class T>
+static void
+cmp_dispatch(const T *a, const T *b, T t, uint32_t n, int op, uint32_t *out)
+{
+  switch (op) {
+  case CMP_GT: cmp_words<T, Gt>(a, b, t, n, out); break;
+  case CMP_GE: cmp_words<T, Ge>(a, b, t, n, out); break;
+  case CMP_LT: cmp_words<T, Lt>(a, b, t, n, out); break;
+  case CMP_LE: cmp_words<T, Le>(a, b, t, n, out); break;
+  case CMP_EQ: cmp_words<T, Eq>(a, b, t, n, out); break;
+  case CMP_NE: cmp_words<T, Ne>(a, b, t, n, out); break;
+  }
+}
+
+#if defined(SIMD_X86)
+
+/*
+ * Wider compares for the later levels: templates over the CMP_ op, whose
+ * switch folds away, for 8 lanes gathered by movemask under AVX2 and 16
+ * straight into a mask register under AVX-512.
+ */
+template <int Op>
+TARGET("avx2") static inline __m256 vcmp8(__m256 x, __m256 t)
+{
+  switch (Op) {
+  case CMP_GT: return _mm256_cmp_ps(x, t, _CMP_GT_OQ);
+  case CMP_GE: return _mm256_cmp_ps(x, t, _CMP_GE_OQ);
+  case CMP_LT: return _mm256_cmp_ps(x, t, _CMP_LT_OQ);
+  case CMP_LE: return _mm256_cmp_ps(x, t, _CMP_LE_OQ);
+  case CMP_EQ: return _mm256_cmp_ps(x, t, _CMP_EQ_OQ);
+  default: return _mm256_cmp_ps(x, t, _CMP_NEQ_UQ);
+  }
+}
+
+template <int Op>
+TARGET("avx2") static inline __m256i vcmp8(__m256i x, __m256i t)
+{
+  __m256i ones = _mm256_set1_epi32(-1);
+  switch (Op) {
+  case CMP_GT: return _mm256_cmpgt_epi32(x, t);
+  case CMP_GE: return _mm256_xor_si256(_mm256_cmpgt_epi32(t, x), ones);
+  case CMP_LT: return _mm256_cmpgt_epi32(t, x);
+  case CMP_LE: return _mm256_xor_si256(_mm256_cmpgt_epi32(x, t), ones);
+  case CMP_EQ: return _mm256_cmpeq_epi32(x, t);
+  default: return _mm256_xor_si256(_mm256_cmpeq_epi32(x, t), ones);
+  }
+}
+
+TARGET("avx2") static inline __m256 load8(const float *p) { return _mm256_loadu_ps(p); }
+TARGET("avx2") static inline __m256i load8(const int32_t *p) { return _mm256_loadu_si256((const __m256i *) p); }
+TARGET("avx2") static inline __m256 set8(float t) { return _mm256_set1_ps(t); }
+TARGET("avx2") static inline __m256i set8(int32_t t) { return _mm256_set1_epi32(t); }
+TARGET("avx2") static inline uint32_t movemask8(__m256 m) { return _mm256_movemask_ps(m); }
+TARGET("avx2") static inline uint32_t movemask8(__m256i m) { return _mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+
+template <int Op>
+TARGET("avx512f") static inline uint32_t vcmp16(__m512 x, __m512 t)
+{
+  switch (Op) {
+  case CMP_GT: return _mm512_cmp_ps_mask(x, t, _CMP_GT_OQ);
+  case CMP_GE: return _mm512_cmp_ps_mask(x, t, _CMP_GE_OQ);
+  case CMP_LT: return _mm512_cmp_ps_mask(x, t, _CMP_LT_OQ);
+  case CMP_LE: return _mm512_cmp_ps_mask(x, t, _CMP_LE_OQ);
+  case CMP_EQ: return _mm512_cmp_ps_mask(x, t, _CMP_EQ_OQ);
+  default: return _mm512_cmp_ps_mask(x, t, _CMP_NEQ_UQ);
+  }
+}
+
+template <int Op>
+TARGET("avx512f") static inline uint32_t vcmp16(__m512i x, __m512i t)
+{
+  switch (Op) {
+  case CMP_GT: return _mm512_cmp_epi32_mask(x, t, _MM_CMPINT_NLE);
+  case CMP_GE: return _mm512_cmp_epi32_mask(x, t, _MM_CMPINT_NLT);
+  case CMP_LT: return _mm512_cmp_epi32_mask(x, t, _MM_CMPINT_LT);
+  case CMP_LE: return _mm512_cmp_epi32_mask(x, t, _MM_CMPINT_LE);
+  case CMP_EQ: return _mm512_cmp_epi32_mask(x, t, _MM_CMPINT_EQ);
+  default: return _mm512_cmp_epi32_mask(x, t, _MM_CMPINT_NE);
+  }
+}
+
+TARGET("avx512f") static inline __m512 load16(const float *p) { return _mm512_loadu_ps(p); }
+TARGET("avx512f") static inline __m512i load16(const int32_t *p) { return _mm512_loadu_si512(p); }
+TARGET("avx512f") static inline __m512 set16(float t) { return _mm512_set1_ps(t); }
+TARGET("avx512f") static inline __m512i set16(int32_t t) { return _mm512_set1_epi32(t); }
+
+// Whole words as cmp_words does, leaving the tail to it.
+template <class T, int Op>
+TARGET("avx2") static void
+cmp_words_avx2(const T *a, const T *b, T t, uint32_t n, uint32_t *out)
+{
+  uint32_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    uint32_t bits = 0;
+    for (uint32_t j = 0; j < 32; j += 8) {
+      bits |= movemask8(vcmp8<Op>(load8(a + i + j), b ? load8(b + i + j) : set8(t))) << j;
+    }
+    out[i/32] = bits;
+  }
+  cmp_dispatch<T>(a + i, b ? b + i : 0, t, n - i, Op, out + i/32);
+}
+
+template <class T, int Op>
+TARGET("avx512f") static void
+cmp_words_avx512(const T *a, const T *b, T t, uint32_t n, uint32_t *out)
+{
+  uint32_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    uint32_t lo = vcmp16<Op>(load16(a + i), b ? load16(b + i) : set16(t));
+    uint32_t hi = vcmp16<Op>(load16(a + i + 16), b ? load16(b + i + 16) : set16(t));
+    out[i/32] = lo | hi << 16;
+  }
+  cmp_dispatch<T>(a + i, b ? b + i : 0, t, n - i, Op, out + i/32);
+}
+
+template <class T>
+static void
+cmp_avx2(const T *a, const T *b, T t, uint32_t n, int op, uint32_t *out)
+{
+  switch (op) {
+  case CMP_GT: cmp_words_avx2<T, CMP_GT>(a, b, t, n, out); break;
+  case CMP_GE: cmp_words_avx2<T, CMP_GE>(a, b, t, n, out); break;
+  case CMP_LT: cmp_words_avx2<T, CMP_LT>(a, b, t, n, out); break;
+  case CMP_LE: cmp_words_avx2<T, CMP_LE>(a, b, t, n, out); break;
+  case CMP_EQ: cmp_words_avx2<T, CMP_EQ>(a, b, t, n, out); break;
+  case CMP_NE: cmp_words_avx2<T, CMP_NE>(a, b, t, n, out); break;
+  }
+}
+
+template <class T>
+static void
+cmp_avx512(const T *a, const T *b, T t, uint32_t n, int op, uint32_t *out)
+{
+  switch (op) {
+  case CMP_GT: cmp_words_avx512<T, CMP_GT>(a, b, t, n, out); break;
+  case CMP_GE: cmp_words_avx512<T, CMP_GE>(a, b, t, n, out); break;
+  case CMP_LT: cmp_words_avx512<T, CMP_LT>(a, b, t, n, out); break;
+  case CMP_LE: cmp_words_avx512<T, CMP_LE>(a, b, t, n, out); break;
+  case CMP_EQ: cmp_words_avx512<T, CMP_EQ>(a, b, t, n, out); break;
+  case CMP_NE: cmp_words_avx512<T, CMP_NE>(a, b, t, n, out); break;
+  }
+}
+
+#endif
+
+static void
+cmp_fill(uint32_t n, bool value, uint32_t *out)
+{
+  uint32_t words = (n+31)/32;
+  memset(out, value ? 0xff : 0, words * sizeof(uint32_t));
+  if (value && n % 32) { out[words-1] = (1u << (n%32)) - 1; }
+}
+
+void
+cmp_i32(const int32_t *a, uint32_t n, int op, double t, uint32_t *out)
+{
+  const double lo = -2147483648.0, hi = 2147483647.0;
+  if (t != t) { cmp_fill(n, op == CMP_NE, out); return; }
+
+  // Against an integer element, x > t is x > floor(t), x >= t is
+  // x >= ceil(t) and so on; thresholds beyond int32 decide everything.
+  double f = floor(t), c = ceil(t);
+  switch (op) {
+  case CMP_GT:
+    if (f >= hi || f < lo) { cmp_fill(n, f < lo, out); return; }
+    kern.cmp_i32(a, 0, (int32_t) f, n, op, out);
+    break;
+  case CMP_LE:
+    if (f >= hi || f < lo) { cmp_fill(n, f >= hi, out); return; }
+    kern.cmp_i32(a, 0, (int32_t) f, n, op, out);
+    break;
+  case CMP_GE:
+    if (c > hi || c <= lo) { cmp_fill(n, c <= lo, out); return; }
+    kern.cmp_i32(a, 0, (int32_t) c, n, op, out);
+    break;
+  case CMP_LT:
+    if (c > hi || c <= lo) { cmp_fill(n, c > hi, out); return; }
+    kern.cmp_i32(a, 0, (int32_t) c, n, op, out);
+    break;
+  case CMP_EQ:
+  case CMP_NE:
+    if (f != t || t < lo || t > hi) { cmp_fill(n, op == CMP_NE, out); return; }
+    kern.cmp_i32(a, 0, (int32_t) t, n, op, out);
+    break;
+  }
+}
+
+void
+cmp_f32(const float *a, uint32_t n, int op, double t, uint32_t *out)
+{
+  if (t != t) { cmp_fill(n, op == CMP_NE, out); return; }
+
+  // The floats either side of t: x > t is x > down, x >= t is x >= up.
+  float down, up, r = (float) t;
+  if (t > FLT_MAX) {
+    down = FLT_MAX; up = INFINITY;
+  } else if (t < -FLT_MAX) {
+    down = -INFINITY; up = -FLT_MAX;
+  } else if ((double) r == t) {
+    down = up = r;
+  } else if ((double) r < t) {
+    down = r; up = nextafterf(r, INFINITY);
+  } else {
+    up = r; down = nextafterf(r, -INFINITY);
+  }
+
+  switch (op) {
+  case CMP_GT: case CMP_LE:
+    kern.cmp_f32(a, 0, down, n, op, out);
+    break;
+  case CMP_GE: case CMP_LT:
+    kern.cmp_f32(a, 0, up, n, op, out);
+    break;
+  case CMP_EQ: case CMP_NE:
+    if (down != up) { cmp_fill(n, op == CMP_NE, out); return; }
+    kern.cmp_f32(a, 0, down, n, op, out);
+    break;
+  }
+}
+
+void
+cmp_i32_vec(const int32_t *a, const int32_t *b, uint32_t n, int op, uint32_t *out)
+{
+  kern.cmp_i32(a, b, 0, n, op, out);
+}
+
+void
+cmp_f32_vec(const float *a, const float *b, uint32_t n, int op, uint32_t *out)
+{
+  kern.cmp_f32(a, b, 0, n, op, out);
+}
+
+// The first i from 'from' passing the predicate; while none do, four
+// vectors are tested per step.
+template <class T, class P>
+static uint32_t
+find_first(const T *a, uint32_t from, uint32_t n, T t)
+{
+  uint32_t i = from;
+#if defined(__SSE2__)
+  typename Simd<T>::V vt = Simd<T>::set1(t);
+  for (; i + 16 <= n; i += 16) {
+    uint32_t bits = 0;
+    for (uint32_t j = 0; j < 16; j += 4) {
+      bits |= Simd<T>::movemask(P::v(Simd<T>::load(a + i + j), vt)) << j;
+    }
+    if (bits) { return i + __builtin_ctz(bits); }
+  }
+#endif
+  for (; i < n; ++i) {
+    if (P::s(a[i], t)) { return i; }
+  }
+  return n;
+}
+
+template <class T>
+static uint32_t
+find_dispatch(const T *a, uint32_t from, uint32_t n, int op, T t)
+{
+  switch (op) {
+  case CMP_GT: return find_first<T, Gt>(a, from, n, t);
+  case CMP_GE: return find_first<T, Ge>(a, from, n, t);
+  case CMP_LT: return find_first<T, Lt>(a, from, n, t);
+  case CMP_LE: return find_first<T, Le>(a, from, n, t);
+  case CMP_EQ: return find_first<T, Eq>(a, from, n, t);
+  default: return find_first<T, Ne>(a, from, n, t);
+  }
+}
+
+uint32_t
+find_i32(const int32_t *a, uint32_t from, uint32_t n, int op, int32_t t)
+{
+  return find_dispatch<int32_t>(a, from, n, op, t);
+}
+
+uint32_t
+find_f32(const float *a, uint32_t from, uint32_t n, int op, float t)
+{
+  return find_dispatch<float>(a, from, n, op, t);
+}
+
+int
+transform_op(const char *name)
+{
+  static const char *names[] = {
+    "cast", "sqrt", "log", "exp", "round", "floor", "ceil", "abs", "neg"
+  };
+  for (int i = 0; i < (int) (sizeof(names)/sizeof(names[0])); ++i) {
+    if (! strcmp(name, names[i])) { return i; }
+  }
+  return -1;
+}
+
+// Element access by type; bits are read one at a time from their words.
+static inline double
+load_elem(const void *src, int type, uint32_t i)
+{
+  switch (type) {
+  case ELEM_I32: return ((const int32_t *) src)[i];
+  case ELEM_F32: return ((const float *) src)[i];
+  default: return (((const uint32_t *) src)[i/32] >> (i%32)) & 1;
+  }
+}
+
+template <int Op>
+static inline double
+apply(double x)
+{
+  switch (Op) {
+  case XF_SQRT: return sqrt(x);
+  case XF_LOG: return log(x);
+  case XF_EXP: return exp(x);
+  case XF_ROUND: return floor(x + 0.5);
+  case XF_FLOOR: return floor(x);
+  case XF_CEIL: return ceil(x);
+  case XF_ABS: return fabs(x);
+  case XF_NEG: return -x;
+  default: return x;
+  }
+}
+
+template <int Op>
+static void
+transform_op_loop(const void *src, int src_type, uint32_t n, void *dst, int dst_type)
+{
+  // The common same-type cases get plain loops the compiler can vectorize.
+  if (src_type == ELEM_F32 && dst_type == ELEM_F32) {
+    const float *s = (const float *) src;
+    float *d = (float *) dst;
+    for (uint32_t i = 0; i < n; ++i) { d[i] = (float) apply<Op>(s[i]); }
+    return;
+  }
+  if (src_type == ELEM_I32 && dst_type == ELEM_F32) {
+    const int32_t *s = (const int32_t *) src;
+    float *d = (float *) dst;
+    for (uint32_t i = 0; i < n; ++i) { d[i] = (float) apply<Op>(s[i]); }
+    return;
+  }
+
+  switch (dst_type) {
+  case ELEM_I32:
+    for (uint32_t i = 0; i < n; ++i) {
+      ((int32_t *) dst)[i] = to_int32(apply<Op>(load_elem(src, src_type, i)));
+    }
+    break;
+  case ELEM_F32:
+    for (uint32_t i = 0; i < n; ++i) {
+      ((float *) dst)[i] = (float) apply<Op>(load_elem(src, src_type, i));
+    }
+    break;
+  case ELEM_BIT:
+    for (uint32_t i = 0; i < n; i += 32) {
+      uint32_t bits = 0, m = n - i < 32 ? n - i : 32;
+      for (uint32_t j = 0; j < m; ++j) {
+        double v = apply<Op>(load_elem(src, src_type, i+j));
+        bits |= (uint32_t) (v != 0 && v == v) << j;
+      }
+      uint32_t *word = (uint32_t *) dst + i/32;
+      *word = m == 32 ? bits : (*word & ~((1u << m) - 1)) | bits;
+    }
+    break;
+  }
+}
+
+void
+transform(const void *src, int src_type, uint32_t n, int op, void *dst, int dst_type)
+{
+  switch (op) {
+  case XF_CAST: transform_op_loop<XF_CAST>(src, src_type, n, dst, dst_type); break;
+  case XF_SQRT: transform_op_loop<XF_SQRT>(src, src_type, n, dst, dst_type); break;
+  case XF_LOG: transform_op_loop<XF_LOG>(src, src_type, n, dst, dst_type); break;
+  case XF_EXP: transform_op_loop<XF_EXP>(src, src_type, n, dst, dst_type); break;
+  case XF_ROUND: transform_op_loop<XF_ROUND>(src, src_type, n, dst, dst_type); break;
+  case XF_FLOOR: transform_op_loop<XF_FLOOR>(src, src_type, n, dst, dst_type); break;
+  case XF_CEIL: transform_op_loop<XF_CEIL>(src, src_type, n, dst, dst_type); break;
+  case XF_ABS: transform_op_loop<XF_ABS>(src, src_type, n, dst, dst_type); break;
+  case XF_NEG: transform_op_loop<XF_NEG>(src, src_type, n, dst, dst_type); break;
+  }
+}
+
+static const uint64_t XXH_P1 = 11400714785074694791ULL;
+static const uint64_t XXH_P2 = 14029467366897019727ULL;
+static const uint64_t XXH_P3 = 1609587929392839161ULL;
+static const uint64_t XXH_P4 = 9650029242287828579ULL;
+static const uint64_t XXH_P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t
+read64(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t
+xxh_round(uint64_t acc, uint64_t input)
+{
+  acc += input * XXH_P2;
+  return rotl64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t
+xxh_merge(uint64_t acc, uint64_t v)
+{
+  acc ^= xxh_round(0, v);
+  return acc * XXH_P1 + XXH_P4;
+}
+
+uint64_t
+hash64(const void *data, size_t len, uint64_t seed)
+{
+  const uint8_t *p = (const uint8_t *) data, *end = p + len;
+  uint64_t h;
+
+  // Four independent lanes over 32 byte stripes.
+  if (len >= 32) {
+    uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed, v4 = seed - XXH_P1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = xxh_round(v1, read64(p));
+      v2 = xxh_round(v2, read64(p + 8));
+      v3 = xxh_round(v3, read64(p + 16));
+      v4 = xxh_round(v4, read64(p + 24));
+    }
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = xxh_merge(h, v1);
+    h = xxh_merge(h, v2);
+    h = xxh_merge(h, v3);
+    h = xxh_merge(h, v4);
+  } else {
+    h = seed + XXH_P5;
+  }
+  h += len;
+
+  for (; p + 8 <= end; p += 8) {
+    h ^= xxh_round(0, read64(p));
+    h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+  }
+  if (p + 4 <= end) {
+    uint32_t k;
+    memcpy(&k, p, sizeof(k));
+    h ^= k * XXH_P1;
+    h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * XXH_P5;
+    h = rotl64(h, 11) * XXH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t
+hash_bits(const uint32_t *w, uint32_t n, uint64_t seed)
+{
+  uint64_t h = hash64(w, sizeof(uint32_t) * (n/32), seed);
+  if (n % 32) {
+    uint32_t tail = w[n/32] & ((1u << (n%32)) - 1);
+    h = hash64(&tail, sizeof(tail), h);
+  }
+  return h;
+}
+
+bool
+equal_bits(const uint32_t *a, const uint32_t *b, uint32_t n)
+{
+  if (memcmp(a, b, sizeof(uint32_t) * (n/32))) { return false; }
+  uint32_t m = (1u << (n%32)) - 1;
+  return ! (n % 32) || ! ((a[n/32] ^ b[n/32]) & m);
+}
+
+/*
+ * Float matrix kernels.  Sums of products run in SSE lanes, four or
+ * eight apart, and are added up at the end.
+ */
+
+// Columns of x that gemv keeps in L1 while a block of rows goes by: 16KB.
+#define GEMV_KC 4096
+// Panels of B, GEMM_KC rows by GEMM_NC columns (256KB), that gemm keeps
+// in L2 while each row of A goes through them.
+#define GEMM_KC 256
+#define GEMM_NC 256
+// Rows that knn scores at a time.
+#define KNN_BLOCK 256
+// Below this many multiply-adds a product isn't worth splitting across
+// threads.
+#define PARALLEL_MATRIX_MIN (1 << 20)
+
+#if defined(__SSE2__)
+static inline float hsum_f32(__m128 v) {
+  float t[4];
+  _mm_storeu_ps(t, v);
+  return (t[0] + t[1]) + (t[2] + t[3]);
+}
+#endif
+
+float
+dot_f32(const float *a, const float *b, uint32_t n)
+{
+  float sum = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  sum = hsum_f32(_mm_add_ps(s0, s1));
+#endif
+  for (; i < n; ++i) { sum += a[i] * b[i]; }
+  return sum;
+}
+
+float
+l2sq_f32(const float *a, const float *b, uint32_t n)
+{
+  float sum = 0;
+  uint32_t i = 0;
+#if defined(__SSE2__)
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+    s0 = _mm_add_ps(s0, _mm_mul_ps(d0, d0));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(d1, d1));
+  }
+  sum = hsum_f32(_mm_add_ps(s0, s1));
+#endif
+  for (; i < n; ++i) { sum += (a[i] - b[i]) * (a[i] - b[i]); }
+  return sum;
+}
+
+// Add to y[0..3] the dot products with x of four rows, stride apart,
+// sharing each load of x.
+static void
+dot4_f32(const float *a, size_t stride, const float *x, uint32_t n, float *y)
+{
+  const float *r0 = a, *r1 = a + stride, *r2 = a + 2*stride, *r3 = a + 3*stride;
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  uint32_t j = 0;
+#if defined(__SSE2__)
+  __m128 v0 = _mm_setzero_ps(), v1 = _mm_setzero_ps(), v2 = _mm_setzero_ps(), v3 = _mm_setzero_ps();
+  for (; j + 4 <= n; j += 4) {
+    __m128 xv = _mm_loadu_ps(x + j);
+    v0 = _mm_add_ps(v0, _mm_mul_ps(_mm_loadu_ps(r0 + j), xv));
+    v1 = _mm_add_ps(v1, _mm_mul_ps(_mm_loadu_ps(r1 + j), xv));
+    v2 = _mm_add_ps(v2, _mm_mul_ps(_mm_loadu_ps(r2 + j), xv));
+    v3 = _mm_add_ps(v3, _mm_mul_ps(_mm_loadu_ps(r3 + j), xv));
+  }
+  s0 = hsum_f32(v0);
+  s1 = hsum_f32(v1);
+  s2 = hsum_f32(v2);
+  s3 = hsum_f32(v3);
+#endif
+  for (; j < n; ++j) {
+    s0 += r0[j] * x[j];
+    s1 += r1[j] * x[j];
+    s2 += r2[j] * x[j];
+    s3 += r3[j] * x[j];
+  }
+  y[0] += s0;
+  y[1] += s1;
+  y[2] += s2;
+  y[3] += s3;
+}
+
+// y[start, end) of y = A x.
+static void
+gemv_rows(const float *a, uint32_t cols, const float *x, float *y, uint32_t start, uint32_t end)
+{
+  for (uint32_t i = start; i < end; ++i) { y[i] = 0; }
+  for (uint32_t jj = 0; jj < cols; jj += GEMV_KC) {
+    uint32_t nb = cols - jj < GEMV_KC ? cols - jj : GEMV_KC;
+    uint32_t i = start;
+    for (; i + 4 <= end; i += 4) { dot4_f32(a + (size_t) i * cols + jj, cols, x + jj, nb, y + i); }
+    for (; i < end; ++i) { y[i] += dot_f32(a + (size_t) i * cols + jj, x + jj, nb); }
+  }
+}
+
+struct gemv_ctx {
+  const float *a;
+  uint32_t cols;
+  const float *x;
+  float *y;
+};
+
+static void gemv_part(void *ctx, uint32_t part, uint32_t start, uint32_t end)
+{
+  gemv_ctx *c = (gemv_ctx *) ctx;
+  gemv_rows(c->a, c->cols, c->x, c->y, start, end);
+}
+
+void
+gemv_f32(const float *a, uint32_t rows, uint32_t cols, const float *x, float *y)
+{
+  gemv_ctx ctx = { a, cols, x, y };
+  uint32_t parts = (uint64_t) rows * cols < PARALLEL_MATRIX_MIN ? 1 : parallel_threads();
+  parallel_for(rows, parts, gemv_part, &ctx);
+}
+
+// y[0, n) += alpha x.
+static inline void
+axpy_f32(float alpha, const float *x, float *y, uint32_t n)
+{
+  uint32_t j = 0;
+#if defined(__SSE2__)
+  __m128 av = _mm_set1_ps(alpha);
+  for (; j + 8 <= n; j += 8) {
+    _mm_storeu_ps(y + j, _mm_add_ps(_mm_loadu_ps(y + j), _mm_mul_ps(av, _mm_loadu_ps(x + j))));
+    _mm_storeu_ps(y + j + 4, _mm_add_ps(_mm_loadu_ps(y + j + 4), _mm_mul_ps(av, _mm_loadu_ps(x + j + 4))));
+  }
+#endif
+  for (; j < n; ++j) { y[j] += alpha * x[j]; }
+}
+
+#if defined(__SSE2__)
+// A 4 x 8 tile of C, held in registers, plus a 4 x kb block of A times a
+// kb x 8 block of B.
+static void
+gemm_4x8(const float *a, size_t lda, const float *b, size_t ldb, float *c, size_t ldc, uint32_t kb)
+{
+  __m128 c00 = _mm_loadu_ps(c), c01 = _mm_loadu_ps(c + 4);
+  __m128 c10 = _mm_loadu_ps(c + ldc), c11 = _mm_loadu_ps(c + ldc + 4);
+  __m128 c20 = _mm_loadu_ps(c + 2*ldc), c21 = _mm_loadu_ps(c + 2*ldc + 4);
+  __m128 c30 = _mm_loadu_ps(c + 3*ldc), c31 = _mm_loadu_ps(c + 3*ldc + 4);
+  for (uint32_t p = 0; p < kb; ++p, b += ldb) {
+    __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), av;
+    av = _mm_set1_ps(a[p]);
+    c00 = _mm_add_ps(c00, _mm_mul_ps(av, b0));
+    c01 = _mm_add_ps(c01, _mm_mul_ps(av, b1));
+    av = _mm_set1_ps(a[lda + p]);
+    c10 = _mm_add_ps(c10, _mm_mul_ps(av, b0));
+    c11 = _mm_add_ps(c11, _mm_mul_ps(av, b1));
+    av = _mm_set1_ps(a[2*lda + p]);
+    c20 = _mm_add_ps(c20, _mm_mul_ps(av, b0));
+    c21 = _mm_add_ps(c21, _mm_mul_ps(av, b1));
+    av = _mm_set1_ps(a[3*lda + p]);
+    c30 = _mm_add_ps(c30, _mm_mul_ps(av, b0));
+    c31 = _mm_add_ps(c31, _mm_mul_ps(av, b1));
+  }
+  _mm_storeu_ps(c, c00);
+  _mm_storeu_ps(c + 4, c01);
+  _mm_storeu_ps(c + ldc, c10);
+  _mm_storeu_ps(c + ldc + 4, c11);
+  _mm_storeu_ps(c + 2*ldc, c20);
+  _mm_storeu_ps(c + 2*ldc + 4, c21);
+  _mm_storeu_ps(c + 3*ldc, c30);
+  _mm_storeu_ps(c + 3*ldc + 4, c31);
+}
+#endif
+
+// Rows [start, end) of C = A B.
+static void
+gemm_rows(const float *a, const float *b, uint32_t k, uint32_t n, float *c, uint32_t start, uint32_t end)
+{
+  memset(c + (size_t) start * n, 0, sizeof(float) * n * (end - start));
+  for (uint32_t jj = 0; jj < n; jj += GEMM_NC) {
+    uint32_t nb = n - jj < GEMM_NC ? n - jj : GEMM_NC;
+    for (uint32_t pp = 0; pp < k; pp += GEMM_KC) {
+      uint32_t kb = k - pp < GEMM_KC ? k - pp : GEMM_KC;
+      const float *bp = b + (size_t) pp * n + jj;
+
+      uint32_t i = start;
+      for (; i + 4 <= end; i += 4) {
+        const float *ap = a + (size_t) i * k + pp;
+        float *cp = c + (size_t) i * n + jj;
+        uint32_t j = 0;
+#if defined(__SSE2__)
+        for (; j + 8 <= nb; j += 8) { gemm_4x8(ap, k, bp + j, n, cp + j, n, kb); }
+#endif
+        for (uint32_t r = 0; j < nb && r < 4; ++r) {
+          for (uint32_t p = 0; p < kb; ++p) {
+            axpy_f32(ap[r*k + p], bp + (size_t) p * n + j, cp + (size_t) r * n + j, nb - j);
+          }
+        }
+      }
+      for (; i < end; ++i) {
+        for (uint32_t p = 0; p < kb; ++p) {
+          axpy_f32(a[(size_t) i * k + pp + p], bp + (size_t) p * n, c + (size_t) i * n + jj, nb);
+        }
+      }
+    }
+  }
+}
+
+struct gemm_ctx {
+  const float *a;
+  const float *b;
+  uint32_t k, n;
+  float *c;
+};
+
+static void gemm_part(void *ctx, uint32_t part, uint32_t start, uint32_t end)
+{
+  gemm_ctx *c = (gemm_ctx *) ctx;
+  gemm_rows(c->a, c->b, c->k, c->n, c->c, start, end);
+}
+
+void
+gemm_f32(const float *a, const float *b, uint32_t m, uint32_t k, uint32_t n, float *c)
+{
+  gemm_ctx ctx = { a, b, k, n, c };
+  uint32_t parts = (uint64_t) m * k * n < PARALLEL_MATRIX_MIN ? 1 : parallel_threads();
+  parallel_for(m, parts, gemm_part, &ctx);
+}
+
+int
+knn_metric(const char *name)
+{
+  if (strcmp(name, "dot") == 0) { return KNN_DOT; }
+  if (strcmp(name, "cosine") == 0) { return KNN_COSINE; }
+  if (strcmp(name, "l2") == 0) { return KNN_L2; }
+  return -1;
+}
+
+struct KnnHit {
+  float score;  // squared for KNN_L2
+  uint32_t row;
+};
+
+// Orders hits best first: by score, then by row.
+struct KnnBetter {
+  bool smallest;
+  explicit KnnBetter(bool smallest) : smallest(smallest) {}
+  bool operator()(const KnnHit& a, const KnnHit& b) const {
+    if (a.score != b.score) { return smallest ? a.score < b.score : a.score > b.score; }
+    return a.row < b.row;
+  }
+};
+
+struct knn_ctx {
+  const float *a;
+  uint32_t cols;
+  const float *q;
+  float qnorm;
+  uint32_t k;
+  int metric;
+  std::vector<KnnHit> *hits;  // A heap per part, worst on top
+};
+
+static void knn_part(void *ctx, uint32_t part, uint32_t start, uint32_t end)
+{
+  knn_ctx *c = (knn_ctx *) ctx;
+  std::vector<KnnHit>& heap = c->hits[part];
+  KnnBetter better(c->metric == KNN_L2);
+  float scores[KNN_BLOCK];
+
+  for (uint32_t i = start; i < end; i += KNN_BLOCK) {
+    uint32_t nb = end - i < KNN_BLOCK ? end - i : KNN_BLOCK;
+    const float *rows = c->a + (size_t) i * c->cols;
+    if (c->metric == KNN_L2) {
+      for (uint32_t j = 0; j < nb; ++j) { scores[j] = l2sq_f32(rows + (size_t) j * c->cols, c->q, c->cols); }
+    } else {
+      gemv_rows(rows, c->cols, c->q, scores, 0, nb);
+    }
+    if (c->metric == KNN_COSINE) {
+      for (uint32_t j = 0; j < nb; ++j) {
+        const float *row = rows + (size_t) j * c->cols;
+        float norm = sqrtf(dot_f32(row, row, c->cols)) * c->qnorm;
+        scores[j] = norm > 0 ? scores[j] / norm : 0;
+      }
+    }
+
+    for (uint32_t j = 0; j < nb; ++j) {
+      KnnHit hit = { scores[j], i + j };
+      if (hit.score != hit.score) { continue; }
+      if (heap.size() < c->k) {
+        heap.push_back(hit);
+        std::push_heap(heap.begin(), heap.end(), better);
+      } else if (better(hit, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = hit;
+        std::push_heap(heap.begin(), heap.end(), better);
+      }
+    }
+  }
+}
+
+uint32_t
+knn_f32(const float *a, uint32_t rows, uint32_t cols, const float *q, uint32_t k, int metric,
+        uint32_t *idx, float *scores)
+{
+  if (k > rows) { k = rows; }
+  if (k == 0) { return 0; }
+
+  std::vector<KnnHit> hits[64];
+  knn_ctx ctx = { a, cols, q, sqrtf(dot_f32(q, q, cols)), k, metric, hits };
+  uint32_t parts = (uint64_t) rows * cols < PARALLEL_MATRIX_MIN ? 1 : parallel_threads();
+  parallel_for(rows, parts, knn_part, &ctx);
+
+  // The best k of the best k of each part.
+  std::vector<KnnHit> all;
+  for (uint32_t p = 0; p < 64; ++p) { all.insert(all.end(), hits[p].begin(), hits[p].end()); }
+  uint32_t m = all.size() < k ? all.size() : k;
+  std::partial_sort(all.begin(), all.begin() + m, all.end(), KnnBetter(metric == KNN_L2));
+  for (uint32_t i = 0; i < m; ++i) {
+    idx[i] = all[i].row;
+    scores[i] = metric == KNN_L2 ? sqrtf(all[i].score) : all[i].score;
+  }
+  return m;
+}
+
+/*
+ * Runtime dispatch.  Each level binds its own kernels over those of the
+ * levels below it.
+ */
+const char *simd_level_names[SIMD_LEVELS] = { "base", "sse4.2", "avx2", "avx512" };
+
+static int simd_bound = SIMD_BASE;
+
+int
+simd_detect()
+{
+#if defined(SIMD_X86)
+  __builtin_cpu_init();
+  if (! __builtin_cpu_supports("sse4.2") || ! __builtin_cpu_supports("popcnt")) { return SIMD_BASE; }
+  if (! __builtin_cpu_supports("avx2")) { return SIMD_SSE42; }
+  if (! __builtin_cpu_supports("avx512f") || ! __builtin_cpu_supports("avx512bw")) { return SIMD_AVX2; }
+  return SIMD_AVX512;
+#else
+  return SIMD_BASE;
+#endif
+}
+
+int
+simd_bind(int level)
+{
+  int best = simd_detect();
+  if (level > best) { level = best; }
+  if (level < SIMD_BASE) { level = SIMD_BASE; }
+
+  kern.dot_i8 = dot_i8_base;
+  kern.count_bits = count_bits_base;
+  kern.compress_u32 = compress_u32_base;
+  kern.expand_u32 = expand_u32_base;
+  kern.sum_i32 = reduce_base<int32_t, SumOp<int64_t>, int64_t>;
+  kern.sum_f32 = reduce_base<float, SumOp<double>, double>;
+  kern.min_i32 = reduce_base<int32_t, MinOp<double>, double>;
+  kern.min_f32 = reduce_base<float, MinOp<double>, double>;
+  kern.max_i32 = reduce_base<int32_t, MaxOp<double>, double>;
+  kern.max_f32 = reduce_base<float, MaxOp<double>, double>;
+  kern.cmp_i32 = cmp_dispatch<int32_t>;
+  kern.cmp_f32 = cmp_dispatch<float>;
+
+#if defined(SIMD_X86)
+  if (level >= SIMD_SSE42) {
+    kern.count_bits = count_bits_popcnt;
+    kern.min_i32 = min_i32_sse4;
+    kern.min_f32 = min_f32_sse4;
+    kern.max_i32 = max_i32_sse4;
+    kern.max_f32 = max_f32_sse4;
+  }
+  if (level >= SIMD_AVX2) {
+    init_compress_lut();
+    kern.dot_i8 = dot_i8_avx2;
+    kern.count_bits = count_bits_avx2;
+    kern.compress_u32 = compress_u32_avx2;
+    kern.sum_i32 = sum_i32_avx2;
+    kern.sum_f32 = sum_f32_avx2;
+    kern.min_i32 = min_i32_avx2;
+    kern.min_f32 = min_f32_avx2;
+    kern.max_i32 = max_i32_avx2;
+    kern.max_f32 = max_f32_avx2;
+    kern.cmp_i32 = cmp_avx2<int32_t>;
+    kern.cmp_f32 = cmp_avx2<float>;
+  }
+  if (level >= SIMD_AVX512) {
+    kern.dot_i8 = dot_i8_avx512;
+    if (__builtin_cpu_supports("avx512vpopcntdq")) { kern.count_bits = count_bits_avx512; }
+    kern.compress_u32 = compress_u32_avx512;
+    kern.expand_u32 = expand_u32_avx512;
+    kern.sum_i32 = sum_i32_avx512;
+    kern.sum_f32 = sum_f32_avx512;
+    kern.min_i32 = min_i32_avx512;
+    kern.min_f32 = min_f32_avx512;
+    kern.max_i32 = max_i32_avx512;
+    kern.max_f32 = max_f32_avx512;
+    kern.cmp_i32 = cmp_avx512<int32_t>;
+    kern.cmp_f32 = cmp_avx512<float>;
+  }
+#endif
+
+  simd_bound = level;
+  return level;
+}
+
+int
+simd_init()
+{
+  int level = SIMD_LEVELS - 1;
+  const char *env = getenv("VEC_SIMD");
+  for (int l = 0; env && l < SIMD_LEVELS; ++l) {
+    if (strcmp(env, simd_level_names[l]) == 0) { level = l; }
+  }
+  return simd_bind(level);
+}
+
+int
+simd_level()
+{
+  return simd_bound;
+}
+
+// The baseline kernels are bound as the library loads, so they work
+// before simd_init().
+static struct SimdLoad {
+  SimdLoad() { simd_bind(SIMD_BASE); }
+} simd_load;
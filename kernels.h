@@ -0,0 +1,155 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+/*
+ * Numeric kernels shared by the vector types.  Nothing in here knows
+ * about V8, so the kernels can be exercised on their own.
+ */
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+/*
+ * SIMD levels.  The build targets the baseline instruction set (SSE2 on
+ * x86-64); the hot kernels (popcount, reductions, compares, int8 dot
+ * products, compress and expand) also have versions for later levels,
+ * bound at load time to the best the CPU supports.  VEC_SIMD set to a
+ * level name forces that level, or the best supported below it.
+ */
+enum { SIMD_BASE, SIMD_SSE42, SIMD_AVX2, SIMD_AVX512, SIMD_LEVELS };
+extern const char *simd_level_names[SIMD_LEVELS];  // "base", "sse4.2", "avx2", "avx512"
+
+int simd_detect();          // the best level this CPU supports
+int simd_bind(int level);   // bind a level, capped at simd_detect(); returns it
+int simd_init();            // bind VEC_SIMD's level or the best; returns it
+int simd_level();           // the level bound
+
+// Sum of a[i]*b[i] over two int8 vectors.
+int64_t dot_i8(const int8_t *a, const int8_t *b, uint32_t n);
+
+// Sum of a[i] and of a[i]*a[i] over an int8 vector.
+int64_t sum_i8(const int8_t *a, uint32_t n);
+int64_t sumsq_i8(const int8_t *a, uint32_t n);
+
+// Prefix scans.  src and dst may be the same vector.  Exclusive scans
+// start from the identity of the operation.  Large vectors are scanned
+// in two parallel passes: per-slice totals, then each slice from its
+// carry.  Float sums are reassociated and may differ in the last bits
+// from a strictly sequential sum.
+enum { SCAN_SUM, SCAN_MIN, SCAN_MAX, SCAN_PRODUCT };
+int scan_op(const char *name);  // -1 for an unknown name
+
+void scan_i32(const int32_t *src, int32_t *dst, uint32_t n, int op, bool exclusive);
+void scan_f32(const float *src, float *dst, uint32_t n, int op, bool exclusive);
+
+// Adjacent differences, the inverse of an inclusive sum scan.
+void diff_i32(const int32_t *src, int32_t *dst, uint32_t n);
+void diff_f32(const float *src, float *dst, uint32_t n);
+
+/*
+ * Masked kernels.  A mask is a BitVec word array; only its first n bits
+ * are looked at.  Elements are moved as raw 32-bit words, so the same
+ * compress/expand serve both IntVec and FloatVec.
+ */
+uint32_t count_bits(const uint32_t *mask, uint32_t n);
+
+// Copy src[i] for each set bit i < n to consecutive dst slots; returns
+// the number copied, which is count_bits(mask, n).
+uint32_t compress_u32(const uint32_t *src, const uint32_t *mask, uint32_t n, uint32_t *dst);
+
+// Store consecutive values (at most nvalues) to dst[i] for each set bit
+// i < n; returns the number of values used.
+uint32_t expand_u32(const uint32_t *values, uint32_t nvalues, const uint32_t *mask, uint32_t n, uint32_t *dst);
+
+// Reductions over the first n elements, or only those whose mask bit is
+// set when mask is non-null.  Empty min/max give +/-Infinity.
+double sum_i32(const int32_t *src, uint32_t n, const uint32_t *mask);
+double sum_f32(const float *src, uint32_t n, const uint32_t *mask);
+double min_i32(const int32_t *src, uint32_t n, const uint32_t *mask);
+double min_f32(const float *src, uint32_t n, const uint32_t *mask);
+double max_i32(const int32_t *src, uint32_t n, const uint32_t *mask);
+double max_f32(const float *src, uint32_t n, const uint32_t *mask);
+
+/*
+ * Comparisons packed 32 results to a word, as in a BitVec.  The scalar
+ * forms take the threshold as a double and compare exactly, as JS would
+ * compare the element's value, by adjusting it to the nearest element
+ * value on the correct side.  All n/32 full words and the partial last
+ * word (with its unused high bits clear) are written.
+ */
+enum { CMP_GT, CMP_GE, CMP_LT, CMP_LE, CMP_EQ, CMP_NE };
+
+void cmp_i32(const int32_t *a, uint32_t n, int op, double t, uint32_t *out);
+void cmp_f32(const float *a, uint32_t n, int op, double t, uint32_t *out);
+void cmp_i32_vec(const int32_t *a, const int32_t *b, uint32_t n, int op, uint32_t *out);
+void cmp_f32_vec(const float *a, const float *b, uint32_t n, int op, uint32_t *out);
+
+// The first i in [from, n) where a[i] compares true against t, or n.
+uint32_t find_i32(const int32_t *a, uint32_t from, uint32_t n, int op, int32_t t);
+uint32_t find_f32(const float *a, uint32_t from, uint32_t n, int op, float t);
+
+// ECMAScript ToInt32, the conversion of a number stored into an IntVec.
+static inline int32_t
+to_int32(double d)
+{
+  if (d >= -2147483648.0 && d <= 2147483647.0) { return (int32_t) d; }
+  if (d != d || d == INFINITY || d == -INFINITY) { return 0; }
+  double m = fmod(trunc(d), 4294967296.0);
+  if (m < 0) { m += 4294967296.0; }
+  return (int32_t) (uint32_t) m;
+}
+
+/*
+ * Elementwise named transforms between element types, computed in double
+ * as the equivalent Math function would and stored as an indexed set
+ * would: ToInt32 into ints, nonzero (and not NaN) into bits.  Bit
+ * destinations are written a word at a time, keeping any bits past n.
+ * src and dst may be the same storage when the types match.
+ */
+enum { ELEM_I32, ELEM_F32, ELEM_BIT };
+enum { XF_CAST, XF_SQRT, XF_LOG, XF_EXP, XF_ROUND, XF_FLOOR, XF_CEIL, XF_ABS, XF_NEG };
+int transform_op(const char *name);  // -1 for an unknown name
+
+void transform(const void *src, int src_type, uint32_t n, int op, void *dst, int dst_type);
+
+// XXH64 of len bytes; chaining a hash in as the seed of the next call
+// hashes storage in pieces.
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+// Hash and equality of n bits, ignoring the bits past n in the last word.
+uint64_t hash_bits(const uint32_t *w, uint32_t n, uint64_t seed);
+bool equal_bits(const uint32_t *a, const uint32_t *b, uint32_t n);
+
+// Sum of a[i]*b[i], and of (a[i]-b[i])^2, over two float vectors.
+float dot_f32(const float *a, const float *b, uint32_t n);
+float l2sq_f32(const float *a, const float *b, uint32_t n);
+
+/*
+ * Row-major float matrix products: gemv sets y = A x for a rows x cols
+ * A, and gemm sets C = A B for an m x k A and a k x n B.  Both are cache
+ * blocked and split by rows across threads when large.  Sums of products
+ * are reassociated, so may differ in the last bits from a plain loop.
+ */
+void gemv_f32(const float *a, uint32_t rows, uint32_t cols, const float *x, float *y);
+void gemm_f32(const float *a, const float *b, uint32_t m, uint32_t k, uint32_t n, float *c);
+
+/*
+ * The k rows of a rows x cols matrix nearest to q, best first and ties
+ * to the lower row, into idx with their scores: the largest dot products
+ * or cosine similarities, or the smallest euclidean distances.  Rows
+ * scoring NaN are never chosen.  Slices of rows are scored in parallel,
+ * each keeping a running top k.  Returns how many were found.
+ */
+enum { KNN_DOT, KNN_COSINE, KNN_L2 };
+int knn_metric(const char *name);  // -1 for an unknown name
+
+uint32_t knn_f32(const float *a, uint32_t rows, uint32_t cols, const float *q, uint32_t k, int metric,
+                 uint32_t *idx, float *scores);
+
+#endif
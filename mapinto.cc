@@ -0,0 +1,108 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+
+#include <string.h>
+
+using namespace node;
+using namespace v8;
+
+#include "mapinto.h"
+#include "intvec.h"
+#include "floatvec.h"
+#include "bitvec.h"
+#include "kernels.h"
+
+static const char BAD_OUTPUT[] = "Output must be a vector or 'int', 'float' or 'bit'";
+
+bool
+map_output(Handle<Value> arg, int deflt, uint32_t len, Handle<Object> *out, int *type)
+{
+  *type = deflt;
+  if (arg->IsString()) {
+    String::AsciiValue name(arg);
+    if (! strcmp(*name, "int")) {
+      *type = ELEM_I32;
+    } else if (! strcmp(*name, "float")) {
+      *type = ELEM_F32;
+    } else if (! strcmp(*name, "bit")) {
+      *type = ELEM_BIT;
+    } else {
+      ThrowException(Exception::TypeError(String::New(BAD_OUTPUT)));
+      return false;
+    }
+  } else if (IntVec::HasInstance(arg)) {
+    *out = arg->ToObject();
+    *type = ELEM_I32;
+    if (! ObjectWrap::Unwrap<IntVec>(*out)->extend(len)) {
+      ThrowException(Exception::TypeError(String::New("Out of memory")));
+      return false;
+    }
+    return true;
+  } else if (FloatVec::HasInstance(arg)) {
+    *out = arg->ToObject();
+    *type = ELEM_F32;
+    if (! ObjectWrap::Unwrap<FloatVec>(*out)->extend(len)) {
+      ThrowException(Exception::TypeError(String::New("Out of memory")));
+      return false;
+    }
+    return true;
+  } else if (BitVec::HasInstance(arg)) {
+    *out = arg->ToObject();
+    *type = ELEM_BIT;
+    if (! ObjectWrap::Unwrap<BitVec>(*out)->extend(len)) {
+      ThrowException(Exception::TypeError(String::New("Out of memory")));
+      return false;
+    }
+    return true;
+  } else if (! arg->IsUndefined()) {
+    ThrowException(Exception::TypeError(String::New(BAD_OUTPUT)));
+    return false;
+  }
+
+  switch (*type) {
+  case ELEM_I32: *out = IntVec::NewInstance(len); break;
+  case ELEM_F32: *out = FloatVec::NewInstance(len); break;
+  default: *out = BitVec::NewInstance(len); break;
+  }
+  return ! out->IsEmpty();
+}
+
+void *
+map_data(Handle<Object> out, int type)
+{
+  switch (type) {
+  case ELEM_I32: {
+    IntVec *iv = ObjectWrap::Unwrap<IntVec>(out);
+    iv->willWrite();
+    return iv->data();
+  }
+  case ELEM_F32: {
+    FloatVec *fv = ObjectWrap::Unwrap<FloatVec>(out);
+    fv->willWrite();
+    return fv->data();
+  }
+  default: {
+    BitVec *bv = ObjectWrap::Unwrap<BitVec>(out);
+    bv->willWrite();
+    return bv->data();
+  }
+  }
+}
+
+bool
+map_store(Handle<Object> out, int type, uint32_t i, Handle<Value> val)
+{
+  switch (type) {
+  case ELEM_I32:
+    return ObjectWrap::Unwrap<IntVec>(out)->set(i, val->Int32Value());
+  case ELEM_F32:
+    return ObjectWrap::Unwrap<FloatVec>(out)->set(i, val->NumberValue());
+  default:
+    return ObjectWrap::Unwrap<BitVec>(out)->set(i, val->BooleanValue());
+  }
+}
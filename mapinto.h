@@ -0,0 +1,34 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef MAPINTO_H
+#define MAPINTO_H
+
+#include <v8.h>
+#include <node.h>
+
+using namespace node;
+using namespace v8;
+
+/*
+ * Native outputs for mapInto() and transform().  The output argument is
+ * either an existing IntVec, FloatVec or BitVec, extended to at least the
+ * source length, or one of the type names "int", "float" or "bit" for a
+ * new vector; when it is undefined a new vector of the default type is
+ * made.  Types are the ELEM_ constants of kernels.h.
+ */
+
+// False, with an exception thrown, if the argument is not a vector or
+// type name or there is no memory for the output.
+bool map_output(Handle<Value> arg, int deflt, uint32_t len, Handle<Object> *out, int *type);
+
+// Storage of an output vector, ready to be written by the native kernels.
+void *map_data(Handle<Object> out, int type);
+
+// Store a callback result at i, converted as an indexed set would;
+// false if the output could not grow to hold it.
+bool map_store(Handle<Object> out, int type, uint32_t i, Handle<Value> val);
+
+#endif
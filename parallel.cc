@@ -0,0 +1,74 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+#define MAX_THREADS 64
+
+uint32_t
+parallel_threads()
+{
+  static uint32_t threads = 0;
+  if (threads == 0) {
+    const char *env = getenv("VEC_THREADS");
+    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    threads = n < 1 ? 1 : (n > MAX_THREADS ? MAX_THREADS : n);
+  }
+  return threads;
+}
+
+struct part_t {
+  parallel_fn fn;
+  void *ctx;
+  uint32_t part, start, end;
+};
+
+static void *
+run_part(void *arg)
+{
+  part_t *p = (part_t *) arg;
+  p->fn(p->ctx, p->part, p->start, p->end);
+  return 0;
+}
+
+void
+parallel_for(uint32_t n, uint32_t parts, parallel_fn fn, void *ctx)
+{
+  if (parts > MAX_THREADS) { parts = MAX_THREADS; }
+  if (parts > n) { parts = n; }
+  if (parts <= 1) {
+    fn(ctx, 0, 0, n);
+    return;
+  }
+
+  part_t part[MAX_THREADS];
+  pthread_t tid[MAX_THREADS];
+  bool started[MAX_THREADS];
+  uint32_t chunk = n / parts;
+  for (uint32_t i = 0; i < parts; ++i) {
+    part[i].fn = fn;
+    part[i].ctx = ctx;
+    part[i].part = i;
+    part[i].start = i * chunk;
+    part[i].end = (i == parts-1) ? n : (i+1) * chunk;
+  }
+
+  // If a thread can't be started, its slice just runs here instead.
+  for (uint32_t i = 1; i < parts; ++i) {
+    started[i] = pthread_create(&tid[i], 0, run_part, &part[i]) == 0;
+  }
+  run_part(&part[0]);
+  for (uint32_t i = 1; i < parts; ++i) {
+    if (started[i]) {
+      pthread_join(tid[i], 0);
+    } else {
+      run_part(&part[i]);
+    }
+  }
+}
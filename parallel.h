@@ -0,0 +1,24 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+/*
+ * A minimal fork/join helper for kernels over very large vectors.  The
+ * range [0,n) is cut into parts contiguous slices; part 0 runs on the
+ * calling thread and the rest on short-lived pthreads.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+typedef void (*parallel_fn)(void *ctx, uint32_t part, uint32_t start, uint32_t end);
+
+// Number of threads worth using: VEC_THREADS if set, else online CPUs.
+uint32_t parallel_threads();
+
+void parallel_for(uint32_t n, uint32_t parts, parallel_fn fn, void *ctx);
+
+#endif
@@ -0,0 +1,279 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+using namespace node;
+using namespace v8;
+
+#include "quantvec.h"
+#include "floatvec.h"
+#include "kernels.h"
+
+QuantizedVec::~QuantizedVec()
+{
+  if (vec) {
+    vec_free(MEM_QUANTVEC, vec, sizeof(int8_t) * length);
+    V8::AdjustAmountOfExternalAllocatedMemory(-sizeof(int8_t) * length);
+  }
+  vec_live(MEM_QUANTVEC, -1);
+}
+
+static Persistent<FunctionTemplate> s_ct;
+
+Handle<Value>
+QuantizedVec::New(const Arguments& args)
+{
+  HandleScope scope;
+  QuantizedVec* hw = new QuantizedVec();
+
+  // A FloatVec argument is quantized on construction.
+  if (args.Length() > 0) {
+    if (FloatVec::HasInstance(args[0])) {
+      FloatVec *fv = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+      hw->quantize(fv->data(), fv->size());
+    } else {
+      return ThrowException(Exception::TypeError(String::New("Argument must be a FloatVec")));
+    }
+  }
+
+  hw->Wrap(args.This());
+  return args.This();
+}
+
+void
+QuantizedVec::quantize(const float *src, uint32_t len)
+{
+  if (vec) {
+    vec_free(MEM_QUANTVEC, vec, sizeof(int8_t) * length);
+    V8::AdjustAmountOfExternalAllocatedMemory(-sizeof(int8_t) * length);
+    vec = 0;
+  }
+  length = len;
+  scale = offset = 0;
+  qsum = qsumsq = 0;
+  if (len == 0) { return; }
+
+  vec = (int8_t *) vec_alloc(MEM_QUANTVEC, len * sizeof(int8_t));
+  V8::AdjustAmountOfExternalAllocatedMemory(sizeof(int8_t) * len);
+
+  float lo = src[0], hi = src[0];
+  for (uint32_t i = 1; i < len; ++i) {
+    if (src[i] < lo) { lo = src[i]; }
+    if (src[i] > hi) { hi = src[i]; }
+  }
+
+  offset = lo + (hi - lo) / 2;
+  scale = (hi - lo) / 254;
+  float inv = scale > 0 ? 1 / scale : 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    long q = lrintf((src[i] - offset) * inv);
+    vec[i] = (int8_t) (q < -127 ? -127 : (q > 127 ? 127 : q));
+  }
+
+  qsum = sum_i8(vec, len);
+  qsumsq = sumsq_i8(vec, len);
+  //fprintf(stderr, "quantvec: %d elements, scale %g offset %g\n", len, scale, offset);
+}
+
+/*
+ * With a = sa*qa + oa and b = sb*qb + ob, the dot product expands to
+ *   sa*sb*sum(qa*qb) + sa*ob*sum(qa) + oa*sb*sum(qb) + n*oa*ob
+ * so only the first term needs a pass over the data.
+ */
+double
+QuantizedVec::dot(QuantizedVec *other)
+{
+  double qq = (double) dot_i8(vec, other->vec, length);
+  return (double) scale * other->scale * qq
+    + (double) scale * other->offset * qsum
+    + (double) offset * other->scale * other->qsum
+    + (double) length * offset * other->offset;
+}
+
+double
+QuantizedVec::norm2()
+{
+  return (double) scale * scale * qsumsq
+    + 2.0 * scale * offset * qsum
+    + (double) length * offset * offset;
+}
+
+/*
+ * The squared distance, from the differences rather than as
+ * norm2 + norm2 - 2*dot, which cancels catastrophically for nearby
+ * vectors far from the origin.  With s = (sa+sb)/2, d = (sa-sb)/2 and
+ * c = oa-ob, each element differs by s*(qa-qb) + d*(qa+qb) + c, and the
+ * sums of squares and products of those code terms are exact integers
+ * from the single dot_i8 pass.  What rounding is left is on terms as
+ * small as the difference itself.
+ */
+double
+QuantizedVec::dist2(QuantizedVec *other)
+{
+  int64_t qq = dot_i8(vec, other->vec, length);
+  double s = ((double) scale + other->scale) / 2;
+  double d = ((double) scale - other->scale) / 2;
+  double c = (double) offset - other->offset;
+  return s * s * (double) (qsumsq + other->qsumsq - 2*qq)
+    + d * d * (double) (qsumsq + other->qsumsq + 2*qq)
+    + (double) length * c * c
+    + 2 * s * d * (double) (qsumsq - other->qsumsq)
+    + 2 * s * c * (double) (qsum - other->qsum)
+    + 2 * d * c * (double) (qsum + other->qsum);
+}
+
+Handle<Value>
+QuantizedVec::Quantize(const Arguments& args)
+{
+  HandleScope scope;
+
+  if (args.Length() < 1 || ! FloatVec::HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a FloatVec")));
+  }
+
+  Handle<Value> argv[1] = { args[0] };
+  return scope.Close(s_ct->GetFunction()->NewInstance(1, argv));
+}
+
+Handle<Value>
+QuantizedVec::Dequantize(const Arguments& args)
+{
+  HandleScope scope;
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(args.This());
+
+  Handle<Object> ret = FloatVec::NewInstance(hw->length);
+  float *out = ObjectWrap::Unwrap<FloatVec>(ret)->data();
+  for (uint32_t i = 0; i < hw->length; ++i) {
+    out[i] = hw->get(i);
+  }
+
+  return scope.Close(ret);
+}
+
+// Unwrap the QuantizedVec argument of a binary operation, or return 0.
+static QuantizedVec *
+other_arg(const Arguments& args)
+{
+  if (args.Length() < 1 || ! args[0]->IsObject() || ! s_ct->HasInstance(args[0])) {
+    return 0;
+  }
+  return ObjectWrap::Unwrap<QuantizedVec>(args[0]->ToObject());
+}
+
+Handle<Value>
+QuantizedVec::Dot(const Arguments& args)
+{
+  HandleScope scope;
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(args.This());
+
+  QuantizedVec *other = other_arg(args);
+  if (! other) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a QuantizedVec")));
+  } else if (other->length != hw->length) {
+    return ThrowException(Exception::TypeError(String::New("Vectors must be the same length")));
+  }
+
+  return scope.Close(Number::New(hw->dot(other)));
+}
+
+Handle<Value>
+QuantizedVec::L2(const Arguments& args)
+{
+  HandleScope scope;
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(args.This());
+
+  QuantizedVec *other = other_arg(args);
+  if (! other) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a QuantizedVec")));
+  } else if (other->length != hw->length) {
+    return ThrowException(Exception::TypeError(String::New("Vectors must be the same length")));
+  }
+
+  // Rounding can still leave a tiny negative for identical vectors.
+  double d2 = hw->dist2(other);
+  return scope.Close(Number::New(d2 > 0 ? sqrt(d2) : 0));
+}
+
+Handle<Value>
+QuantizedVec::Cosine(const Arguments& args)
+{
+  HandleScope scope;
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(args.This());
+
+  QuantizedVec *other = other_arg(args);
+  if (! other) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a QuantizedVec")));
+  } else if (other->length != hw->length) {
+    return ThrowException(Exception::TypeError(String::New("Vectors must be the same length")));
+  }
+
+  double n2 = hw->norm2() * other->norm2();
+  return scope.Close(Number::New(n2 > 0 ? hw->dot(other) / sqrt(n2) : 0));
+}
+
+Handle<Value>
+QuantizedVec::GetLength(Local<String> property, const AccessorInfo& info)
+{
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(info.This());
+  return Integer::New(hw->length);
+}
+
+Handle<Value>
+QuantizedVec::GetScale(Local<String> property, const AccessorInfo& info)
+{
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(info.This());
+  return Number::New(hw->scale);
+}
+
+Handle<Value>
+QuantizedVec::GetOffset(Local<String> property, const AccessorInfo& info)
+{
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(info.This());
+  return Number::New(hw->offset);
+}
+
+/*
+ * Get the decoded value at [idx].  Out of range values return zero.
+ */
+Handle<Value>
+QuantizedVec::IndexGet(uint32_t idx, const AccessorInfo& info)
+{
+  VEC_COUNT(MEM_QUANTVEC, gets);
+  QuantizedVec* hw = ObjectWrap::Unwrap<QuantizedVec>(info.This());
+
+  return Number::New(idx >= hw->length ? 0 : hw->get(idx));
+}
+
+void
+QuantizedVec::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("QuantizedVec"));
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "dequantize", Dequantize);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "dot", Dot);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "l2", L2);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "cosine", Cosine);
+
+  s_ct->InstanceTemplate()->SetIndexedPropertyHandler(IndexGet);
+
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("length"), GetLength);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("scale"), GetScale);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("offset"), GetOffset);
+
+  target->Set(String::NewSymbol("QuantizedVec"), s_ct->GetFunction());
+  NODE_SET_METHOD(target, "quantize", Quantize);
+}
@@ -0,0 +1,70 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef QUANTVEC_H
+#define QUANTVEC_H
+
+#include <v8.h>
+#include <node.h>
+
+#include "vecmem.h"
+
+using namespace node;
+using namespace v8;
+
+/*
+ * A FloatVec scalar-quantized to one signed byte per element.  Each
+ * element is stored as q in [-127,127] and decodes as scale*q + offset,
+ * where offset is the midpoint of the source range and scale spreads
+ * that range over the 255 codes.
+ *
+ * Error bounds, with e = scale/2 the largest per-element decode error:
+ *   |x[i] - x'[i]|       <= e
+ *   |dot(a,b) - dot'|    <= ea*sum|b'[i]| + eb*sum|a'[i]| + n*ea*eb
+ *   |l2(a,b) - l2'|      <= sqrt(n)*(ea + eb)
+ * where x' is the decoded vector.  Cosine has no useful absolute bound
+ * near zero-norm vectors but inherits the relative dot error otherwise.
+ */
+class QuantizedVec: ObjectWrap
+{
+private:
+  uint32_t length;
+  float scale, offset;
+  int64_t qsum;    // Sum of the codes
+  int64_t qsumsq;  // Sum of the squared codes
+  int8_t *vec;
+
+public:
+
+  static void Init(Handle<Object> target);
+
+ QuantizedVec() : length(0), scale(0), offset(0), qsum(0), qsumsq(0), vec(0) { vec_live(MEM_QUANTVEC, 1); }
+  ~QuantizedVec();
+
+  // Prototype methods.
+  static Handle<Value> New(const Arguments& args);
+  static Handle<Value> Quantize(const Arguments& args);
+  static Handle<Value> Dequantize(const Arguments& args);
+
+  static Handle<Value> Dot(const Arguments& args);
+  static Handle<Value> L2(const Arguments& args);
+  static Handle<Value> Cosine(const Arguments& args);
+
+  // Getters
+  static Handle<Value> GetLength(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetScale(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetOffset(Local<String> property, const AccessorInfo& info);
+
+  static Handle<Value> IndexGet(uint32_t idx, const AccessorInfo& info);
+
+  // Internal manipulators
+  float get(uint32_t idx) { return scale * vec[idx] + offset; }
+  void quantize(const float *src, uint32_t len);
+  double dot(QuantizedVec *other);
+  double norm2();
+  double dist2(QuantizedVec *other);
+};
+
+#endif
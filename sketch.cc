@@ -0,0 +1,408 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+#include <node_buffer.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+using namespace node;
+using namespace v8;
+
+#include "sketch.h"
+#include "intvec.h"
+#include "floatvec.h"
+
+// Each compactor below the top is this fraction of the one above it.
+#define SKETCH_C (2.0/3.0)
+
+// Serialized form: "KLL1", k, n (64 bits), min, max, level count, then
+// for each level its item count followed by the items, all native endian.
+static const char SKETCH_MAGIC[] = "KLL1";
+
+static Persistent<FunctionTemplate> s_ct;
+
+QuantileSketch::QuantileSketch(uint32_t k)
+  : k(k), n(0), size(0), max_size(0), seed(2463534242u), min(0), max(0), cdf_valid(false)
+{
+  grow();
+}
+
+Handle<Value>
+QuantileSketch::New(const Arguments& args)
+{
+  HandleScope scope;
+  QuantileSketch* hw;
+
+  // An integer argument is k, a Buffer is a serialized sketch.
+  if (args.Length() > 0 && args[0]->IsUint32()) {
+    uint32_t k = args[0]->Uint32Value();
+    if (k < 8) {
+      return ThrowException(Exception::TypeError(String::New("k must be at least 8")));
+    }
+    hw = new QuantileSketch(k);
+  } else if (args.Length() > 0 && Buffer::HasInstance(args[0])) {
+    Local<Object> buf = args[0]->ToObject();
+    hw = new QuantileSketch();
+    if (! hw->deserialize(Buffer::Data(buf), Buffer::Length(buf))) {
+      delete hw;
+      return ThrowException(Exception::TypeError(String::New("Invalid QuantileSketch buffer")));
+    }
+  } else if (args.Length() > 0) {
+    return ThrowException(Exception::TypeError(String::New("Bad argument")));
+  } else {
+    hw = new QuantileSketch();
+  }
+
+  hw->Wrap(args.This());
+  return args.This();
+}
+
+uint32_t
+QuantileSketch::capacity(uint32_t h)
+{
+  uint32_t depth = levels.size() - h - 1;
+  return (uint32_t) ceil(pow(SKETCH_C, depth) * k) + 1;
+}
+
+void
+QuantileSketch::grow()
+{
+  levels.push_back(std::vector<float>());
+  max_size = 0;
+  for (uint32_t h = 0; h < levels.size(); ++h) {
+    max_size += capacity(h);
+  }
+}
+
+/*
+ * Compact the lowest full level: sort it and promote either the odd or
+ * the even items (chosen at random) to the level above.
+ */
+void
+QuantileSketch::compress()
+{
+  for (uint32_t h = 0; h < levels.size(); ++h) {
+    if (levels[h].size() >= capacity(h)) {
+      if (h+1 >= levels.size()) { grow(); }
+      std::vector<float> &lv = levels[h], &up = levels[h+1];
+
+      std::sort(lv.begin(), lv.end());
+      float last = 0;
+      bool odd = lv.size() % 2;
+      if (odd) { last = lv.back(); lv.pop_back(); }
+
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+      for (uint32_t i = seed & 1; i < lv.size(); i += 2) {
+        up.push_back(lv[i]);
+      }
+      size -= lv.size() / 2;
+      lv.clear();
+      if (odd) { lv.push_back(last); }
+      return;
+    }
+  }
+}
+
+void
+QuantileSketch::add(float x)
+{
+  if (x != x) { return; }
+  if (n == 0 || x < min) { min = x; }
+  if (n == 0 || x > max) { max = x; }
+
+  levels[0].push_back(x);
+  ++n; ++size;
+  cdf_valid = false;
+  if (size >= max_size) { compress(); }
+}
+
+void
+QuantileSketch::merge(QuantileSketch *other)
+{
+  if (other->n == 0) { return; }
+  while (levels.size() < other->levels.size()) { grow(); }
+
+  for (uint32_t h = 0; h < other->levels.size(); ++h) {
+    levels[h].insert(levels[h].end(), other->levels[h].begin(), other->levels[h].end());
+    size += other->levels[h].size();
+  }
+  if (n == 0 || other->min < min) { min = other->min; }
+  if (n == 0 || other->max > max) { max = other->max; }
+  n += other->n;
+  cdf_valid = false;
+
+  while (size >= max_size) { compress(); }
+}
+
+void
+QuantileSketch::buildCDF()
+{
+  if (cdf_valid) { return; }
+
+  cdf.clear();
+  cdf.reserve(size);
+  for (uint32_t h = 0; h < levels.size(); ++h) {
+    for (uint32_t i = 0; i < levels[h].size(); ++i) {
+      cdf.push_back(std::make_pair(levels[h][i], (uint64_t) 1 << h));
+    }
+  }
+  std::sort(cdf.begin(), cdf.end());
+
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < cdf.size(); ++i) {
+    total += cdf[i].second;
+    cdf[i].second = total;
+  }
+  cdf_valid = true;
+}
+
+double
+QuantileSketch::quantile(double p)
+{
+  if (n == 0) { return 0; }
+  if (p <= 0) { return min; }
+  if (p >= 1) { return max; }
+
+  buildCDF();
+  double total = (double) cdf.back().second, want = p * total;
+  uint32_t lo = 0, hi = cdf.size() - 1;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo)/2;
+    if (cdf[mid].second < want) { lo = mid+1; } else { hi = mid; }
+  }
+  return cdf[lo].first;
+}
+
+/*
+ * Estimated fraction of the inputs <= x.
+ */
+double
+QuantileSketch::rank(double x)
+{
+  if (n == 0) { return 0; }
+
+  buildCDF();
+  uint32_t lo = 0, hi = cdf.size();
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo)/2;
+    if (cdf[mid].first <= x) { lo = mid+1; } else { hi = mid; }
+  }
+  return lo == 0 ? 0 : (double) cdf[lo-1].second / cdf.back().second;
+}
+
+size_t
+QuantileSketch::serializedLength()
+{
+  return 4 + sizeof(uint32_t) + sizeof(uint64_t) + 2*sizeof(float) + sizeof(uint32_t)
+    + levels.size() * sizeof(uint32_t) + size * sizeof(float);
+}
+
+void
+QuantileSketch::serialize(char *buf)
+{
+  char *p = buf;
+  uint32_t nlevels = levels.size();
+
+  memcpy(p, SKETCH_MAGIC, 4); p += 4;
+  memcpy(p, &k, sizeof(k)); p += sizeof(k);
+  memcpy(p, &n, sizeof(n)); p += sizeof(n);
+  memcpy(p, &min, sizeof(min)); p += sizeof(min);
+  memcpy(p, &max, sizeof(max)); p += sizeof(max);
+  memcpy(p, &nlevels, sizeof(nlevels)); p += sizeof(nlevels);
+  for (uint32_t h = 0; h < nlevels; ++h) {
+    uint32_t len = levels[h].size();
+    memcpy(p, &len, sizeof(len)); p += sizeof(len);
+    if (len) { memcpy(p, &levels[h][0], len * sizeof(float)); p += len * sizeof(float); }
+  }
+}
+
+bool
+QuantileSketch::deserialize(const char *buf, size_t buflen)
+{
+  const char *p = buf, *end = buf + buflen;
+  uint32_t nlevels;
+
+  if (buflen < 4 + 3*sizeof(uint32_t) + sizeof(uint64_t) + 2*sizeof(float)) { return false; }
+  if (memcmp(p, SKETCH_MAGIC, 4) != 0) { return false; }
+  p += 4;
+  memcpy(&k, p, sizeof(k)); p += sizeof(k);
+  memcpy(&n, p, sizeof(n)); p += sizeof(n);
+  memcpy(&min, p, sizeof(min)); p += sizeof(min);
+  memcpy(&max, p, sizeof(max)); p += sizeof(max);
+  memcpy(&nlevels, p, sizeof(nlevels)); p += sizeof(nlevels);
+  if (k < 8 || nlevels == 0 || nlevels > 64) { return false; }
+
+  levels.clear();
+  size = 0;
+  for (uint32_t h = 0; h < nlevels; ++h) {
+    grow();
+    uint32_t len;
+    if (end - p < (ptrdiff_t) sizeof(len)) { return false; }
+    memcpy(&len, p, sizeof(len)); p += sizeof(len);
+    if ((size_t) (end - p) < len * sizeof(float)) { return false; }
+    levels[h].resize(len);
+    if (len) { memcpy(&levels[h][0], p, len * sizeof(float)); p += len * sizeof(float); }
+    size += len;
+  }
+  cdf_valid = false;
+  return true;
+}
+
+/*
+ * Add a number, an Array of numbers, or every element of an IntVec or
+ * FloatVec.
+ */
+Handle<Value>
+QuantileSketch::Add(const Arguments& args)
+{
+  HandleScope scope;
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(args.This());
+
+  if (args.Length() < 1) {
+    return ThrowException(Exception::TypeError(String::New("Must provide a value to add")));
+  }
+
+  if (args[0]->IsNumber()) {
+    hw->add(args[0]->NumberValue());
+  } else if (FloatVec::HasInstance(args[0])) {
+    FloatVec *fv = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+    const float *src = fv->data();
+    for (uint32_t i = 0; i < fv->size(); ++i) { hw->add(src[i]); }
+  } else if (IntVec::HasInstance(args[0])) {
+    IntVec *iv = ObjectWrap::Unwrap<IntVec>(args[0]->ToObject());
+    const int32_t *src = iv->data();
+    for (uint32_t i = 0; i < iv->size(); ++i) { hw->add(src[i]); }
+  } else if (args[0]->IsArray()) {
+    Local<Array> arr = Local<Array>::Cast(args[0]);
+    for (uint32_t i = 0; i < arr->Length(); ++i) { hw->add(arr->Get(i)->NumberValue()); }
+  } else {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a number, Array, IntVec or FloatVec")));
+  }
+
+  return scope.Close(args.This());
+}
+
+Handle<Value>
+QuantileSketch::Merge(const Arguments& args)
+{
+  HandleScope scope;
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsObject() || ! s_ct->HasInstance(args[0])) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a QuantileSketch")));
+  }
+
+  QuantileSketch *other = ObjectWrap::Unwrap<QuantileSketch>(args[0]->ToObject());
+  if (other != hw) { hw->merge(other); }
+  return scope.Close(args.This());
+}
+
+/*
+ * Estimated quantile for a single p, or a FloatVec of them for an Array
+ * or FloatVec of ps.
+ */
+Handle<Value>
+QuantileSketch::Quantile(const Arguments& args)
+{
+  HandleScope scope;
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(args.This());
+
+  if (args.Length() >= 1 && args[0]->IsNumber()) {
+    return scope.Close(Number::New(hw->quantile(args[0]->NumberValue())));
+  } else if (args.Length() >= 1 && args[0]->IsArray()) {
+    Local<Array> arr = Local<Array>::Cast(args[0]);
+    Handle<Object> ret = FloatVec::NewInstance(arr->Length());
+    float *out = ObjectWrap::Unwrap<FloatVec>(ret)->data();
+    for (uint32_t j = 0; j < arr->Length(); ++j) {
+      out[j] = hw->quantile(arr->Get(j)->NumberValue());
+    }
+    return scope.Close(ret);
+  } else if (args.Length() >= 1 && FloatVec::HasInstance(args[0])) {
+    FloatVec *ps = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+    Handle<Object> ret = FloatVec::NewInstance(ps->size());
+    float *out = ObjectWrap::Unwrap<FloatVec>(ret)->data();
+    for (uint32_t j = 0; j < ps->size(); ++j) {
+      out[j] = hw->quantile(ps->data()[j]);
+    }
+    return scope.Close(ret);
+  }
+
+  return ThrowException(Exception::TypeError(String::New("Argument must be a number, Array or FloatVec")));
+}
+
+Handle<Value>
+QuantileSketch::Rank(const Arguments& args)
+{
+  HandleScope scope;
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsNumber()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a number")));
+  }
+
+  return scope.Close(Number::New(hw->rank(args[0]->NumberValue())));
+}
+
+Handle<Value>
+QuantileSketch::Serialize(const Arguments& args)
+{
+  HandleScope scope;
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(args.This());
+
+  Buffer *buf = Buffer::New(hw->serializedLength());
+  hw->serialize(Buffer::Data(buf->handle_));
+  return scope.Close(buf->handle_);
+}
+
+Handle<Value>
+QuantileSketch::GetCount(Local<String> property, const AccessorInfo& info)
+{
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(info.This());
+  return Number::New((double) hw->n);
+}
+
+Handle<Value>
+QuantileSketch::GetMin(Local<String> property, const AccessorInfo& info)
+{
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(info.This());
+  return Number::New(hw->min);
+}
+
+Handle<Value>
+QuantileSketch::GetMax(Local<String> property, const AccessorInfo& info)
+{
+  QuantileSketch* hw = ObjectWrap::Unwrap<QuantileSketch>(info.This());
+  return Number::New(hw->max);
+}
+
+void
+QuantileSketch::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("QuantileSketch"));
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "add", Add);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "merge", Merge);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "quantile", Quantile);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "rank", Rank);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "serialize", Serialize);
+
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("count"), GetCount);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("min"), GetMin);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("max"), GetMax);
+
+  target->Set(String::NewSymbol("QuantileSketch"), s_ct->GetFunction());
+}
@@ -0,0 +1,73 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <v8.h>
+#include <node.h>
+
+#include <vector>
+
+using namespace node;
+using namespace v8;
+
+/*
+ * A mergeable streaming quantile sketch (KLL).  Items live in a stack of
+ * compactors; an item at level h stands for 2^h inputs.  When a level
+ * fills up it is sorted and every other item is promoted, so memory
+ * stays O(k log(n/k)) and the rank error is about 1.7/k with high
+ * probability.  Sketches can be merged and serialized to a Buffer.
+ */
+class QuantileSketch: ObjectWrap
+{
+private:
+  uint32_t k;         // Capacity of the top compactor
+  uint64_t n;         // Number of items added
+  uint32_t size;      // Number of items retained
+  uint32_t max_size;  // Retained items that trigger a compaction
+  uint32_t seed;      // xorshift state for choosing compaction offsets
+  float min, max;
+  std::vector< std::vector<float> > levels;
+
+  // Sorted (value, cumulative weight) table for queries, rebuilt lazily.
+  std::vector< std::pair<float, uint64_t> > cdf;
+  bool cdf_valid;
+
+public:
+
+  static void Init(Handle<Object> target);
+
+  QuantileSketch(uint32_t k = 200);
+  ~QuantileSketch() {}
+
+  // Prototype methods.
+  static Handle<Value> New(const Arguments& args);
+  static Handle<Value> Add(const Arguments& args);
+  static Handle<Value> Merge(const Arguments& args);
+  static Handle<Value> Quantile(const Arguments& args);
+  static Handle<Value> Rank(const Arguments& args);
+  static Handle<Value> Serialize(const Arguments& args);
+
+  // Getters
+  static Handle<Value> GetCount(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetMin(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetMax(Local<String> property, const AccessorInfo& info);
+
+  // Internal manipulators
+  void add(float x);
+  void merge(QuantileSketch *other);
+  double quantile(double p);
+  double rank(double x);
+  uint32_t capacity(uint32_t h);
+  void grow();
+  void compress();
+  void buildCDF();
+  size_t serializedLength();
+  void serialize(char *buf);
+  bool deserialize(const char *buf, size_t len);
+};
+
+#endif
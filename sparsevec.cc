@@ -0,0 +1,421 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <v8.h>
+#include <node.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace node;
+using namespace v8;
+
+#include "sparsevec.h"
+#include "intvec.h"
+#include "floatvec.h"
+
+SparseFloatVec::~SparseFloatVec()
+{
+  if (idx) {
+    vec_free(MEM_SPARSEVEC, idx, sizeof(uint32_t) * buflen);
+    vec_free(MEM_SPARSEVEC, val, sizeof(float) * buflen);
+    V8::AdjustAmountOfExternalAllocatedMemory(-(sizeof(uint32_t) + sizeof(float)) * buflen);
+  }
+  vec_live(MEM_SPARSEVEC, -1);
+}
+
+static Persistent<FunctionTemplate> s_ct;
+
+bool
+SparseFloatVec::HasInstance(Handle<Value> val)
+{
+  return val->IsObject() && s_ct->HasInstance(val);
+}
+
+Handle<Object>
+SparseFloatVec::NewInstance(Handle<Value> arg)
+{
+  HandleScope scope;
+  Handle<Value> argv[1] = { arg };
+  return scope.Close(s_ct->GetFunction()->NewInstance(1, argv));
+}
+
+Handle<Value>
+SparseFloatVec::New(const Arguments& args)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = new SparseFloatVec();
+
+  // An integer argument is the initial length, a FloatVec is converted.
+  if (args.Length() > 0) {
+    if (args[0]->IsInt32()) {
+      int32_t len = args[0]->Int32Value();
+      if (len < 0) {
+        return ThrowException(Exception::TypeError(String::New("Bad argument")));
+      }
+      hw->length = len;
+    } else if (FloatVec::HasInstance(args[0])) {
+      FloatVec *fv = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+      hw->fromDense(fv->data(), fv->size());
+    } else if (args[0]->IsString()) {
+      if (hw->setString(Local<String>::Cast(args[0])) < 0) {
+        return ThrowException(Exception::TypeError(String::New("Invalid SparseFloatVec string")));
+      }
+    } else {
+      return ThrowException(Exception::TypeError(String::New("Bad argument")));
+    }
+  }
+
+  hw->Wrap(args.This());
+  return args.This();
+}
+
+Handle<Value>
+SparseFloatVec::GetLength(Local<String> property, const AccessorInfo& info)
+{
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+  return Integer::NewFromUnsigned(hw->length);
+}
+
+Handle<Value>
+SparseFloatVec::GetNNZ(Local<String> property, const AccessorInfo& info)
+{
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+  return Integer::NewFromUnsigned(hw->nnz);
+}
+
+Handle<Value>
+SparseFloatVec::GetIndices(Local<String> property, const AccessorInfo& info)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+
+  Handle<Object> ret = IntVec::NewInstance(hw->nnz);
+  memcpy(ObjectWrap::Unwrap<IntVec>(ret)->data(), hw->idx, hw->nnz * sizeof(int32_t));
+  return scope.Close(ret);
+}
+
+Handle<Value>
+SparseFloatVec::GetValues(Local<String> property, const AccessorInfo& info)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+
+  Handle<Object> ret = FloatVec::NewInstance(hw->nnz);
+  memcpy(ObjectWrap::Unwrap<FloatVec>(ret)->data(), hw->val, hw->nnz * sizeof(float));
+  return scope.Close(ret);
+}
+
+Handle<Value>
+SparseFloatVec::GetJSON(Local<String> property, const AccessorInfo& info)
+{
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+
+  return hw->toString(true);
+}
+
+/*
+ * Position of the first stored index >= i, which is nnz if there is none.
+ */
+uint32_t
+SparseFloatVec::find(uint32_t i)
+{
+  if (nnz == 0 || idx[nnz-1] < i) { return nnz; }
+
+  uint32_t lo = 0, hi = nnz;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo)/2;
+    if (idx[mid] < i) { lo = mid+1; } else { hi = mid; }
+  }
+  return lo;
+}
+
+float
+SparseFloatVec::get(uint32_t i)
+{
+  uint32_t k = find(i);
+  return (k < nnz && idx[k] == i) ? val[k] : 0;
+}
+
+float
+SparseFloatVec::set(uint32_t i, float value)
+{
+  uint32_t k = find(i);
+  if (k < nnz && idx[k] == i) {
+    if (value) {
+      val[k] = value;
+    } else {
+      memmove(idx+k, idx+k+1, (nnz-k-1) * sizeof(uint32_t));
+      memmove(val+k, val+k+1, (nnz-k-1) * sizeof(float));
+      --nnz;
+    }
+  } else if (value) {
+    reserve(nnz+1);
+    memmove(idx+k+1, idx+k, (nnz-k) * sizeof(uint32_t));
+    memmove(val+k+1, val+k, (nnz-k) * sizeof(float));
+    idx[k] = i;
+    val[k] = value;
+    ++nnz;
+    if (i >= length) { length = i+1; }
+  }
+  return value;
+}
+
+void
+SparseFloatVec::reserve(uint32_t n) {
+  uint32_t new_buflen = n;
+
+  if (new_buflen <= buflen) {
+    return;
+  } else if (new_buflen < 5*buflen/4) {
+    new_buflen = 5*buflen/4;
+  }
+
+  idx = (uint32_t *) vec_realloc(MEM_SPARSEVEC, idx, buflen * sizeof(uint32_t),
+                                 new_buflen * sizeof(uint32_t));
+  val = (float *) vec_realloc(MEM_SPARSEVEC, val, buflen * sizeof(float),
+                              new_buflen * sizeof(float));
+
+  //fprintf(stderr, "sparsevec: reserve %d -> %d\n", buflen, new_buflen);
+  V8::AdjustAmountOfExternalAllocatedMemory((sizeof(uint32_t) + sizeof(float)) * (new_buflen - buflen));
+  buflen = new_buflen;
+}
+
+void
+SparseFloatVec::fromDense(const float *src, uint32_t len)
+{
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    if (src[i]) { ++count; }
+  }
+
+  nnz = 0;
+  reserve(count);
+  for (uint32_t i = 0; i < len; ++i) {
+    if (src[i]) {
+      idx[nnz] = i;
+      val[nnz++] = src[i];
+    }
+  }
+  length = len;
+}
+
+/*
+ * Parse "index:value" pairs separated by commas, in any order, after an
+ * optional "length;" as written by toString().  Without one the length
+ * is one past the highest index.  Returns 0, or -1 if the string is
+ * malformed or has an index outside the length.
+ */
+int
+SparseFloatVec::setString(Local<String> str) {
+  int len = str->Utf8Length();
+  char *data = (char *) malloc(len+1);
+  str->WriteUtf8(data, len+1);
+
+  const char *p = data;
+  if (strncmp(p, "SparseFloatVec[", 15) == 0) { p += 15; }
+
+  uint32_t n;
+  int used = 0;
+  bool sized = sscanf(p, "%u;%n", &n, &used) >= 1 && used > 0;
+  if (sized) {
+    if (n > 0x7fffffffu) { free(data); return -1; }
+    length = n;
+    p += used;
+  }
+
+  uint32_t i;
+  float v;
+  while (*p && *p != ']') {
+    if (sscanf(p, "%u:%f", &i, &v) < 2) { free(data); return -1; }
+    if (sized ? i >= length : i >= 0x7fffffffu) { free(data); return -1; }
+    set(i, v);
+    if (i >= length) { length = i+1; }
+    if (! (p = index(p, ','))) { break; }
+    ++p;
+  }
+
+  free(data);
+  return 0;
+}
+
+/*
+ * "length;index:value,..." with each value to 9 significant digits, so
+ * that new SparseFloatVec(v.toString()) is exactly v.
+ */
+Handle<Value>
+SparseFloatVec::toString(bool json)
+{
+  Local<String> sep = String::NewSymbol(",");
+  Local<String> rep = json ? String::New("SparseFloatVec[") : String::New("");
+
+  char buffer[32];
+  sprintf(buffer, "%u;", length);
+  rep = String::Concat(rep, String::New(buffer));
+  for (uint32_t k = 0; k < nnz; ++k) {
+    if (k > 0) { rep = String::Concat(rep, sep); }
+    sprintf(buffer, "%u:%.9g", idx[k], val[k]);
+    rep = String::Concat(rep, String::New(buffer));
+  }
+  if (json) { rep = String::Concat(rep, String::New("]")); }
+  return rep;
+}
+
+Handle<Value>
+SparseFloatVec::ToString(const Arguments& args)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(args.This());
+
+  return scope.Close(hw->toString());
+}
+
+Handle<Value>
+SparseFloatVec::ToFloatVec(const Arguments& args)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(args.This());
+
+  Handle<Object> ret = FloatVec::NewInstance(hw->length);
+  float *out = ObjectWrap::Unwrap<FloatVec>(ret)->data();
+  for (uint32_t k = 0; k < hw->nnz; ++k) {
+    out[hw->idx[k]] = hw->val[k];
+  }
+
+  return scope.Close(ret);
+}
+
+double
+SparseFloatVec::dot(const float *dense, uint32_t len)
+{
+  double sum = 0;
+  for (uint32_t k = 0; k < nnz && idx[k] < len; ++k) {
+    sum += val[k] * dense[idx[k]];
+  }
+  return sum;
+}
+
+/*
+ * Merge join over the two sorted index lists.
+ */
+double
+SparseFloatVec::dot(SparseFloatVec *other)
+{
+  double sum = 0;
+  uint32_t i = 0, j = 0;
+  while (i < nnz && j < other->nnz) {
+    uint32_t a = idx[i], b = other->idx[j];
+    if (a == b) {
+      sum += val[i++] * other->val[j++];
+    } else if (a < b) {
+      ++i;
+    } else {
+      ++j;
+    }
+  }
+  return sum;
+}
+
+Handle<Value>
+SparseFloatVec::Dot(const Arguments& args)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(args.This());
+
+  if (args.Length() >= 1 && HasInstance(args[0])) {
+    SparseFloatVec *other = ObjectWrap::Unwrap<SparseFloatVec>(args[0]->ToObject());
+    return scope.Close(Number::New(hw->dot(other)));
+  } else if (args.Length() >= 1 && FloatVec::HasInstance(args[0])) {
+    FloatVec *fv = ObjectWrap::Unwrap<FloatVec>(args[0]->ToObject());
+    return scope.Close(Number::New(hw->dot(fv->data(), fv->size())));
+  }
+
+  return ThrowException(Exception::TypeError(String::New("Argument must be a FloatVec or SparseFloatVec")));
+}
+
+/*
+ * Get the value at [idx] of this vector.  Absent values return zero.
+ */
+Handle<Value>
+SparseFloatVec::IndexGet(uint32_t idx, const AccessorInfo& info)
+{
+  VEC_COUNT(MEM_SPARSEVEC, gets);
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+
+  return Number::New(hw->get(idx));
+}
+
+/*
+ * Set the value at [idx].  Non-zero values past the end extend the
+ * vector; zero values remove the element.
+ */
+Handle<Value>
+SparseFloatVec::IndexSet(uint32_t idx, Local<Value> value, const AccessorInfo& info)
+{
+  VEC_COUNT(MEM_SPARSEVEC, sets);
+  // As in setString: the length must stay within a FloatVec's.
+  if (idx >= 0x7fffffffu) {
+    return ThrowException(Exception::TypeError(String::New("Index out of range")));
+  }
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(info.This());
+
+  hw->set(idx, value->NumberValue());
+  return value;
+}
+
+/*
+ * Iterate over the stored (non-zero) elements only.
+ */
+Handle<Value>
+SparseFloatVec::ForEach(const Arguments& args)
+{
+  HandleScope scope;
+  SparseFloatVec* hw = ObjectWrap::Unwrap<SparseFloatVec>(args.This());
+
+  if (args.Length() < 1 || ! args[0]->IsFunction()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a function")));
+  }
+
+  Local<Function> cb = Local<Function>::Cast(args[0]);
+  Handle<Object> global = Context::GetCurrent()->Global();
+
+  Local<Value> argv[2];
+  for (uint32_t k = 0; k < hw->nnz; ++k) {
+    argv[0] = Number::New(hw->val[k]);
+    argv[1] = Integer::NewFromUnsigned(hw->idx[k]);
+    VEC_COUNT(MEM_SPARSEVEC, callbacks);
+    cb->Call(global, 2, argv);
+  }
+
+  return scope.Close(args.This());
+}
+
+void
+SparseFloatVec::Init(Handle<Object> target)
+{
+  HandleScope scope;
+
+  Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+  s_ct = Persistent<FunctionTemplate>::New(t);
+  s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+  s_ct->SetClassName(String::NewSymbol("SparseFloatVec"));
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toString", ToString);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "toFloatVec", ToFloatVec);
+
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "forEach", ForEach);
+  NODE_SET_PROTOTYPE_METHOD(s_ct, "dot", Dot);
+
+  s_ct->InstanceTemplate()->SetIndexedPropertyHandler(IndexGet, IndexSet);
+
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("length"), GetLength);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("nnz"), GetNNZ);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("indices"), GetIndices);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("values"), GetValues);
+  s_ct->InstanceTemplate()->SetAccessor(String::NewSymbol("JSON"), GetJSON);
+
+  target->Set(String::NewSymbol("SparseFloatVec"), s_ct->GetFunction());
+}
@@ -0,0 +1,70 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#ifndef SPARSEVEC_H
+#define SPARSEVEC_H
+
+#include <v8.h>
+#include <node.h>
+
+#include "vecmem.h"
+
+using namespace node;
+using namespace v8;
+
+/*
+ * A FloatVec that only stores its non-zero elements, as parallel arrays
+ * of strictly increasing indices and their values.  Absent elements read
+ * as zero and setting an element to zero removes it.
+ */
+class SparseFloatVec: ObjectWrap
+{
+private:
+  uint32_t length;  // Logical (dense) length
+  uint32_t nnz;     // Number of stored elements
+  uint32_t buflen;  // Capacity of idx and val
+  uint32_t *idx;
+  float *val;
+
+public:
+
+  static void Init(Handle<Object> target);
+  static bool HasInstance(Handle<Value> val);
+  static Handle<Object> NewInstance(Handle<Value> arg);
+
+ SparseFloatVec() : length(0), nnz(0), buflen(0), idx(0), val(0) { vec_live(MEM_SPARSEVEC, 1); }
+  ~SparseFloatVec();
+
+  // Prototype methods.
+  static Handle<Value> New(const Arguments& args);
+  static Handle<Value> ToString(const Arguments& args);
+  static Handle<Value> ToFloatVec(const Arguments& args);
+
+  static Handle<Value> ForEach(const Arguments& args);
+  static Handle<Value> Dot(const Arguments& args);
+
+  // Getters
+  static Handle<Value> GetLength(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetNNZ(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetIndices(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetValues(Local<String> property, const AccessorInfo& info);
+  static Handle<Value> GetJSON(Local<String> property, const AccessorInfo& info);
+
+  static Handle<Value> IndexGet(uint32_t idx, const AccessorInfo& info);
+  static Handle<Value> IndexSet(uint32_t idx, Local<Value> val, const AccessorInfo& info);
+
+  // Internal manipulators
+  uint32_t find(uint32_t i);
+  float get(uint32_t i);
+  float set(uint32_t i, float v);
+  void reserve(uint32_t n);
+  void fromDense(const float *src, uint32_t len);
+  int setString(Local<String> str);
+  Handle<Value> toString(bool json = false);
+  double dot(const float *dense, uint32_t len);
+  double dot(SparseFloatVec *other);
+};
+
+#endif
@@ -0,0 +1,153 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+/*
+ * Order statistics shared by IntVec and FloatVec.  Like kernels.h these
+ * know nothing about V8.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <algorithm>
+
+#include "kernels.h"
+
+/*
+ * Count the values of src falling in each of bins equal-width bins over
+ * [lo,hi].  hi itself goes in the last bin; values outside the range
+ * (and NaNs) are not counted.
+ */
+template <class T>
+void histogram(const T *src, uint32_t n, uint32_t bins, double lo, double hi, int32_t *counts)
+{
+  if (bins == 0 || !(hi >= lo)) { return; }
+  double scale = hi > lo ? bins / (hi - lo) : 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    double x = src[i];
+    if (x >= lo && x <= hi) {
+      uint32_t b = (uint32_t) ((x - lo) * scale);
+      counts[b < bins ? b : bins-1]++;
+    }
+  }
+}
+
+// The range of the values of src, skipping NaNs; 0 to 0 if there are none.
+template <class T>
+void minmax(const T *src, uint32_t n, double *lo, double *hi)
+{
+  uint32_t i = 0;
+  while (i < n && src[i] != src[i]) { ++i; }
+  if (i == n) { *lo = *hi = 0; return; }
+  T l = src[i], h = src[i];
+  for (++i; i < n; ++i) {
+    if (src[i] < l) { l = src[i]; }
+    if (src[i] > h) { h = src[i]; }
+  }
+  *lo = l; *hi = h;
+}
+
+/*
+ * Exact quantiles of the n values in work, which is reordered.  Each
+ * p, which must be finite, is clamped to [0,1] and linearly interpolated
+ * between the order statistics at floor((n-1)*p) and the one after it.
+ * The ps are handled in increasing order so that each selection only
+ * partitions what is left of the range above the previous one.
+ */
+template <class T>
+void quantiles(T *work, uint32_t n, const double *ps, uint32_t m, double *out)
+{
+  uint32_t *order = new uint32_t[m];
+  for (uint32_t j = 0; j < m; ++j) { order[j] = j; }
+  for (uint32_t j = 1; j < m; ++j) {
+    uint32_t o = order[j], i = j;
+    for (; i > 0 && ps[order[i-1]] > ps[o]; --i) { order[i] = order[i-1]; }
+    order[i] = o;
+  }
+
+  uint32_t start = 0;
+  for (uint32_t j = 0; j < m; ++j) {
+    double p = ps[order[j]];
+    if (n == 0) { out[order[j]] = 0; continue; }
+    if (p < 0) { p = 0; } else if (p > 1) { p = 1; }
+
+    double h = (n - 1) * p;
+    uint32_t k = (uint32_t) h;
+    std::nth_element(work + start, work + k, work + n);
+    double v = work[k];
+    if (k + 1 < n && h > k) {
+      double next = *std::min_element(work + k + 1, work + n);
+      v += (h - k) * (next - v);
+    }
+    out[order[j]] = v;
+    start = k;
+  }
+
+  delete[] order;
+}
+
+// Orders indices of src from best to worst: by value, larger or smaller
+// first, with ties and then NaNs last.
+template <class T>
+struct Ranking {
+  const T *src;
+  bool largest;
+  Ranking(const T *src, bool largest) : src(src), largest(largest) {}
+  bool operator()(uint32_t i, uint32_t j) const {
+    T a = src[i], b = src[j];
+    bool a_nan = a != a, b_nan = b != b;
+    if (a_nan != b_nan) { return b_nan; }
+    if (! a_nan && a != b) { return largest ? a > b : a < b; }
+    return i < j;
+  }
+};
+
+static inline uint32_t find_from(const int32_t *a, uint32_t from, uint32_t n, int op, int32_t t) { return find_i32(a, from, n, op, t); }
+static inline uint32_t find_from(const float *a, uint32_t from, uint32_t n, int op, float t) { return find_f32(a, from, n, op, t); }
+
+/*
+ * The indices of the k largest (or smallest) values, best first, with
+ * ties going to the lower index; NaNs are never chosen.  Returns how
+ * many were found.  A heap of the best so far, worst on top, sets a
+ * threshold that the vector scan of find_i32/find_f32 skips to the next
+ * element beating, so once it settles the selection is one linear pass.
+ */
+template <class T>
+uint32_t top_k(const T *src, uint32_t n, uint32_t k, bool largest, uint32_t *out)
+{
+  Ranking<T> better(src, largest);
+  uint32_t m = 0, i = 0;
+  for (; i < n && m < k; ++i) {
+    if (src[i] == src[i]) { out[m++] = i; }
+  }
+  std::make_heap(out, out + m, better);
+
+  if (m == k && k > 0) {
+    int op = largest ? CMP_GT : CMP_LT;
+    while ((i = find_from(src, i, n, op, src[out[0]])) < n) {
+      std::pop_heap(out, out + k, better);
+      out[k-1] = i++;
+      std::push_heap(out, out + k, better);
+    }
+  }
+
+  std::sort_heap(out, out + m, better);
+  return m;
+}
+
+/*
+ * Reorder the indices 0..n-1 in idx so that idx[k] is the index of the
+ * value that would be k-th in increasing order, those before it index
+ * values no greater and those after it values no smaller; NaNs sort last.
+ */
+template <class T>
+void argpartition(const T *src, uint32_t n, uint32_t k, uint32_t *idx)
+{
+  for (uint32_t i = 0; i < n; ++i) { idx[i] = i; }
+  if (k < n) { std::nth_element(idx, idx + k, idx + n, Ranking<T>(src, false)); }
+}
+
+#endif
@@ -0,0 +1,71 @@
+var vows = require("vows"), assert = require('assert');
+var vec = require("../build/default/vec");
+
+var suite = vows.describe("BitmapIndex");
+
+suite.addBatch({
+  'a bitmapindex': {
+    topic: function() {
+      // Mostly 0, with a few rows of 1..3 scattered through 20000.
+      var col = new vec.IntVec(20000);
+      for (var i = 0; i < 20000; i += 100) { col[i] = 1 + (i/100) % 3; }
+      return { col: col, index: new vec.BitmapIndex(col) };
+    },
+
+    'holds the distinct values': function(t) {
+      assert.equal(t.index.length, 20000);
+      assert.equal(t.index.size, 4);
+      assert.equal(t.index.values.toString(), "0,1,2,3");
+    },
+
+    'gets the rows of a value': function(t) {
+      var rows = t.index.get(2);
+      assert.equal(rows.length, 20000);
+      assert.equal(rows.count(), 67);
+      assert.isTrue(rows[100]);
+      assert.isFalse(rows[200]);
+      assert.equal(t.index.get(7).count(), 0);
+    },
+
+    'counts without building the result': function(t) {
+      assert.equal(t.index.count(0), 19800);
+      assert.equal(t.index.count([1, 2]), 134);
+      assert.equal(t.index.count({not: 0}), 200);
+      assert.equal(t.index.count({and: [{not: 1}, {not: 0}]}), 133);
+      assert.equal(t.index.count({and: [1, 2]}), 0);
+      assert.equal(t.index.count({or: []}), 0);
+      assert.equal(t.index.count({and: []}), 20000);
+    },
+
+    'queries match counts': function(t) {
+      var q = {or: [3, {and: [{not: 0}, {not: 3}]}]};
+      var rows = t.index.query(q);
+      assert.equal(rows.count(), t.index.count(q));
+      assert.equal(rows.count(), 200);
+      assert.isFalse(rows[1]);
+    },
+
+    'rejects bad queries': function(t) {
+      assert.throws(function() { t.index.count("0"); }, TypeError);
+      assert.throws(function() { t.index.count({xor: [1]}); }, TypeError);
+      assert.throws(function() { new vec.BitmapIndex([1, 2]); }, TypeError);
+    },
+
+    'rejects cyclic and deeply nested queries': function(t) {
+      var q = {not: 0};
+      q.not = q;
+      assert.throws(function() { t.index.query(q); }, TypeError);
+      var a = [];
+      a.push(a);
+      assert.throws(function() { t.index.count(a); }, TypeError);
+      var deep = 0;
+      for (var i = 0; i < 100000; ++i) { deep = {not: deep}; }
+      assert.throws(function() { t.index.count(deep); }, TypeError);
+      var ok = 0;
+      for (var i = 0; i < 256; ++i) { ok = {not: ok}; }
+      assert.equal(t.index.count(ok), 19800);
+    }
+  }
+});
+
+suite.export(module);
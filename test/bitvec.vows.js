@@ -59,6 +59,18 @@ suite.addBatch({
       assert.isFalse(bitvec[0]);
       assert.isFalse(bitvec[1000]);
       assert.isUndefined(bitvec[-1]);
+    },
+
+    'on set past the length': {
+      topic: function(bitvec) {
+        bitvec[120] = true;
+        return bitvec;
+      },
+
+      'grows and reads back': function(bitvec) {
+        assert.equal(bitvec.length, 121);
+        assert.isTrue(bitvec[120]);
+      }
     }
   }
 });
@@ -192,4 +204,229 @@ suite.addBatch({
   "0x765120aff876876786": 16
 });
 
+suite.addBatch({
+  'two bitvecs': {
+    topic: function() {
+      var a = new vec.BitVec(40), b = new vec.BitVec(3);
+      a[0] = a[1] = a[39] = true;
+      b[1] = b[2] = true;
+      return { a: a, b: b };
+    },
+
+    'and to their common bits': function(t) {
+      assert.equal(t.a.and(t.b).count(), 1);
+      assert.equal(t.a.and(t.b).length, 40);
+    },
+
+    'or and xor': function(t) {
+      assert.equal(t.a.or(t.b).count(), 4);
+      assert.equal(t.a.xor(t.b).count(), 3);
+      assert.equal(t.a.andNot(t.b).count(), 2);
+    },
+
+    'not within the length': function(t) {
+      assert.equal(t.a.not().count(), 37);
+    }
+  }
+});
+
+suite.addBatch({
+  'a bitvec walked in chunks': {
+    topic: function() {
+      var b = new vec.BitVec(100);
+      b[3] = b[31] = b[32] = b[99] = true;
+      return b;
+    },
+
+    'delivers set indices in batches': function(b) {
+      var batches = [];
+      b.forEachTrueChunk(function(idx) {
+        var a = [];
+        for (var i = 0; i < idx.length; ++i) { a.push(idx[i]); }
+        batches.push(a.join(','));
+      }, 3);
+      assert.deepEqual(batches, ["3,31,32", "99"]);
+    },
+
+    'takes any batch size': function(b) {
+      var batches = 0;
+      b.forEachTrueChunk(function(idx) {
+        ++batches;
+        assert.equal(idx.length, 4);
+      }, 0x7fffffff);
+      assert.equal(batches, 1);
+    }
+  }
+});
+
+suite.addBatch({
+  'a bitvec mapped natively': {
+    topic: function() {
+      var b = new vec.BitVec(3);
+      b[1] = true;
+      return b;
+    },
+
+    'maps into a new bitvec': function(b) {
+      var m = b.mapInto(function(x) { return ! x; });
+      assert.equal(m.count(), 2);
+      assert.isTrue(! m[1]);
+    },
+
+    'maps into an intvec': function(b) {
+      assert.equal(b.mapInto(function(x, i) { return x ? i : -1; }, 'int').toString(), "-1,1,-1");
+    }
+  }
+});
+
+suite.addBatch({
+  'a cloned bitvec': {
+    topic: function() {
+      var b = new vec.BitVec(5000);
+      b[10] = true;
+      var c = b.clone();
+      b[11] = true;
+      return { b: b, c: c };
+    },
+
+    'keeps the bits it was cloned with': function(t) {
+      assert.isTrue(!!t.c[10]);
+      assert.isTrue(! t.c[11]);
+      assert.equal(t.b.count(), 2);
+    },
+
+    'copies a shorter bitvec with copyFrom': function(t) {
+      var d = new vec.BitVec(100);
+      d[99] = true;
+      d.copyFrom(t.c);
+      assert.equal(d.length, 5000);
+      assert.equal(d.count(), 1);
+    }
+  }
+});
+
+suite.addBatch({
+  'bulk access to a bitvec': {
+    topic: function() {
+      return new vec.BitVec(70);
+    },
+
+    'fills ranges across words': function(v) {
+      var w = v.clone();
+      w.fill(true, 30, 66);
+      assert.equal(w.count(), 36);
+      assert.isFalse(w[29]);
+      assert.isTrue(w[30]);
+      assert.isTrue(w[65]);
+      assert.isFalse(w[66]);
+      w.fill(false, 31, 65);
+      assert.equal(w.count(), 2);
+    },
+
+    'sets from booleans and bytes': function(v) {
+      var w = v.clone();
+      w.set([true, false, true], 31);
+      assert.deepEqual(w.toArray(30, 35), [false, true, false, true, false]);
+      w.set(new Buffer([0, 1, 1]), 0);
+      assert.deepEqual(w.toArray(0, 3), [false, true, true]);
+    }
+  }
+});
+
+suite.addBatch({
+  'dirty tracking on a bitvec': {
+    topic: function() {
+      var v = new vec.BitVec(100000);
+      v.clearDirty();
+      v[40000] = true;
+      return v;
+    },
+
+    'works in blocks of bits': function(v) {
+      var ranges = [];
+      v.dirtyRanges(function(start, end) { ranges.push([start, end]); });
+      assert.deepEqual(ranges, [[32768, 65536]]);
+    },
+
+    'brings a copy up to date': function(v) {
+      var copy = new vec.BitVec(5);
+      copy[0] = true;
+      var w = v.clone();
+      copy.applyDelta(w.serializeDelta());
+      assert.equal(copy.length, 100000);
+      assert.equal(copy.count(), 1);
+      assert.isTrue(copy[40000]);
+    }
+  }
+});
+
+suite.addBatch({
+  'hashing bitvecs': {
+    topic: function() {
+      var v = new vec.BitVec(40);
+      v[3] = true;
+      return v;
+    },
+
+    'ignores storage past the length': function(v) {
+      var w = new vec.BitVec(41);
+      w[3] = true;
+      w[40] = true;
+      w.applyDelta(v.clone().serializeDelta());
+      assert.equal(w.length, 40);
+      assert.isTrue(v.equals(w));
+      assert.equal(v.hash(), w.hash());
+    },
+
+    'depends on the length': function(v) {
+      var w = new vec.BitVec(41);
+      w[3] = true;
+      assert.isFalse(v.equals(w));
+      assert.notEqual(v.hash(), w.hash());
+    }
+  }
+});
+
+suite.addBatch({
+  'a shared bitvec': {
+    topic: function() {
+      var name = "vec-test-bit-" + process.pid;
+      var v = new vec.BitVec(100);
+      v[3] = true;
+      v.share(name);
+      var w = vec.openShared(name);
+      vec.unlinkShared(name);
+      return { v: v, w: w };
+    },
+
+    'opens as the same storage': function(t) {
+      assert.equal(t.w.length, 100);
+      assert.isTrue(t.w[3]);
+      t.v[70] = true;
+      assert.isTrue(t.w[70]);
+      assert.equal(t.w.count(), 2);
+    },
+
+    'sets bits atomically': function(t) {
+      assert.isFalse(t.w.testAndSet(50));
+      assert.isTrue(t.v.testAndSet(50));
+      assert.isTrue(t.v.atomicSet(50, false));
+      assert.isFalse(t.w[50]);
+      assert.isFalse(t.w.atomicSet(99));
+      assert.isTrue(t.v[99]);
+      assert.throws(function() { t.v.testAndSet(100); }, TypeError);
+    },
+
+    'moves out when it grows': function(t) {
+      var name = "vec-test-bit-grow-" + process.pid;
+      var a = new vec.BitVec(10).share(name), b = vec.openShared(name);
+      vec.unlinkShared(name);
+      b[1000] = true;
+      b[1] = true;
+      assert.isFalse(a[1]);
+      assert.equal(a.length, 10);
+    }
+  }
+});
+
 suite.export(module);
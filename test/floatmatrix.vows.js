@@ -0,0 +1,110 @@
+var vows = require("vows"), assert = require('assert');
+var vec = require("../build/default/vec");
+
+var suite = vows.describe("FloatMatrix");
+
+suite.addBatch({
+  'a floatmatrix': {
+    topic: function() {
+      return new vec.FloatMatrix(3, 2, [1, 2, 3, 4, 5, 6]);
+    },
+
+    'has its shape': function(m) {
+      assert.equal(m.rows, 3);
+      assert.equal(m.cols, 2);
+      assert.equal(m.toFloatVec().toString(), "1,2,3,4,5,6");
+      assert.equal(new vec.FloatMatrix(2, 2).toFloatVec().toString(), "0,0,0,0");
+    },
+
+    'gets and sets cells': function(m) {
+      var c = new vec.FloatMatrix(2, 3, m.toFloatVec());
+      assert.equal(c.get(1, 0), 4);
+      c.set(1, 0, 9);
+      assert.equal(c.get(1, 0), 9);
+      assert.throws(function() { c.get(2, 0); }, TypeError);
+    },
+
+    'has rows that are views': function(m) {
+      var c = new vec.FloatMatrix(3, 2, m.toFloatVec());
+      var row = c.row(1);
+      assert.equal(row.toString(), "3,4");
+      row[0] = 7;
+      assert.equal(c.get(1, 0), 7);
+      c.set(1, 1, 8);
+      assert.equal(row[1], 8);
+      assert.equal(row.clone().toString(), "7,8");
+
+      // Growing a row leaves the matrix alone.
+      row[2] = 1;
+      row[0] = 0;
+      assert.equal(c.get(1, 0), 7);
+    },
+
+    'multiplies by a vector': function(m) {
+      var y = m.gemv(new vec.FloatVec("1,-1"));
+      assert.equal(y.toString(), "-1,-1,-1");
+      assert.throws(function() { m.gemv(new vec.FloatVec(3)); }, TypeError);
+    },
+
+    'multiplies by a matrix': function(m) {
+      var c = m.gemm(new vec.FloatMatrix(2, 2, [0, 1, 1, 0]));
+      assert.equal(c.rows, 3);
+      assert.equal(c.toFloatVec().toString(), "2,1,4,3,6,5");
+      assert.throws(function() { m.gemm(m); }, TypeError);
+    },
+
+    'fits in a FloatVec': function() {
+      assert.throws(function() { new vec.FloatMatrix(65536, 32768); }, TypeError);
+      assert.throws(function() { new vec.FloatMatrix(2147483648, 0); }, TypeError);
+      var a = new vec.FloatMatrix(65536, 0), b = new vec.FloatMatrix(0, 32768);
+      assert.throws(function() { a.gemm(b); }, TypeError);
+      assert.equal(a.gemv(new vec.FloatVec(0)).length, 65536);
+    },
+
+    'matches plain loops when large': function() {
+      var n = 70, a = new vec.FloatMatrix(n, n), b = new vec.FloatMatrix(n, n);
+      for (var i = 0; i < n; ++i) {
+        for (var j = 0; j < n; ++j) {
+          a.set(i, j, (i * 7 + j) % 5);
+          b.set(i, j, (i + j * 3) % 4 - 1);
+        }
+      }
+      var c = a.gemm(b);
+      for (var i = 0; i < n; i += 13) {
+        for (var j = 0; j < n; j += 11) {
+          var s = 0;
+          for (var p = 0; p < n; ++p) { s += a.get(i, p) * b.get(p, j); }
+          assert.equal(c.get(i, j), s);
+        }
+      }
+    }
+  },
+
+  'knn': {
+    topic: function() {
+      return new vec.FloatMatrix(4, 2, [0, 0, 3, 4, 1, 0, -2, 0]);
+    },
+
+    'finds the nearest rows': function(m) {
+      var r = m.knn(new vec.FloatVec("1,1"), 2);
+      assert.equal(r.indices.toString(), "2,0");
+      assert.equal(r.scores[0], 1);
+      assert.equal(m.knn(new vec.FloatVec("1,1"), 10, "l2").indices.length, 4);
+    },
+
+    'scores by dot product and cosine': function(m) {
+      var q = new vec.FloatVec("1,0");
+      assert.equal(m.knn(q, 2, "dot").indices.toString(), "1,2");
+      assert.equal(m.knn(q, 2, "cosine").indices.toString(), "2,1");
+      assert.equal(m.knn(q, 1, "cosine").scores[0], 1);
+    },
+
+    'rejects bad arguments': function(m) {
+      assert.throws(function() { m.knn(new vec.FloatVec(3), 1); }, TypeError);
+      assert.throws(function() { m.knn(new vec.FloatVec(2), 1, "manhattan"); }, TypeError);
+      assert.throws(function() { m.knn(new vec.FloatVec(2), -1); }, TypeError);
+    }
+  }
+});
+
+suite.export(module);
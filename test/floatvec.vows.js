@@ -161,4 +161,272 @@ suite.addBatch({
   }
 });
 
+suite.addBatch({
+  'a floatvec of samples': {
+    topic: function() {
+      return new vec.FloatVec("0.5,1.5,2.5,3.5,100");
+    },
+
+    'has a histogram over a given range': function(v) {
+      assert.equal(v.histogram(4, 0, 4).toString(), "1,1,1,1");
+    },
+
+    'rejects more bins than an IntVec holds': function(v) {
+      assert.throws(function() { v.histogram(Math.pow(2, 31)); }, TypeError);
+    },
+
+    'has exact quantiles': function(v) {
+      assert.equal(v.quantiles(0.5), 2.5);
+      assert.equal(v.quantiles([0, 1]).toString(), "0.5,100");
+    },
+
+    'rejects ps that are not finite': function(v) {
+      assert.throws(function() { v.quantiles(NaN); }, TypeError);
+      assert.throws(function() { v.quantiles([0.5, Infinity]); }, TypeError);
+    },
+
+    'has a histogram over its range without NaNs': function(v) {
+      var w = new vec.FloatVec(6);
+      w[0] = NaN;
+      for (var i = 0; i < 5; ++i) { w[i+1] = v[i]; }
+      assert.equal(w.histogram(2).toString(), "4,1");
+    }
+  }
+});
+
+suite.addBatch({
+  'a floatvec of increments': {
+    topic: function() {
+      return new vec.FloatVec("0.5,0.25,2,-1");
+    },
+
+    'has an inclusive sum scan': function(v) {
+      assert.equal(v.scan('sum').toString(), "0.5,0.75,2.75,1.75");
+    },
+
+    'has an exclusive max scan': function(v) {
+      assert.equal(v.scan('max', {exclusive: true}).toString(), "-inf,0.5,0.5,2");
+    },
+
+    'is restored by diff': function(v) {
+      assert.equal(v.scan('sum').diff().toString(), v.toString());
+    }
+  }
+});
+
+suite.addBatch({
+  'a floatvec with a mask': {
+    topic: function() {
+      var v = new vec.FloatVec("0.5,1.5,2.5,3.5");
+      var mask = new vec.BitVec(4);
+      mask[0] = mask[2] = true;
+      return { v: v, mask: mask };
+    },
+
+    'compresses to the masked elements': function(t) {
+      assert.equal(t.v.compress(t.mask).toString(), "0.5,2.5");
+    },
+
+    'takes elements by index': function(t) {
+      assert.equal(t.v.take(new vec.IntVec("3,3,1")).toString(), "3.5,3.5,1.5");
+    },
+
+    'has masked reductions': function(t) {
+      assert.equal(t.v.sum(t.mask), 3);
+      assert.equal(t.v.max(), 3.5);
+      assert.equal(t.v.min(t.mask), 0.5);
+    },
+
+    'is filled by put with a number': function(t) {
+      var v = new vec.FloatVec(3);
+      v.put(new vec.IntVec("1,2"), 0.25);
+      assert.equal(v.toString(), "0,0.25,0.25");
+    }
+  }
+});
+
+suite.addBatch({
+  'a floatvec compared': {
+    topic: function() {
+      return new vec.FloatVec("0.1,0.5,2,-1,0.5");
+    },
+
+    'against a number gives a bitvec': function(v) {
+      var m = v.gt(0.5);
+      assert.equal(m.length, 5);
+      assert.equal(m.count(), 1);
+      assert.isTrue(!!m[2]);
+    },
+
+    'against a double as JS would': function(v) {
+      assert.equal(v.eq(0.1).count(), 0);
+      assert.equal(v.ge(0.1).count(), 4);
+    },
+
+    'against another floatvec': function(v) {
+      var m = v.le(new vec.FloatVec("0,1,2"));
+      assert.equal(m.count(), 3);
+      assert.isTrue(!!m[3]);
+    },
+
+    'with between': function(v) {
+      assert.equal(v.between(0, 1).count(), 3);
+      assert.equal(v.between(0, 1).and(v.ne(0.5)).count(), 1);
+    }
+  }
+});
+
+suite.addBatch({
+  'a floatvec walked in chunks': {
+    topic: function() {
+      return new vec.FloatVec("0.5,1.5,2.5");
+    },
+
+    'maps into a new floatvec': function(v) {
+      assert.equal(v.mapChunk(function(w, out) {
+        for (var i = 0; i < w.length; ++i) { out[i] = w[i] + 1; }
+      }, 2).toString(), "1.5,2.5,3.5");
+    },
+
+    'reduces chunk by chunk': function(v) {
+      assert.equal(v.reduceChunk(0, function(acc, w) {
+        for (var i = 0; i < w.length; ++i) { acc += w[i]; }
+        return acc;
+      }, 2), 4.5);
+    },
+
+    'lets the callback grow the vector': function() {
+      var g = new vec.FloatVec("0.5,1.5,2.5");
+      var m = g.mapChunk(function(w, out, offset) {
+        if (offset == 0) { g[g.length + 1000] = 1; }
+        for (var i = 0; i < w.length; ++i) { out[i] = w[i] * 2; }
+      }, 2);
+      assert.equal(m.toString(), "1,3,5");
+      assert.equal(g.length, 1004);
+      assert.equal(g[2], 2.5);
+    }
+  }
+});
+
+suite.addBatch({
+  'a floatvec mapped natively': {
+    topic: function() {
+      return new vec.FloatVec("0.5,-1.5,2.25");
+    },
+
+    'maps into a new floatvec': function(v) {
+      assert.equal(v.mapInto(function(x) { return x * 2; }).toString(), "1,-3,4.5");
+    },
+
+    'rounds as Math.round': function(v) {
+      assert.equal(v.transform('round', 'int').toString(), "1,-1,2");
+    },
+
+    'casts to int': function(v) {
+      assert.equal(v.transform('cast', 'int').toString(), "0,-1,2");
+    }
+  }
+});
+
+suite.addBatch({
+  'a cloned floatvec': {
+    topic: function() {
+      var v = new vec.FloatVec("0.5,1.5");
+      var c = v.clone();
+      c[0] = 2;
+      return { v: v, c: c };
+    },
+
+    'is independent of the original': function(t) {
+      assert.equal(t.v.toString(), "0.5,1.5");
+      assert.equal(t.c.toString(), "2,1.5");
+    },
+
+    'copies in place with copyFrom': function(t) {
+      var w = new vec.FloatVec(3);
+      assert.equal(w.copyFrom(t.v), w);
+      assert.equal(w.toString(), "0.5,1.5");
+    }
+  }
+});
+
+suite.addBatch({
+  'bulk access to a floatvec': {
+    topic: function() {
+      return new vec.FloatVec("0.5,1.5,2.5");
+    },
+
+    'fills a range': function(v) {
+      var w = v.clone();
+      w.fill(0.25, 2);
+      assert.equal(w.toString(), "0.5,1.5,0.25");
+    },
+
+    'sets from arrays': function(v) {
+      var w = v.clone();
+      w.set([4.5, "2"], 1);
+      assert.equal(w.toString(), "0.5,4.5,2");
+    },
+
+    'copies ranges out': function(v) {
+      assert.deepEqual(v.toArray(1), [1.5, 2.5]);
+      if (typeof Float32Array === 'function') {
+        assert.equal(v.toTypedArray()[2], 2.5);
+      }
+    }
+  }
+});
+
+suite.addBatch({
+  'selecting from a floatvec': {
+    topic: function() {
+      return new vec.FloatVec("0.5,3,NaN,-1,3,2");
+    },
+
+    'finds the largest': function(v) {
+      var top = v.topK(3);
+      assert.equal(top.values.toString(), "3,3,2");
+      assert.equal(top.indices.toString(), "1,4,5");
+    },
+
+    'finds the smallest': function(v) {
+      var top = v.topK(2, {largest: false});
+      assert.equal(top.values.toString(), "-1,0.5");
+      assert.equal(top.indices.toString(), "3,0");
+    },
+
+    'leaves out NaNs': function(v) {
+      assert.equal(v.topK(10).indices.length, 5);
+    },
+
+    'partitions indices': function(v) {
+      var idx = v.argpartition(2);
+      assert.equal(idx.length, 6);
+      assert.equal(v[idx[2]], 2);
+      assert.isTrue(v[idx[0]] <= 2 && v[idx[1]] <= 2);
+      assert.isTrue(v[idx[3]] >= 2 && v[idx[4]] >= 2);
+      assert.isNaN(v[idx[5]]);
+    }
+  }
+});
+
+suite.addBatch({
+  'a shared floatvec': {
+    topic: function() {
+      var name = "vec-test-float-" + process.pid;
+      var v = new vec.FloatVec("0.5,1.5").share(name);
+      var w = vec.openShared(name);
+      vec.unlinkShared(name);
+      return { v: v, w: w };
+    },
+
+    'opens as the same storage': function(t) {
+      assert.instanceOf(t.w, vec.FloatVec);
+      assert.equal(t.w.toString(), t.v.toString());
+      t.w[0] = 2.5;
+      assert.equal(t.v[0], 2.5);
+    }
+  }
+});
+
 suite.export(module);
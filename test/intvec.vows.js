@@ -149,4 +149,516 @@ suite.addBatch({
   }
 });
 
+suite.addBatch({
+  'an intvec of 0..99': {
+    topic: function() {
+      var v = new vec.IntVec(100);
+      for (var i = 0; i < 100; ++i) { v[i] = 99-i; }
+      return v;
+    },
+
+    'has a histogram over its range': function(v) {
+      var h = v.histogram(4);
+      assert.instanceOf(h, vec.IntVec);
+      assert.equal(h.toString(), "25,25,25,25");
+    },
+
+    'has a histogram over a given range': function(v) {
+      assert.equal(v.histogram(2, 0, 9).toString(), "5,5");
+    },
+
+    'rejects more bins than an IntVec holds': function(v) {
+      assert.throws(function() { v.histogram(Math.pow(2, 31)); }, TypeError);
+    },
+
+    'has exact quantiles': function(v) {
+      assert.equal(v.quantiles(0.5), 49.5);
+      assert.equal(v.quantiles([1, 0, 0.25]).toString(), "99,0,24.75");
+    },
+
+    'rejects ps that are not finite': function(v) {
+      assert.throws(function() { v.quantiles(NaN); }, TypeError);
+      assert.throws(function() { v.quantiles([0.5, -Infinity]); }, TypeError);
+    },
+
+    'is not reordered by quantiles': function(v) {
+      assert.equal(v[0], 99);
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec of counts': {
+    topic: function() {
+      return new vec.IntVec("3,1,4,1,5");
+    },
+
+    'has an inclusive sum scan': function(v) {
+      assert.equal(v.scan('sum').toString(), "3,4,8,9,14");
+    },
+
+    'has an exclusive sum scan': function(v) {
+      assert.equal(v.scan('sum', {exclusive: true}).toString(), "0,3,4,8,9");
+    },
+
+    'has min, max and product scans': function(v) {
+      assert.equal(v.scan('min').toString(), "3,1,1,1,1");
+      assert.equal(v.scan('max').toString(), "3,3,4,4,5");
+      assert.equal(v.scan('product').toString(), "3,3,12,12,60");
+    },
+
+    'is unchanged by a scan': function(v) {
+      assert.equal(v.toString(), "3,1,4,1,5");
+    },
+
+    'rejects an unknown operation': function(v) {
+      assert.throws(function () { v.scan('mean'); }, TypeError);
+    },
+
+    'is restored by diff': function(v) {
+      assert.equal(v.scan('sum').diff().toString(), "3,1,4,1,5");
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec scanned in place': {
+    topic: function() {
+      var v = new vec.IntVec("1,1,1,1");
+      return [v, v.scan('sum', {inPlace: true})];
+    },
+
+    'is returned and overwritten': function(t) {
+      assert.equal(t[0], t[1]);
+      assert.equal(t[0].toString(), "1,2,3,4");
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec with a mask': {
+    topic: function() {
+      var v = new vec.IntVec("10,20,30,40,50,60");
+      var mask = new vec.BitVec(6);
+      mask[1] = mask[3] = mask[4] = true;
+      return { v: v, mask: mask };
+    },
+
+    'takes elements by index': function(t) {
+      assert.equal(t.v.take(new vec.IntVec("5,0,9")).toString(), "60,10,0");
+    },
+
+    'compresses to the masked elements': function(t) {
+      assert.equal(t.v.compress(t.mask).toString(), "20,40,50");
+    },
+
+    'has masked reductions': function(t) {
+      assert.equal(t.v.sum(), 210);
+      assert.equal(t.v.sum(t.mask), 110);
+      assert.equal(t.v.count(t.mask), 3);
+      assert.equal(t.v.min(t.mask), 20);
+      assert.equal(t.v.max(t.mask), 50);
+    },
+
+    'expands values into the masked positions': function(t) {
+      var out = new vec.IntVec(6);
+      out.expand(t.mask, new vec.IntVec("1,2,3"));
+      assert.equal(out.toString(), "0,1,0,2,3,0");
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec after put': {
+    topic: function() {
+      var v = new vec.IntVec("1,2,3");
+      v.put(new vec.IntVec("0,4"), new vec.IntVec("7,8"));
+      return v;
+    },
+
+    'has the values scattered and is extended': function(v) {
+      assert.equal(v.toString(), "7,2,3,0,8");
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec compared': {
+    topic: function() {
+      var v = new vec.IntVec(40);
+      for (var i = 0; i < 40; ++i) { v[i] = i % 10; }
+      return v;
+    },
+
+    'against a number gives a bitvec': function(v) {
+      var m = v.lt(3);
+      assert.equal(m.length, 40);
+      assert.equal(m.count(), 12);
+      assert.isTrue(!!m[32]);
+    },
+
+    'against a fraction': function(v) {
+      assert.equal(v.gt(8.5).count(), 4);
+      assert.equal(v.eq(8.5).count(), 0);
+      assert.equal(v.ne(8.5).count(), 40);
+    },
+
+    'with between': function(v) {
+      assert.equal(v.between(2, 4).count(), 12);
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec walked in chunks': {
+    topic: function() {
+      var v = new vec.IntVec(10);
+      for (var i = 0; i < 10; ++i) { v[i] = i; }
+      return v;
+    },
+
+    'sees every element once with its offset': function(v) {
+      var seen = [], offsets = [];
+      v.forEachChunk(function(w, offset) {
+        offsets.push(offset);
+        for (var i = 0; i < w.length; ++i) { seen.push(w[i]); }
+      }, 4);
+      assert.equal(seen.join(','), v.toString());
+      assert.equal(offsets.join(','), "0,4,8");
+    },
+
+    'maps into a new intvec': function(v) {
+      var m = v.mapChunk(function(w, out) {
+        for (var i = 0; i < w.length; ++i) { out[i] = w[i] * 2; }
+      }, 3);
+      assert.equal(m.toString(), "0,2,4,6,8,10,12,14,16,18");
+    },
+
+    'reduces chunk by chunk': function(v) {
+      assert.equal(v.reduceChunk(0, function(acc, w) {
+        for (var i = 0; i < w.length; ++i) { acc += w[i]; }
+        return acc;
+      }), 45);
+    },
+
+    'detaches the window after the callback': function(v) {
+      var kept;
+      v.forEachChunk(function(w) { kept = w; });
+      assert.equal(kept.length, 0);
+      assert.isUndefined(kept[0]);
+    },
+
+    'lets the callback grow the vector': function() {
+      var g = new vec.IntVec("1,2,3,4,5,6");
+      var seen = [];
+      g.forEachChunk(function(w, offset) {
+        if (offset == 0) { g[g.length + 1000] = 9; }
+        w[0] = -1;
+        for (var i = 0; i < w.length && offset + i < 6; ++i) { seen.push(w[i]); }
+      }, 3);
+      assert.equal(seen.join(','), "-1,2,3,-1,5,6");
+      assert.equal(g.length, 1007);
+      assert.equal(g[0], 1);
+      assert.equal(g[1006], 9);
+      assert.equal(g.reduceChunk(0, function(acc, w, offset) {
+        if (offset == 0) { g[g.length + 5000] = 1; }
+        for (var i = 0; i < w.length; ++i) { acc += w[i]; }
+        return acc;
+      }, 512), 31);
+    },
+
+    'keeps clones and hashes right': function() {
+      var g = new vec.IntVec("1,2,3,4"), c, h;
+      g.forEachChunk(function(w, offset) {
+        if (offset == 0) {
+          c = g.clone();
+          h = g.hash();
+        }
+        w[0] = 7;
+        g[offset] = 5;
+      }, 2);
+      assert.equal(c.toString(), "1,2,3,4");
+      assert.equal(g.toString(), "5,2,5,4");
+      assert.notEqual(g.hash(), h);
+      assert.isTrue(g.equals(new vec.IntVec("5,2,5,4")));
+    }
+  }
+});
+
+suite.addBatch({
+  'an intvec mapped natively': {
+    topic: function() {
+      return new vec.IntVec("4,9,-3,0");
+    },
+
+    'maps into a new intvec': function(v) {
+      var m = v.mapInto(function(x, i) { return x + i; });
+      assert.instanceOf(m, vec.IntVec);
+      assert.equal(m.toString(), "4,10,-1,3");
+    },
+
+    'maps into a named type': function(v) {
+      var m = v.mapInto(function(x) { return x > 0; }, 'bit');
+      assert.instanceOf(m, vec.BitVec);
+      assert.equal(m.count(), 2);
+    },
+
+    'transforms to a floatvec by default for sqrt': function(v) {
+      var m = v.transform('sqrt');
+      assert.instanceOf(m, vec.FloatVec);
+      assert.equal(m[1], 3);
+    },
+
+    'transforms into an existing vector': function(v) {
+      var out = new vec.IntVec(1);
+      assert.equal(v.transform('abs', out), out);
+      assert.equal(out.toString(), "4,9,3,0");
+    },
+
+    'rejects unknown transforms': function(v) {
+      assert.throws(function() { v.transform('cube'); }, TypeError);
+    }
+  }
+});
+
+suite.addBatch({
+  'a cloned intvec': {
+    topic: function() {
+      var v = new vec.IntVec(1000);
+      v[1] = 5;
+      var c = v.clone();
+      v[2] = 6;
+      c[3] = 7;
+      return { v: v, c: c };
+    },
+
+    'starts with the same contents': function(t) {
+      assert.equal(t.c.length, 1000);
+      assert.equal(t.c[1], 5);
+    },
+
+    'is not changed by writes to the original': function(t) {
+      assert.equal(t.c[2], 0);
+      assert.equal(t.v[3], 0);
+      assert.equal(t.v[2], 6);
+      assert.equal(t.c[3], 7);
+    },
+
+    'is copied from with copyFrom': function(t) {
+      var w = new vec.IntVec("1,2,3,4");
+      w.copyFrom(new vec.IntVec("9,8"));
+      assert.equal(w.toString(), "9,8");
+      assert.equal(w[3], 0);
+    }
+  }
+});
+
+suite.addBatch({
+  'bulk access to an intvec': {
+    topic: function() {
+      return new vec.IntVec("1,2,3,4,5");
+    },
+
+    'fills a range': function(v) {
+      var w = v.clone();
+      w.fill(9, 1, 3);
+      assert.equal(w.toString(), "1,9,9,4,5");
+      w.fill(7, -1);
+      assert.equal(w.toString(), "1,9,9,4,7");
+    },
+
+    'fills past the end': function(v) {
+      var w = new vec.IntVec(2);
+      w.fill(3, 1, 4);
+      assert.equal(w.toString(), "0,3,3,3");
+    },
+
+    'sets from arrays and Buffers': function(v) {
+      var w = v.clone();
+      w.set([10, 11.7, -12], 3);
+      assert.equal(w.toString(), "1,2,3,10,11,-12");
+      w.set(new Buffer([200, 0]));
+      assert.equal(w.toString(), "200,0,3,10,11,-12");
+      assert.throws(function() { w.set(5); }, TypeError);
+    },
+
+    'converts elements before writing': function(v) {
+      var w = new vec.IntVec(2), c;
+      w.set([{ valueOf: function() { w[100000] = 1; c = w.clone(); return 7; } }, 8]);
+      assert.equal(w[0], 7);
+      assert.equal(w[1], 8);
+      assert.equal(w[100000], 1);
+      assert.equal(c[0], 0);
+      assert.throws(function() {
+        w.set([1, { valueOf: function() { throw new TypeError("no"); } }]);
+      }, TypeError);
+      assert.equal(w[0], 7);
+    },
+
+    'copies ranges out': function(v) {
+      assert.deepEqual(v.toArray(), [1, 2, 3, 4, 5]);
+      assert.deepEqual(v.toArray(1, 3), [2, 3]);
+      assert.deepEqual(v.toArray(-2, 100), [4, 5]);
+      if (typeof Int32Array === 'function') {
+        var a = v.toTypedArray(2);
+        assert.equal(a.length, 3);
+        assert.equal(a[0], 3);
+      }
+    }
+  }
+});
+
+suite.addBatch({
+  'dirty tracking on an intvec': {
+    topic: function() {
+      var v = new vec.IntVec(10000);
+      var copy = new vec.IntVec();
+      copy.applyDelta(v.serializeDelta());
+      v[5] = 1;
+      v.fill(2, 3000, 3010);
+      v[20000] = 3;
+      var ranges = [];
+      v.dirtyRanges(function(start, end) { ranges.push([start, end]); });
+      var delta = v.serializeDelta();
+      copy.applyDelta(delta);
+      return { v: v, copy: copy, ranges: ranges, delta: delta };
+    },
+
+    'reports the written blocks': function(t) {
+      assert.deepEqual(t.ranges, [[0, 1024], [2048, 3072], [19456, 20001]]);
+    },
+
+    'sends only those blocks': function(t) {
+      assert.isTrue(t.delta.length < 4 * 3000);
+    },
+
+    'brings a copy up to date': function(t) {
+      assert.equal(t.copy.length, 20001);
+      assert.equal(t.copy[5], 1);
+      assert.equal(t.copy[3009], 2);
+      assert.equal(t.copy[20000], 3);
+    },
+
+    'starts clean after a delta': function(t) {
+      var n = 0;
+      t.v.dirtyRanges(function() { ++n; });
+      assert.equal(n, 0);
+    },
+
+    'stays clean through chunked reads': function(t) {
+      var n = 0;
+      t.v.forEachChunk(function(w) { w[0] = 9; });
+      t.v.reduceChunk(0, function(acc, w) { return acc + w.length; });
+      t.v.mapChunk(function(w, out) { out[0] = w[0]; });
+      t.v.dirtyRanges(function() { ++n; });
+      assert.equal(n, 0);
+      assert.equal(t.v[0], 0);
+    },
+
+    'rejects other deltas': function(t) {
+      assert.throws(function() { t.copy.applyDelta(new Buffer(4)); }, TypeError);
+      assert.throws(function() { new vec.FloatVec().applyDelta(t.delta); }, TypeError);
+    }
+  }
+});
+
+suite.addBatch({
+  'hashing intvecs': {
+    topic: function() {
+      return new vec.IntVec("1,2,3");
+    },
+
+    'gives equal vectors equal hashes': function(v) {
+      var w = new vec.IntVec("1,2,3");
+      assert.isTrue(v.equals(w));
+      assert.equal(v.hash(), w.hash());
+      assert.equal(v.hash().length, 16);
+    },
+
+    'tells different vectors apart': function(v) {
+      var w = v.clone();
+      var h = w.hash();
+      w[1] = 5;
+      assert.notEqual(w.hash(), h);
+      assert.isFalse(v.equals(w));
+      assert.isFalse(v.equals(new vec.IntVec("1,2,3,0")));
+      assert.isFalse(v.equals([1, 2, 3]));
+    }
+  }
+});
+
+suite.addBatch({
+  'selecting from an intvec': {
+    topic: function() {
+      var v = new vec.IntVec(100000);
+      for (var i = 0; i < 100000; ++i) { v[i] = (i * 7919) % 100003; }
+      return v;
+    },
+
+    'finds the largest in one pass': function(v) {
+      var top = v.topK(3);
+      assert.equal(top.values.length, 3);
+      assert.isTrue(top.values[0] >= top.values[1] && top.values[1] >= top.values[2]);
+      assert.equal(v[top.indices[0]], v.max());
+    },
+
+    'rejects a bad k': function(v) {
+      assert.throws(function() { v.topK(-1); }, TypeError);
+    }
+  }
+});
+
+suite.addBatch({
+  'a shared intvec': {
+    topic: function() {
+      var name = "vec-test-int-" + process.pid;
+      var v = new vec.IntVec("1,2,3").share(name);
+      var w = vec.openShared(name);
+      vec.unlinkShared(name);
+      return { v: v, w: w };
+    },
+
+    'opens as the same storage': function(t) {
+      assert.equal(t.w.length, 3);
+      assert.equal(t.w.toString(), "1,2,3");
+      t.v[1] = 9;
+      assert.equal(t.w[1], 9);
+      assert.equal(t.w.hash(), t.v.hash());
+    },
+
+    'updates atomically': function(t) {
+      assert.equal(t.w.atomicAdd(0, 5), 1);
+      assert.equal(t.v[0], 6);
+      assert.equal(t.v.atomicSet(2, -4), 3);
+      assert.equal(t.v.compareExchange(2, 0, 1), -4);
+      assert.equal(t.w.compareExchange(2, -4, 1), -4);
+      assert.equal(t.v[2], 1);
+      assert.throws(function() { t.v.atomicAdd(3, 1); }, TypeError);
+    },
+
+    'forgets a hash taken before sharing': function() {
+      var name = "vec-test-int-hash-" + process.pid;
+      var v = new vec.IntVec("1,2,3"), h = v.hash();
+      v.share(name);
+      var w = vec.openShared(name);
+      vec.unlinkShared(name);
+      w[0] = 7;
+      assert.notEqual(v.hash(), h);
+      assert.equal(v.hash(), w.hash());
+    },
+
+    'clones privately': function(t) {
+      var c = t.v.clone();
+      c[0] = 100;
+      assert.notEqual(t.w[0], 100);
+    },
+
+    'needs a name that exists': function(t) {
+      assert.throws(function() { vec.openShared("vec-test-missing-" + process.pid); }, TypeError);
+      assert.throws(function() { new vec.IntVec(1).share(); }, TypeError);
+      assert.isFalse(vec.unlinkShared("vec-test-missing-" + process.pid));
+    }
+  }
+});
+
 suite.export(module);
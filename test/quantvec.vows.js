@@ -0,0 +1,100 @@
+var vows = require("vows"), assert = require('assert');
+var vec = require("../build/default/vec");
+
+var suite = vows.describe("QuantizedVec");
+
+function floats(values) {
+  var v = new vec.FloatVec(values.length);
+  for (var i = 0; i < values.length; ++i) { v[i] = values[i]; }
+  return v;
+}
+
+function within(actual, expected, bound) {
+  assert.isTrue(Math.abs(actual - expected) <= bound,
+                actual + " is not within " + bound + " of " + expected);
+}
+
+suite.addBatch({
+  'a quantized sequence': {
+    topic: function() {
+      var values = [];
+      for (var i = 0; i < 100; ++i) { values.push(i/10 - 3); }
+      return { source: floats(values), q: vec.quantize(floats(values)) };
+    },
+
+    'has the source length': function(t) {
+      assert.equal(t.q.length, 100);
+    },
+
+    'decodes each element within scale/2': function(t) {
+      for (var i = 0; i < 100; ++i) {
+        within(t.q[i], t.source[i], t.q.scale/2 + 1e-6);
+      }
+    },
+
+    'dequantizes to a FloatVec': function(t) {
+      var d = t.q.dequantize();
+      assert.instanceOf(d, vec.FloatVec);
+      assert.equal(d.length, 100);
+      within(d[42], t.source[42], t.q.scale/2 + 1e-6);
+    },
+
+    'returns zero for other gets': function(t) {
+      assert.equal(t.q[1000], 0);
+    }
+  }
+});
+
+suite.addBatch({
+  'two quantized vectors': {
+    topic: function() {
+      var a = [], b = [];
+      for (var i = 0; i < 1000; ++i) {
+        a.push(Math.sin(i));
+        b.push(Math.cos(i) * 2 + 0.5);
+      }
+      return { a: a, b: b, qa: vec.quantize(floats(a)), qb: vec.quantize(floats(b)) };
+    },
+
+    'have a dot product within the documented bound': function(t) {
+      var exact = 0, sa = 0, sb = 0;
+      for (var i = 0; i < t.a.length; ++i) {
+        exact += t.a[i] * t.b[i];
+        sa += Math.abs(t.qa[i]);
+        sb += Math.abs(t.qb[i]);
+      }
+      var ea = t.qa.scale/2, eb = t.qb.scale/2;
+      within(t.qa.dot(t.qb), exact, ea*sb + eb*sa + t.a.length*ea*eb + 1e-3);
+    },
+
+    'have an l2 distance within the documented bound': function(t) {
+      var exact = 0;
+      for (var i = 0; i < t.a.length; ++i) {
+        exact += (t.a[i] - t.b[i]) * (t.a[i] - t.b[i]);
+      }
+      var bound = Math.sqrt(t.a.length) * (t.qa.scale + t.qb.scale)/2;
+      within(t.qa.l2(t.qb), Math.sqrt(exact), bound + 1e-3);
+    },
+
+    'have an l2 distance that does not cancel far from the origin': function() {
+      var a = [], b = [];
+      for (var i = 0; i < 1000; ++i) {
+        a.push(1e6 + (i * 37 % 101) / 8);
+        b.push(a[i] + 0.125);
+      }
+      var qa = vec.quantize(floats(a)), qb = vec.quantize(floats(b));
+      within(qa.l2(qb), 0.125 * Math.sqrt(1000), 1e-9);
+      assert.equal(qa.l2(qa), 0);
+    },
+
+    'have a cosine of one with themselves': function(t) {
+      within(t.qa.cosine(t.qa), 1, 1e-6);
+    },
+
+    'reject vectors of a different length': function(t) {
+      assert.throws(function () { t.qa.dot(vec.quantize(floats([1, 2]))); }, TypeError);
+    }
+  }
+});
+
+suite.export(module);
@@ -0,0 +1,78 @@
+var vows = require("vows"), assert = require('assert');
+var vec = require("../build/default/vec");
+
+var suite = vows.describe("QuantileSketch");
+
+function samples(n, from) {
+  var v = new vec.FloatVec(n);
+  for (var i = 0; i < n; ++i) { v[i] = (from + i*7919) % n; }
+  return v;
+}
+
+suite.addBatch({
+  'an empty sketch': {
+    topic: function() {
+      return new vec.QuantileSketch();
+    },
+
+    'has no count': function(s) {
+      assert.equal(s.count, 0);
+      assert.equal(s.quantile(0.5), 0);
+    }
+  }
+});
+
+suite.addBatch({
+  'a sketch fed 100000 values': {
+    topic: function() {
+      var s = new vec.QuantileSketch(200);
+      s.add(samples(100000, 0));
+      return s;
+    },
+
+    'counts every value': function(s) {
+      assert.equal(s.count, 100000);
+      assert.equal(s.min, 0);
+      assert.equal(s.max, 99999);
+    },
+
+    'estimates the median within 2%': function(s) {
+      assert.isTrue(Math.abs(s.quantile(0.5) - 50000) < 2000);
+    },
+
+    'estimates ranks within 2%': function(s) {
+      assert.isTrue(Math.abs(s.rank(90000) - 0.9) < 0.02);
+    },
+
+    'reads back after serialize': function(s) {
+      var copy = new vec.QuantileSketch(s.serialize());
+      assert.equal(copy.count, s.count);
+      assert.equal(copy.quantile(0.99), s.quantile(0.99));
+    },
+
+    'reads back a count past 2^31': function(s) {
+      var buf = s.serialize();
+      buf[11] |= 0x80;  // the top bit of n's low word, on a little-endian host
+      var copy = new vec.QuantileSketch(buf);
+      assert.equal(copy.count, s.count + 2147483648);
+    }
+  }
+});
+
+suite.addBatch({
+  'two merged sketches': {
+    topic: function() {
+      var a = new vec.QuantileSketch(), b = new vec.QuantileSketch();
+      a.add(samples(50000, 0));
+      b.add(new vec.IntVec("100000,100001,100002"));
+      return a.merge(b);
+    },
+
+    'count the items of both': function(s) {
+      assert.equal(s.count, 50003);
+      assert.equal(s.max, 100002);
+    }
+  }
+});
+
+suite.export(module);
@@ -0,0 +1,109 @@
+var vows = require("vows"), assert = require('assert');
+var vec = require("../build/default/vec");
+
+var suite = vows.describe("SparseFloatVec");
+
+suite.addBatch({
+  'a sparsefloatvec': {
+    topic: function() {
+      return new vec.SparseFloatVec();
+    },
+
+    'is initially empty': function(v) {
+      assert.equal(v.length, 0);
+      assert.equal(v.nnz, 0);
+    },
+
+    'returns zero for all gets': function(v) {
+      assert.equal(v[0], 0);
+      assert.equal(v[1000], 0);
+    },
+
+    'rejects indices past a FloatVec\'s length': function() {
+      var s = new vec.SparseFloatVec();
+      assert.throws(function() { s[4294967294] = 1; }, TypeError);
+      assert.throws(function() { s[2147483647] = 1; }, TypeError);
+      s[2147483646] = 1;
+      assert.equal(s.length, 2147483647);
+    },
+
+    'after sets out of order': {
+      topic: function(v) {
+        v[120] = 12; v[3] = 1.5; v[50] = -2;
+        return v;
+      },
+
+      'has length = index+1': function(v) {
+        assert.equal(v.length, 121);
+      },
+
+      'stores only the set values': function(v) {
+        assert.equal(v.nnz, 3);
+        assert.equal(v.toString(), "121;3:1.5,50:-2,120:12");
+      },
+
+      'keeps its indices sorted': function(v) {
+        assert.equal(v.indices.toString(), "3,50,120");
+        assert.equal(v.values.toString(), "1.5,-2,12");
+      }
+    }
+  }
+});
+
+suite.addBatch({
+  'a sparsefloatvec with an element set to zero': {
+    topic: function() {
+      var v = new vec.SparseFloatVec("1:1,2:2,3:3");
+      v[2] = 0;
+      return v;
+    },
+
+    'drops the element': function(v) {
+      assert.equal(v.nnz, 2);
+      assert.equal(v[2], 0);
+      assert.equal(v.JSON, "SparseFloatVec[4;1:1,3:3]");
+    }
+  }
+});
+
+suite.addBatch({
+  'a sparse vector converted from a FloatVec': {
+    topic: function() {
+      var d = new vec.FloatVec("0,0,3,0,5,0");
+      return { dense: d, sparse: d.toSparse() };
+    },
+
+    'keeps the dense length': function(t) {
+      assert.equal(t.sparse.length, 6);
+      assert.equal(t.sparse.nnz, 2);
+    },
+
+    'converts back without change': function(t) {
+      assert.equal(t.sparse.toFloatVec().toString(), t.dense.toString());
+    },
+
+    'reads back its string exactly': function(t) {
+      t.sparse[3] = 0.1;
+      var copy = new vec.SparseFloatVec(t.sparse.toString());
+      assert.equal(copy.length, 6);
+      assert.equal(copy.toString(), t.sparse.toString());
+      assert.equal(copy[3], t.sparse[3]);
+      assert.equal(new vec.SparseFloatVec(t.sparse.JSON).length, 6);
+      assert.equal(new vec.SparseFloatVec("3;").length, 3);
+      assert.throws(function() { new vec.SparseFloatVec("3;5:1"); }, TypeError);
+      t.sparse[3] = 0;
+    },
+
+    'has a dot product with a FloatVec': function(t) {
+      assert.equal(t.sparse.dot(new vec.FloatVec("1,1,2,1,3")), 21);
+    },
+
+    'has a dot product with a SparseFloatVec': function(t) {
+      var other = new vec.SparseFloatVec("1:7,4:2,9:4");
+      assert.equal(t.sparse.dot(other), 10);
+      assert.equal(other.dot(t.sparse), 10);
+    }
+  }
+});
+
+suite.export(module);
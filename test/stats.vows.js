@@ -0,0 +1,172 @@
+var vows = require("vows"), assert = require('assert');
+var execFile = require('child_process').execFile;
+var vec = require("../build/default/vec");
+
+var suite = vows.describe("stats");
+
+suite.addBatch({
+  'storage counters': {
+    topic: function() {
+      vec.resetStats();
+      var before = vec.stats();
+      var v = new vec.FloatVec(1000);
+      v[2000] = 1;
+      return { before: before, after: vec.stats(), v: v };
+    },
+
+    'count a live vector and its bytes': function(t) {
+      assert.equal(t.after.FloatVec.live, t.before.FloatVec.live + 1);
+      assert.isTrue(t.after.FloatVec.bytes >= t.before.FloatVec.bytes + 4 * 2001);
+    },
+
+    'count allocations and reallocations': function(t) {
+      assert.equal(t.after.FloatVec.allocs - t.before.FloatVec.allocs, 1);
+      assert.equal(t.after.FloatVec.reallocs - t.before.FloatVec.reallocs, 1);
+      assert.isTrue(t.after.total.peakBytes >= t.after.total.bytes);
+    }
+  }
+});
+
+suite.addBatch({
+  'access counters': {
+    topic: function() {
+      var v = new vec.IntVec(10);
+      var prev = vec.trackAccess(true);
+      vec.resetStats();
+      v[1] = v[0] + 1;
+      v.forEach(function() {});
+      var s = vec.stats();
+      vec.trackAccess(prev);
+      return s;
+    },
+
+    'count interceptor calls and callbacks': function(s) {
+      assert.equal(s.IntVec.gets, 1);
+      assert.equal(s.IntVec.sets, 1);
+      assert.equal(s.IntVec.callbacks, 10);
+    }
+  }
+});
+
+suite.addBatch({
+  'small vectors': {
+    topic: function() {
+      var before = vec.stats().total.allocs, vs = [];
+      for (var i = 0; i < 100; ++i) {
+        var b = new vec.BitVec(500), v = new vec.IntVec(16);
+        b[499] = true;
+        v[15] = i;
+        vs.push(b, v);
+      }
+      return { allocs: vec.stats().total.allocs - before, vs: vs };
+    },
+
+    'are stored inline with no allocation': function(t) {
+      assert.equal(t.allocs, 0);
+      assert.equal(t.vs[1][15], 0);
+      assert.isTrue(!!t.vs[198][499]);
+    }
+  }
+});
+
+suite.addBatch({
+  'simd level': {
+    topic: function() { return vec.simd; },
+
+    'names a known level': function(simd) {
+      assert.include(["base", "sse4.2", "avx2", "avx512"], simd);
+    },
+
+    'does not change results': function() {
+      var b = new vec.BitVec(1000);
+      for (var i = 0; i < 1000; i += 3) { b[i] = true; }
+      assert.equal(b.count(), 334);
+      var v = new vec.IntVec(100);
+      for (var i = 0; i < 100; ++i) { v[i] = i - 50; }
+      assert.equal(v.sum(), -50);
+      assert.equal(v.min(), -50);
+      assert.equal(v.max(), 49);
+    }
+  },
+
+  'every simd level': {
+    // Reductions over empty and short vectors, in a child process per
+    // level forced with VEC_SIMD.  A level the CPU lacks binds the best
+    // one it has.
+    topic: function() {
+      var script =
+        "var vec = require(" + JSON.stringify(__dirname + "/../build/default/vec") + ");" +
+        "var r = [];" +
+        "[0, 1, 3, 4, 5, 9, 16, 17, 40].forEach(function(n) {" +
+        "  var i = new vec.IntVec(n), f = new vec.FloatVec(n);" +
+        "  for (var k = 0; k < n; ++k) { i[k] = (k * 7) % 11 - 5; f[k] = i[k] / 2; }" +
+        "  r.push([i.min(), i.max(), f.min(), f.max(), i.sum(), f.sum()].join(','));" +
+        "});" +
+        "console.log(r.join(';'));";
+      var levels = ["base", "sse4.2", "avx2", "avx512"], out = {}, left = levels.length;
+      var callback = this.callback;
+      levels.forEach(function(level) {
+        var env = {};
+        for (var k in process.env) { env[k] = process.env[k]; }
+        env.VEC_SIMD = level;
+        execFile(process.execPath, ['-e', script], { env: env }, function(err, stdout) {
+          out[level] = err ? String(err) : stdout.trim();
+          if (--left == 0) { callback(null, out); }
+        });
+      });
+    },
+
+    'agrees with base': function(out) {
+      assert.equal(out.base.split(';')[0], "Infinity,-Infinity,Infinity,-Infinity,0,0");
+      assert.equal(out.base.split(';')[1], "-5,-5,-2.5,-2.5,-5,-2.5");
+      assert.equal(out['sse4.2'], out.base);
+      assert.equal(out.avx2, out.base);
+      assert.equal(out.avx512, out.base);
+    }
+  }
+});
+
+suite.addBatch({
+  'an allocation that fails': {
+    // In a child process with its address space capped below the 8GB
+    // that the largest vectors need.
+    topic: function() {
+      var script =
+        "var vec = require(" + JSON.stringify(__dirname + "/../build/default/vec") + ");" +
+        "var r = [], v = new vec.IntVec(10);" +
+        "try { new vec.FloatVec(0x7fffffff); } catch (e) { r.push(e.message); }" +
+        "try { v[0x7ffffff0] = 1; } catch (e) { r.push(e.message); }" +
+        "try { v.fill(1, 0, 0x7fffffff); } catch (e) { r.push(e.message); }" +
+        "try { new vec.FloatMatrix(46340, 46340); } catch (e) { r.push(e.message); }" +
+        "v[20] = 1;" +
+        "r.push(v.length, vec.stats().FloatVec.bytes);" +
+        "console.log(r.join(';'));";
+      var cmd = "ulimit -v 3000000 && exec " + JSON.stringify(process.execPath) + " -e " + JSON.stringify(script);
+      execFile("/bin/sh", ['-c', cmd], this.callback);
+    },
+
+    'throws and leaves the vector usable': function(err, stdout) {
+      // The failed FloatVec counts no bytes.
+      assert.equal(String(stdout).trim(), "Out of memory;Out of memory;Out of memory;Out of memory;21;0");
+    }
+  }
+});
+
+suite.addBatch({
+  'a large vector': {
+    topic: function() {
+      var v = new vec.IntVec(1 << 24);
+      v[(1 << 24) + 5] = 7;
+      return v;
+    },
+
+    'grows lazily zeroed': function(v) {
+      assert.equal(v.length, (1 << 24) + 6);
+      assert.equal(v[1 << 23], 0);
+      assert.equal(v[(1 << 24) + 4], 0);
+      assert.equal(v[(1 << 24) + 5], 7);
+    }
+  }
+});
+
+suite.export(module);
@@ -6,19 +6,158 @@
 #include <v8.h>
 #include <node.h>
 
+#include <string.h>
+#include <errno.h>
+
 #include "bitvec.h"
 #include "intvec.h"
 #include "floatvec.h"
+#include "quantvec.h"
+#include "sparsevec.h"
+#include "sketch.h"
+#include "bitmapindex.h"
+#include "floatmatrix.h"
+#include "vecmem.h"
+#include "kernels.h"
 
 using namespace node;
 using namespace v8;
 
+static Handle<Object>
+stats_object(const VecMemStats& s)
+{
+  HandleScope scope;
+  Handle<Object> obj = Object::New();
+  obj->Set(String::NewSymbol("live"), Number::New(s.live));
+  obj->Set(String::NewSymbol("bytes"), Number::New(s.bytes));
+  obj->Set(String::NewSymbol("peakBytes"), Number::New(s.peak_bytes));
+  obj->Set(String::NewSymbol("allocs"), Number::New(s.allocs));
+  obj->Set(String::NewSymbol("reallocs"), Number::New(s.reallocs));
+  obj->Set(String::NewSymbol("frees"), Number::New(s.frees));
+  obj->Set(String::NewSymbol("copiedBytes"), Number::New(s.copied_bytes));
+  obj->Set(String::NewSymbol("gets"), Number::New(s.gets));
+  obj->Set(String::NewSymbol("sets"), Number::New(s.sets));
+  obj->Set(String::NewSymbol("callbacks"), Number::New(s.callbacks));
+  return scope.Close(obj);
+}
+
+/*
+ * vec.stats() is a snapshot of the storage and access counters, as
+ * {total: {...}, BitVec: {...}, IntVec: {...}, ...}.  Access counts
+ * (gets, sets, callbacks) only advance while vec.trackAccess(true) is in
+ * effect, or VEC_TRACK_ACCESS is set in the environment.
+ */
+static Handle<Value>
+Stats(const Arguments& args)
+{
+  HandleScope scope;
+  VecMemStats classes[MEM_CLASSES], total;
+  vec_mem_snapshot(classes, &total);
+
+  Handle<Object> ret = Object::New();
+  ret->Set(String::NewSymbol("total"), stats_object(total));
+  for (int c = 0; c < MEM_CLASSES; ++c) {
+    ret->Set(String::NewSymbol(vec_mem_class_names[c]), stats_object(classes[c]));
+  }
+  ret->Set(String::NewSymbol("trackAccess"), Boolean::New(vec_track_access));
+  return scope.Close(ret);
+}
+
+static Handle<Value>
+ResetStats(const Arguments& args)
+{
+  vec_mem_reset();
+  return Undefined();
+}
+
+// Turn access counting on or off; returns the previous setting.
+static Handle<Value>
+TrackAccess(const Arguments& args)
+{
+  HandleScope scope;
+  bool prev = vec_track_access;
+  if (args.Length() > 0) { vec_track_access = args[0]->BooleanValue(); }
+  return scope.Close(Boolean::New(prev));
+}
+
+/*
+ * vec.openShared(name) opens the shared memory segment made by share()
+ * on an IntVec, FloatVec or BitVec, in this process or another, as a
+ * vector of the same type over the same storage.  Send workers the name
+ * rather than the contents: opening copies nothing.
+ */
+static Handle<Value>
+OpenShared(const Arguments& args)
+{
+  HandleScope scope;
+  if (args.Length() < 1 || ! args[0]->IsString()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a name")));
+  }
+  String::Utf8Value name(args[0]);
+  int cls;
+  uint32_t length;
+  size_t bytes;
+  void *p = vec_shm_open(*name, &cls, &length, &bytes);
+  if (! p) {
+    return ThrowException(Exception::TypeError(String::Concat(
+        String::New("Cannot open shared memory: "), String::New(strerror(errno)))));
+  }
+
+  switch (cls) {
+  case MEM_BITVEC:
+    if (bytes == sizeof(uint32_t) * (((size_t) length + 31) / 32)) {
+      return scope.Close(BitVec::NewShared((uint32_t *) p, length));
+    }
+    break;
+  case MEM_INTVEC:
+    if (bytes == sizeof(int32_t) * (size_t) length) {
+      return scope.Close(IntVec::NewShared((int32_t *) p, length));
+    }
+    break;
+  case MEM_FLOATVEC:
+    if (bytes == sizeof(float) * (size_t) length) {
+      return scope.Close(FloatVec::NewShared((float *) p, length));
+    }
+    break;
+  }
+  vec_shm_close(cls, p);
+  return ThrowException(Exception::TypeError(String::New("Not a shared vector")));
+}
+
+// Remove a shared vector's name, returning whether it existed.  Vectors
+// already open keep the storage until they are collected.
+static Handle<Value>
+UnlinkShared(const Arguments& args)
+{
+  HandleScope scope;
+  if (args.Length() < 1 || ! args[0]->IsString()) {
+    return ThrowException(Exception::TypeError(String::New("Argument must be a name")));
+  }
+  String::Utf8Value name(args[0]);
+  return scope.Close(Boolean::New(vec_shm_unlink(*name)));
+}
+
 extern "C" {
   static void init (Handle<Object> target)
   {
+    // Kernels for the best SIMD level the CPU supports, or VEC_SIMD's;
+    // vec.simd names it.
+    target->Set(String::NewSymbol("simd"), String::New(simd_level_names[simd_init()]));
+
     BitVec::Init(target);
     IntVec::Init(target);
     FloatVec::Init(target);
+    QuantizedVec::Init(target);
+    SparseFloatVec::Init(target);
+    QuantileSketch::Init(target);
+    BitmapIndex::Init(target);
+    FloatMatrix::Init(target);
+
+    NODE_SET_METHOD(target, "stats", Stats);
+    NODE_SET_METHOD(target, "resetStats", ResetStats);
+    NODE_SET_METHOD(target, "trackAccess", TrackAccess);
+    NODE_SET_METHOD(target, "openShared", OpenShared);
+    NODE_SET_METHOD(target, "unlinkShared", UnlinkShared);
   }
 
   NODE_MODULE(vec, init);
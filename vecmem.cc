@@ -0,0 +1,534 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vecmem.h"
+
+const char *vec_mem_class_names[MEM_CLASSES] = {
+  "BitVec", "IntVec", "FloatVec", "QuantizedVec", "SparseFloatVec", "FloatMatrix"
+};
+
+VecMemStats vec_mem_stats[MEM_CLASSES];
+int vec_track_access = getenv("VEC_TRACK_ACCESS") != 0;
+
+static int64_t total_bytes, total_peak;
+
+// Storage counters are updated atomically, as allocation may happen off
+// the main thread.
+static void
+raise_peak(int64_t *peak, int64_t bytes)
+{
+  int64_t old;
+  while ((old = __sync_fetch_and_add(peak, 0)) < bytes &&
+         ! __sync_bool_compare_and_swap(peak, old, bytes)) {}
+}
+
+static void
+count_bytes(int cls, int64_t delta)
+{
+  VecMemStats *s = &vec_mem_stats[cls];
+  int64_t bytes = __sync_add_and_fetch(&s->bytes, delta);
+  int64_t total = __sync_add_and_fetch(&total_bytes, delta);
+  if (delta > 0) {
+    raise_peak(&s->peak_bytes, bytes);
+    raise_peak(&total_peak, total);
+  }
+}
+
+/*
+ * Slab pools.  Each size class has a global free list, refilled by
+ * carving fresh slabs, and each thread keeps a short cache per class so
+ * most allocations and frees take no lock.  A thread's cache goes back
+ * to the global lists when it exits.  Slabs are never returned to the
+ * system.
+ */
+#define POOL_CLASSES 9          // 16 bytes to VEC_POOL_MAX
+#define SLAB_BYTES (64 * 1024)
+
+struct Block { Block *next; };
+
+struct Pool {
+  pthread_mutex_t lock;
+  Block *free;
+};
+
+struct Cache {
+  Block *free;
+  uint32_t count;
+};
+
+static Pool pools[POOL_CLASSES];
+static __thread Cache caches[POOL_CLASSES];
+static __thread int cache_registered;
+static pthread_key_t cache_key;
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+static inline int
+pool_class(size_t bytes)
+{
+  int c = 0;
+  while ((size_t) (16 << c) < bytes) { ++c; }
+  return c;
+}
+
+static inline size_t class_bytes(int c) { return 16 << c; }
+
+// Blocks a thread may hold per class before handing half back.
+static inline uint32_t cache_max(int c) { return c < 6 ? 64 : 16; }
+
+static void
+cache_flush(int c, uint32_t keep)
+{
+  Cache *cache = &caches[c];
+  if (cache->count <= keep) { return; }
+
+  Block *head = cache->free, *tail = head;
+  for (uint32_t i = keep + 1; i < cache->count; ++i) { tail = tail->next; }
+  cache->free = tail->next;
+  cache->count = keep;
+
+  pthread_mutex_lock(&pools[c].lock);
+  tail->next = pools[c].free;
+  pools[c].free = head;
+  pthread_mutex_unlock(&pools[c].lock);
+}
+
+static void
+thread_exit(void *)
+{
+  for (int c = 0; c < POOL_CLASSES; ++c) { cache_flush(c, 0); }
+}
+
+static void
+pools_init()
+{
+  for (int c = 0; c < POOL_CLASSES; ++c) {
+    pthread_mutex_init(&pools[c].lock, 0);
+    pools[c].free = 0;
+  }
+  pthread_key_create(&cache_key, thread_exit);
+}
+
+// The first time a thread touches the pools, arrange for its cache to be
+// flushed when it exits.
+static inline void
+cache_register()
+{
+  if (! cache_registered) {
+    pthread_once(&pools_once, pools_init);
+    pthread_setspecific(cache_key, caches);
+    cache_registered = 1;
+  }
+}
+
+// Move up to half a cache's worth of blocks from the global list,
+// carving a new slab first if it is empty.
+static void
+cache_refill(int c)
+{
+  cache_register();
+
+  Pool *pool = &pools[c];
+  pthread_mutex_lock(&pool->lock);
+  if (! pool->free) {
+    size_t size = class_bytes(c);
+    void *mem;
+    if (posix_memalign(&mem, VEC_ALIGN, SLAB_BYTES)) { mem = 0; }
+    char *slab = (char *) mem;
+    for (size_t off = 0; slab && off + size <= SLAB_BYTES; off += size) {
+      Block *b = (Block *) (slab + off);
+      b->next = pool->free;
+      pool->free = b;
+    }
+  }
+  Cache *cache = &caches[c];
+  for (uint32_t n = cache_max(c) / 2; n && pool->free; --n) {
+    Block *b = pool->free;
+    pool->free = b->next;
+    b->next = cache->free;
+    cache->free = b;
+    ++cache->count;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *
+pool_alloc(size_t bytes)
+{
+  int c = pool_class(bytes);
+  Cache *cache = &caches[c];
+  if (! cache->free) { cache_refill(c); }
+  if (! cache->free) { return 0; }
+
+  Block *b = cache->free;
+  cache->free = b->next;
+  --cache->count;
+  memset(b, 0, bytes);
+  return b;
+}
+
+static void
+pool_free(void *p, size_t bytes)
+{
+  int c = pool_class(bytes);
+  Cache *cache = &caches[c];
+  Block *b = (Block *) p;
+  b->next = cache->free;
+  cache->free = b;
+  if (++cache->count > cache_max(c)) {
+    cache_register();
+    cache_flush(c, cache_max(c) / 2);
+  }
+}
+
+/*
+ * Storage tiers by size: pool blocks; 64-byte aligned heap blocks; and
+ * from VEC_MAP_MIN up, private anonymous mappings.  Fresh mappings are
+ * zero pages the kernel only fills in when touched, and grow with mremap
+ * without copying or zeroing anything.  Mappings of 2MB and more are
+ * advised to use transparent huge pages.
+ */
+enum { TIER_POOL, TIER_HEAP, TIER_MAP };
+
+static inline int
+tier(size_t bytes)
+{
+  return bytes <= VEC_POOL_MAX ? TIER_POOL : bytes < VEC_MAP_MIN ? TIER_HEAP : TIER_MAP;
+}
+
+static inline size_t
+page_round(size_t bytes)
+{
+  static size_t page = sysconf(_SC_PAGESIZE);
+  return (bytes + page - 1) & ~(page - 1);
+}
+
+static void
+map_advise(void *p, size_t len)
+{
+#if defined(MADV_HUGEPAGE)
+  if (len >= (2 << 20)) { madvise(p, len, MADV_HUGEPAGE); }
+#endif
+}
+
+static void *
+map_alloc(size_t bytes)
+{
+  size_t len = page_round(bytes);
+  void *p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) { return 0; }
+  map_advise(p, len);
+  return p;
+}
+
+// Zero-filled storage of a tier.
+static void *
+tier_alloc(size_t bytes)
+{
+  void *p;
+  switch (tier(bytes)) {
+  case TIER_POOL:
+    return pool_alloc(bytes);
+  case TIER_HEAP:
+    if (posix_memalign(&p, VEC_ALIGN, bytes)) { return 0; }
+    memset(p, 0, bytes);
+    return p;
+  default:
+    return map_alloc(bytes);
+  }
+}
+
+static void
+tier_free(void *p, size_t bytes)
+{
+  switch (tier(bytes)) {
+  case TIER_POOL: pool_free(p, bytes); break;
+  case TIER_HEAP: free(p); break;
+  default: munmap(p, page_round(bytes)); break;
+  }
+}
+
+void *
+vec_alloc(int cls, size_t bytes)
+{
+  void *p = tier_alloc(bytes);
+  if (! p) { return 0; }
+  __sync_add_and_fetch(&vec_mem_stats[cls].allocs, 1);
+  count_bytes(cls, bytes);
+  return p;
+}
+
+void *
+vec_realloc(int cls, void *p, size_t old_bytes, size_t new_bytes)
+{
+  if (! p) { return vec_alloc(cls, new_bytes); }
+
+  void *q = p;
+  size_t copied = 0;
+  int from = tier(old_bytes), to = tier(new_bytes);
+
+  if (from == TIER_MAP && to == TIER_MAP) {
+    size_t old_len = page_round(old_bytes), new_len = page_round(new_bytes);
+    // The tail of the last page may hold data from before a shrink.
+    if (new_bytes > old_bytes) {
+      size_t end = new_len < old_len ? new_len : old_len;
+      if (end > old_bytes) { memset((char *) p + old_bytes, 0, end - old_bytes); }
+    }
+    if (new_len != old_len) {
+#if defined(__linux__)
+      q = mremap(p, old_len, new_len, MREMAP_MAYMOVE);
+      if (q == MAP_FAILED) { return 0; }
+      map_advise(q, new_len);
+#else
+      q = map_alloc(new_bytes);
+      if (! q) { return 0; }
+      copied = old_bytes < new_bytes ? old_bytes : new_bytes;
+      memcpy(q, p, copied);
+      munmap(p, old_len);
+#endif
+    }
+  } else if (from == TIER_POOL && to == TIER_POOL && pool_class(old_bytes) == pool_class(new_bytes)) {
+    // Within a block's size class there is nothing to move.
+    if (new_bytes > old_bytes) { memset((char *) p + old_bytes, 0, new_bytes - old_bytes); }
+  } else {
+    q = tier_alloc(new_bytes);
+    if (! q) { return 0; }
+    copied = old_bytes < new_bytes ? old_bytes : new_bytes;
+    memcpy(q, p, copied);
+    tier_free(p, old_bytes);
+  }
+
+  __sync_add_and_fetch(&vec_mem_stats[cls].reallocs, 1);
+  __sync_add_and_fetch(&vec_mem_stats[cls].copied_bytes, copied);
+  count_bytes(cls, (int64_t) new_bytes - (int64_t) old_bytes);
+  return q;
+}
+
+void
+vec_free(int cls, void *p, size_t bytes)
+{
+  if (! p) { return; }
+  tier_free(p, bytes);
+  __sync_add_and_fetch(&vec_mem_stats[cls].frees, 1);
+  count_bytes(cls, -(int64_t) bytes);
+}
+
+void *
+vec_grow(int cls, void *p, void *inline_buf, size_t old_bytes, size_t new_bytes)
+{
+  if (new_bytes <= VEC_INLINE_BYTES && (! p || p == inline_buf)) { return inline_buf; }
+  if (p != inline_buf) { return vec_realloc(cls, p, old_bytes, new_bytes); }
+
+  void *q = vec_alloc(cls, new_bytes);
+  if (q) { memcpy(q, inline_buf, old_bytes); }
+  return q;
+}
+
+void
+vec_release(int cls, void *p, void *inline_buf, size_t bytes)
+{
+  if (p != inline_buf) { vec_free(cls, p, bytes); }
+}
+
+VecShare *
+vec_share(VecShare *share)
+{
+  if (! share) {
+    share = (VecShare *) malloc(sizeof(VecShare));
+    share->refs = 2;
+  } else {
+    __sync_add_and_fetch(&share->refs, 1);
+  }
+  return share;
+}
+
+bool
+vec_unshare_release(VecShare **share)
+{
+  bool last = __sync_sub_and_fetch(&(*share)->refs, 1) == 0;
+  if (last) { free(*share); }
+  *share = 0;
+  return last;
+}
+
+void *
+vec_unshare(int cls, void *p, size_t bytes, VecShare **share)
+{
+  // Any other user still reads p, which stays theirs.
+  if (vec_unshare_release(share)) { return p; }
+
+  void *q = vec_alloc(cls, bytes);
+  memcpy(q, p, bytes);
+  __sync_add_and_fetch(&vec_mem_stats[cls].copied_bytes, bytes);
+  return q;
+}
+
+/*
+ * A shared segment is one mapping: a header in the first VEC_ALIGN
+ * bytes, then the storage.  The creator writes magic last, so an opener
+ * racing it sees either a whole header or a bad one.
+ */
+#define SHM_MAGIC 0x53434556  // "VECS"
+#define SHM_HEADER VEC_ALIGN
+
+struct ShmHeader {
+  uint32_t magic;
+  int32_t cls;
+  uint32_t length;
+  uint64_t bytes;     // of storage
+  uint64_t map_len;   // of the whole mapping
+};
+
+typedef char shm_header_fits[sizeof(ShmHeader) <= SHM_HEADER ? 1 : -1];
+
+static bool
+shm_path(const char *name, char *path)
+{
+  if (*name == '/') { ++name; }
+  size_t len = strlen(name);
+  if (len == 0 || len > VEC_SHM_NAME_MAX || strchr(name, '/')) {
+    errno = EINVAL;
+    return false;
+  }
+  path[0] = '/';
+  memcpy(path + 1, name, len + 1);
+  return true;
+}
+
+void *
+vec_shm_create(const char *name, int cls, uint32_t length, size_t bytes)
+{
+  char path[VEC_SHM_NAME_MAX + 2];
+  if (! shm_path(name, path)) { return 0; }
+
+  int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) { return 0; }
+  size_t len = page_round(SHM_HEADER + bytes);
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, len) == 0) {
+    p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  int err = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(path);
+    errno = err;
+    return 0;
+  }
+
+  ShmHeader *h = (ShmHeader *) p;
+  h->cls = cls;
+  h->length = length;
+  h->bytes = bytes;
+  h->map_len = len;
+  __sync_synchronize();
+  h->magic = SHM_MAGIC;
+
+  __sync_add_and_fetch(&vec_mem_stats[cls].allocs, 1);
+  count_bytes(cls, len);
+  return (char *) p + SHM_HEADER;
+}
+
+void *
+vec_shm_open(const char *name, int *cls, uint32_t *length, size_t *bytes)
+{
+  char path[VEC_SHM_NAME_MAX + 2];
+  if (! shm_path(name, path)) { return 0; }
+
+  int fd = shm_open(path, O_RDWR, 0);
+  if (fd < 0) { return 0; }
+  struct stat st;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0) {
+    if (st.st_size < SHM_HEADER) {
+      errno = EINVAL;
+    } else {
+      p = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+  }
+  int err = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    errno = err;
+    return 0;
+  }
+
+  ShmHeader *h = (ShmHeader *) p;
+  if (h->magic != SHM_MAGIC || h->cls < 0 || h->cls >= MEM_CLASSES ||
+      h->map_len != (uint64_t) st.st_size || SHM_HEADER + h->bytes > h->map_len) {
+    munmap(p, st.st_size);
+    errno = EINVAL;
+    return 0;
+  }
+  *cls = h->cls;
+  *length = h->length;
+  *bytes = h->bytes;
+
+  __sync_add_and_fetch(&vec_mem_stats[h->cls].allocs, 1);
+  count_bytes(h->cls, h->map_len);
+  return (char *) p + SHM_HEADER;
+}
+
+void
+vec_shm_close(int cls, void *p)
+{
+  ShmHeader *h = (ShmHeader *) ((char *) p - SHM_HEADER);
+  size_t len = h->map_len;
+  munmap(h, len);
+  __sync_add_and_fetch(&vec_mem_stats[cls].frees, 1);
+  count_bytes(cls, -(int64_t) len);
+}
+
+bool
+vec_shm_unlink(const char *name)
+{
+  char path[VEC_SHM_NAME_MAX + 2];
+  return shm_path(name, path) && shm_unlink(path) == 0;
+}
+
+void
+vec_live(int cls, int delta)
+{
+  __sync_add_and_fetch(&vec_mem_stats[cls].live, delta);
+}
+
+void
+vec_mem_snapshot(VecMemStats *classes, VecMemStats *total)
+{
+  memcpy(classes, vec_mem_stats, sizeof(vec_mem_stats));
+  memset(total, 0, sizeof(*total));
+  for (int c = 0; c < MEM_CLASSES; ++c) {
+    total->live += classes[c].live;
+    total->bytes += classes[c].bytes;
+    total->allocs += classes[c].allocs;
+    total->reallocs += classes[c].reallocs;
+    total->frees += classes[c].frees;
+    total->copied_bytes += classes[c].copied_bytes;
+    total->gets += classes[c].gets;
+    total->sets += classes[c].sets;
+    total->callbacks += classes[c].callbacks;
+  }
+  total->peak_bytes = total_peak;
+}
+
+void
+vec_mem_reset()
+{
+  for (int c = 0; c < MEM_CLASSES; ++c) {
+    VecMemStats *s = &vec_mem_stats[c];
+    s->allocs = s->reallocs = s->frees = s->copied_bytes = 0;
+    s->gets = s->sets = s->callbacks = 0;
+    s->peak_bytes = s->bytes;
+  }
+  total_peak = total_bytes;
+}
@@ -0,0 +1,117 @@
+/* This code is PUBLIC DOMAIN, and is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND. See the accompanying
+* LICENSE file.
+*/
+
+/*
+ * Storage for the vector types, with allocation and access counters per
+ * class.  Nothing in here knows about V8: the vector classes still report
+ * their storage to V8 themselves, and vec.cc exposes the counters as
+ * vec.stats().
+ */
+
+#ifndef VECMEM_H
+#define VECMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum { MEM_BITVEC, MEM_INTVEC, MEM_FLOATVEC, MEM_QUANTVEC, MEM_SPARSEVEC, MEM_FLOATMATRIX, MEM_CLASSES };
+extern const char *vec_mem_class_names[MEM_CLASSES];
+
+struct VecMemStats {
+  int64_t live;          // vectors alive
+  int64_t bytes;         // storage bytes held
+  int64_t peak_bytes;    // high-water mark of bytes since the last reset
+  int64_t allocs;
+  int64_t reallocs;
+  int64_t frees;
+  int64_t copied_bytes;  // bytes moved when a reallocation moved storage
+
+  // Only counted while access tracking is on.
+  int64_t gets;          // indexed reads through the interceptors
+  int64_t sets;          // indexed writes through the interceptors
+  int64_t callbacks;     // calls into JS from forEach, map, reduce...
+};
+
+extern VecMemStats vec_mem_stats[MEM_CLASSES];
+extern int vec_track_access;
+
+/*
+ * Zero-filled storage.  Callers pass the size they asked for back to
+ * vec_realloc and vec_free.  Growing keeps the contents and zero-fills
+ * the new bytes.  Requests up to VEC_POOL_MAX bytes are served from
+ * power-of-two slab pools, through a per-thread cache of free blocks, so
+ * any thread may allocate and free.  Larger ones are VEC_ALIGN aligned
+ * heap blocks, and from VEC_MAP_MIN up lazily zeroed anonymous mappings
+ * that grow in place with mremap.  Any of these of 64 bytes or more is
+ * VEC_ALIGN aligned (inline buffers, below, are not).  All return 0
+ * when out of memory, and vec_realloc then leaves p as it was.
+ */
+#define VEC_POOL_MAX 4096
+#define VEC_MAP_MIN (1 << 20)
+#define VEC_ALIGN 64
+
+void *vec_alloc(int cls, size_t bytes);
+void *vec_realloc(int cls, void *p, size_t old_bytes, size_t new_bytes);
+void vec_free(int cls, void *p, size_t bytes);
+
+/*
+ * Storage that starts in a buffer of VEC_INLINE_BYTES inside the owning
+ * object, which must be zeroed, and moves to the heap once it outgrows
+ * it.  p is the current storage (0, inline_buf or heap); vec_grow
+ * returns 0, leaving it as it was, when out of memory.
+ */
+#define VEC_INLINE_BYTES 64
+
+void *vec_grow(int cls, void *p, void *inline_buf, size_t old_bytes, size_t new_bytes);
+void vec_release(int cls, void *p, void *inline_buf, size_t bytes);
+
+/*
+ * Copy-on-write sharing of heap storage between clones.  A VecShare
+ * counts the vectors using one buffer; each holds the same share.
+ * vec_share adds a user (making the share on first use), vec_unshare
+ * gives a writer storage of its own (copying unless it was the last
+ * user), and vec_unshare_release drops a user, returning true if the
+ * caller was the last and must free the storage.
+ */
+struct VecShare { int refs; };
+
+VecShare *vec_share(VecShare *share);
+void *vec_unshare(int cls, void *p, size_t bytes, VecShare **share);
+bool vec_unshare_release(VecShare **share);
+
+/*
+ * Storage in a named POSIX shared memory segment, which other processes
+ * (and threads) map by name to see and write the same elements.  The
+ * segment records the class and length of the vector it holds.
+ * vec_shm_create makes a zeroed segment, failing if the name is taken;
+ * vec_shm_open maps an existing one and reports what it holds; both
+ * return the storage, or 0 with errno set.  vec_shm_close unmaps storage
+ * from either, and vec_shm_unlink removes a name, leaving mappings of it
+ * alone.  Names are up to VEC_SHM_NAME_MAX characters with no '/' but an
+ * optional leading one.
+ */
+#define VEC_SHM_NAME_MAX 200
+
+void *vec_shm_create(const char *name, int cls, uint32_t length, size_t bytes);
+void *vec_shm_open(const char *name, int *cls, uint32_t *length, size_t *bytes);
+void vec_shm_close(int cls, void *p);
+bool vec_shm_unlink(const char *name);
+
+// Constructors and destructors count live vectors.
+void vec_live(int cls, int delta);
+
+// An access counter bump that costs one predictable branch when off.
+#define VEC_COUNT(cls, field) \
+  do { if (__builtin_expect(vec_track_access, 0)) { ++vec_mem_stats[cls].field; } } while (0)
+
+// Copy out all classes' counters, and the sum over them into total
+// (whose peak_bytes is the peak of the sum, not the sum of the peaks).
+void vec_mem_snapshot(VecMemStats *classes, VecMemStats *total);
+
+// Zero the event counters and restart the peaks from current usage;
+// live and bytes describe the present and are kept.
+void vec_mem_reset();
+
+#endif